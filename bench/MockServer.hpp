@@ -0,0 +1,420 @@
+/*
+A small HTTP/1.1 server that imitates the parts of the Reddit API that CRAW++ uses,
+answering from the fixtures directory. It can inject latency, rate limiting (HTTP 429)
+and server errors (HTTP 5xx) so that the library can be load-tested locally. Like Reddit,
+it gzips responses for clients that accept it.
+
+This is a test tool only: it trusts its clients, handles one connection per thread and
+speaks plain HTTP.
+*/
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CRAW {
+    namespace bench {
+
+        /**
+         * @brief The faults and sizes that a MockServer should simulate. The default
+         * values make a fast, reliable server.
+         */
+        struct MockOptions {
+            /// How long to wait before answering each request
+            std::chrono::microseconds latency;
+
+            /// A random amount of up to this much is added to the latency of each request
+            std::chrono::microseconds jitter;
+
+            /// The fraction of requests (0 to 1) that are slow, like those that hit an overloaded backend
+            double slowrate;
+
+            /// How much latency is added to slow requests
+            std::chrono::microseconds slowlatency;
+
+            /// The fraction of requests (0 to 1) that are answered with HTTP 429 (Too Many Requests)
+            double rate429;
+
+            /// The fraction of requests (0 to 1) that are answered with HTTP 503 (Service Unavailable)
+            double rate5xx;
+
+            /// How many pages each listing has before it runs out
+            int pages;
+
+            /// How many posts are added to the newest ("new") listing each time it is fetched,
+            /// so that streams find new posts on every poll
+            int newposts;
+
+            MockOptions () {
+                latency = std::chrono::microseconds(0);
+                jitter = std::chrono::microseconds(0);
+                slowrate = 0;
+                slowlatency = std::chrono::milliseconds(500);
+                rate429 = 0;
+                rate5xx = 0;
+                pages = 10;
+                newposts = 5;
+            }
+        };
+
+        /**
+         * @brief A local imitation of the Reddit API.
+         */
+        class MockServer {
+            private:
+                MockOptions _options;
+                int _socket;
+
+                std::string _token;
+                std::string _about;
+                std::string _user;
+                std::string _comments;
+                std::string _inbox;
+                std::string _reply;
+                std::string _notfound;
+
+                /// The pages of every listing, where page n is the one after "t3_pagen"
+                std::vector<std::string> _listing;
+
+                /// What the posts of the newest listing and the subreddits of /api/info are made from
+                nlohmann::json _post;
+                nlohmann::json _subreddit;
+
+                /// The number of posts that have been added to the newest listing
+                std::atomic<uint64_t> _posted;
+
+                /// The gzipped version of each of the bodies above
+                std::map<const std::string *, std::string> _gzipped;
+
+                /// Compress a body with gzip
+                static std::string _gzip (const std::string & body) {
+                    z_stream stream {};
+                    // 31 is the largest window with a gzip header rather than a zlib one
+                    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+                    std::string compressed(deflateBound(&stream, body.size()), '\0');
+                    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+                    stream.avail_in = body.size();
+                    stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+                    stream.avail_out = compressed.size();
+                    deflate(&stream, Z_FINISH);
+                    compressed.resize(stream.total_out);
+                    deflateEnd(&stream);
+                    return compressed;
+                }
+
+                /// Load the response body of a fixture
+                static nlohmann::json _fixture (const std::string & directory, const std::string & name) {
+                    std::ifstream file(directory + "/" + name);
+                    if (!file) {
+                        throw std::runtime_error("Could not open fixture " + directory + "/" + name);
+                    }
+                    return nlohmann::json::parse(file)["response"];
+                }
+
+                /// Send all of a buffer, returning false if the connection was closed
+                static bool _write (int connection, const std::string & data) {
+                    size_t sent = 0;
+                    while (sent < data.size()) {
+                        ssize_t written = ::send(connection, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                        if (written <= 0) {
+                            return false;
+                        }
+                        sent += written;
+                    }
+                    return true;
+                }
+
+                /// Decode a query parameter's value
+                static std::string _unescape (const std::string & value) {
+                    std::string decoded;
+                    for (size_t i = 0; i < value.size(); i++) {
+                        if (value[i] == '%' && i + 2 < value.size()) {
+                            decoded += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+                            i += 2;
+                        } else {
+                            decoded += value[i] == '+' ? ' ' : value[i];
+                        }
+                    }
+                    return decoded;
+                }
+
+                /// The value of a query parameter, or "" if it isn't there
+                static std::string _parameter (const std::string & query, const std::string & name) {
+                    for (size_t start = 0; start < query.size();) {
+                        size_t end = std::min(query.find('&', start), query.size());
+                        if (query.compare(start, name.size() + 1, name + "=") == 0) {
+                            return _unescape(query.substr(start + name.size() + 1, end - start - name.size() - 1));
+                        }
+                        start = end + 1;
+                    }
+                    return "";
+                }
+
+                /// The newest listing, with newposts more posts in it than the last time it was fetched
+                std::string _newest (const std::string & query) {
+                    std::string limit = _parameter(query, "limit");
+                    int count = std::clamp(limit == "" ? 25 : std::stoi(limit), 1, 100);
+                    uint64_t newest = _posted.fetch_add(_options.newposts) + _options.newposts;
+                    nlohmann::json children = nlohmann::json::array();
+                    for (int i = 0; i < count && static_cast<uint64_t>(i) < newest; i++) {
+                        nlohmann::json child = _post;
+                        std::string id = "new" + std::to_string(newest - i);
+                        child["data"]["id"] = id;
+                        child["data"]["name"] = "t3_" + id;
+                        children.push_back(std::move(child));
+                    }
+                    return nlohmann::json{{"kind", "Listing"}, {"data", {{"children", children}, {"after", nullptr}, {"before", nullptr}}}}.dump();
+                }
+
+                /// A listing of the subreddits asked for by name (sr_name) or fullname (id), all of which exist
+                std::string _info (const std::string & query) {
+                    std::string ids = _parameter(query, "id");
+                    std::string names = ids == "" ? _parameter(query, "sr_name") : ids;
+                    nlohmann::json children = nlohmann::json::array();
+                    std::stringstream list(names);
+                    for (std::string name; std::getline(list, name, ',');) {
+                        nlohmann::json child = _subreddit;
+                        child["data"]["name"] = ids == "" ? "t5_" + name : name;
+                        if (ids == "") {
+                            child["data"]["display_name"] = name;
+                        }
+                        children.push_back(std::move(child));
+                    }
+                    return nlohmann::json{{"kind", "Listing"}, {"data", {{"children", children}, {"after", nullptr}, {"before", nullptr}}}}.dump();
+                }
+
+                /// Pick the body of the response to a request. Bodies that are made for the
+                /// request, rather than loaded from the fixtures, are put in generated.
+                const std::string & _route (const std::string & method, const std::string & target, int & status, std::string & generated) {
+                    std::string path = target.substr(0, target.find('?'));
+                    std::string query = target.find('?') == std::string::npos ? "" : target.substr(target.find('?') + 1);
+                    status = 200;
+
+                    if (method == "POST" && path == "/api/v1/access_token") {
+                        return _token;
+                    }
+                    if (method == "POST" && path == "/api/comment") {
+                        return _reply;
+                    }
+                    if (path == "/api/info") {
+                        generated = _info(query);
+                        return generated;
+                    }
+                    if (path.rfind("/comments/", 0) == 0) {
+                        return _comments;
+                    }
+                    if (path.rfind("/message/", 0) == 0) {
+                        return _inbox;
+                    }
+                    if (path.rfind("/user/", 0) == 0 && path.size() > 6 && path.substr(path.size() - 6) == "/about") {
+                        return _user;
+                    }
+                    if (path.rfind("/r/", 0) == 0) {
+                        if (path.size() > 6 && path.substr(path.size() - 6) == "/about") {
+                            return _about;
+                        }
+                        if (path.size() > 4 && path.substr(path.size() - 4) == "/new" && query.find("after=") == std::string::npos) {
+                            generated = _newest(query);
+                            return generated;
+                        }
+                        size_t page = 0;
+                        size_t after = query.find("after=t3_page");
+                        if (after != std::string::npos) {
+                            page = std::stoul(query.substr(after + 13));
+                        }
+                        if (page < _listing.size()) {
+                            return _listing[page];
+                        }
+                    }
+                    status = 404;
+                    return _notfound;
+                }
+
+                /// Answer requests on one connection until the client closes it
+                void _handle (int connection) {
+                    thread_local std::mt19937 random(std::random_device{}());
+                    std::uniform_real_distribution<double> chance(0, 1);
+                    std::string buffer;
+                    char chunk [16384];
+
+                    while (true) {
+                        size_t end;
+                        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+                            ssize_t received = ::recv(connection, chunk, sizeof(chunk), 0);
+                            if (received <= 0) {
+                                close(connection);
+                                return;
+                            }
+                            buffer.append(chunk, received);
+                        }
+                        std::string head = buffer.substr(0, end);
+                        size_t length = 0;
+                        bool gzip = false;
+                        for (size_t line = head.find("\r\n"); line != std::string::npos; line = head.find("\r\n", line + 2)) {
+                            std::string header = head.substr(line + 2, head.find("\r\n", line + 2) - line - 2);
+                            for (size_t i = 0; i < header.find(':') && i < header.size(); i++) {
+                                header[i] = std::tolower(header[i]);
+                            }
+                            if (header.rfind("content-length:", 0) == 0) {
+                                length = std::stoul(header.substr(15));
+                            } else if (header.rfind("accept-encoding:", 0) == 0) {
+                                gzip = header.find("gzip") != std::string::npos;
+                            }
+                        }
+                        while (buffer.size() < end + 4 + length) {
+                            ssize_t received = ::recv(connection, chunk, sizeof(chunk), 0);
+                            if (received <= 0) {
+                                close(connection);
+                                return;
+                            }
+                            buffer.append(chunk, received);
+                        }
+                        std::string method = head.substr(0, head.find(' '));
+                        std::string target = head.substr(method.size() + 1, head.find(' ', method.size() + 1) - method.size() - 1);
+                        buffer.erase(0, end + 4 + length);
+
+                        std::chrono::microseconds delay = _options.latency;
+                        if (_options.jitter.count() > 0) {
+                            delay += std::chrono::microseconds(random() % _options.jitter.count());
+                        }
+                        if (_options.slowrate > 0 && chance(random) < _options.slowrate) {
+                            delay += _options.slowlatency;
+                        }
+                        if (delay.count() > 0) {
+                            std::this_thread::sleep_for(delay);
+                        }
+
+                        int status;
+                        std::string body;
+                        std::string encoding;
+                        double roll = chance(random);
+                        if (roll < _options.rate429) {
+                            status = 429;
+                            body = "{\"message\": \"Too Many Requests\", \"error\": 429}";
+                        } else if (roll < _options.rate429 + _options.rate5xx) {
+                            status = 503;
+                            body = "{\"message\": \"Service Unavailable\", \"error\": 503}";
+                        } else {
+                            std::string generated;
+                            const std::string & routed = _route(method, target, status, generated);
+                            if (gzip) {
+                                auto cached = _gzipped.find(&routed);
+                                body = cached == _gzipped.end() ? _gzip(routed) : cached->second;
+                                encoding = "Content-Encoding: gzip\r\n";
+                            } else {
+                                body = routed;
+                            }
+                        }
+                        std::string response = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error") + "\r\n"
+                                               "Content-Type: application/json; charset=UTF-8\r\n"
+                                               "Content-Length: " + std::to_string(body.size()) + "\r\n" + encoding +
+                                               "x-ratelimit-remaining: 600.0\r\n"
+                                               "x-ratelimit-used: 0\r\n"
+                                               "x-ratelimit-reset: 600\r\n"
+                                               "Connection: keep-alive\r\n\r\n" + body;
+                        if (!_write(connection, response)) {
+                            close(connection);
+                            return;
+                        }
+                    }
+                }
+
+            public:
+                /**
+                 * @brief Construct a new MockServer
+                 *
+                 * @param fixtures The fixtures directory to answer requests from
+                 * @param options The faults to inject
+                 */
+                MockServer (const std::string & fixtures, const MockOptions & options = MockOptions()) {
+                    _options = options;
+                    _socket = -1;
+                    _posted = 0;
+                    _token = _fixture(fixtures, "access_token.json").dump();
+                    _about = _fixture(fixtures, "subreddit_about.json").dump();
+                    _user = _fixture(fixtures, "redditor_about.json").dump();
+                    _comments = _fixture(fixtures, "comments.json").dump();
+                    _inbox = _fixture(fixtures, "inbox.json").dump();
+                    _reply = _fixture(fixtures, "comments.json")[1]["data"]["children"][0]["data"].dump();
+                    _notfound = "{\"message\": \"Not Found\", \"error\": 404}";
+
+                    nlohmann::json listing = _fixture(fixtures, "listing_hot.json");
+                    _post = listing["data"]["children"][0];
+                    _subreddit = _fixture(fixtures, "subreddit_about.json");
+                    for (int page = 0; page < options.pages; page++) {
+                        listing["data"]["before"] = page == 0 ? nlohmann::json() : nlohmann::json("t3_page" + std::to_string(page - 1));
+                        listing["data"]["after"] = page + 1 == options.pages ? nlohmann::json() : nlohmann::json("t3_page" + std::to_string(page + 1));
+                        _listing.emplace_back(listing.dump());
+                    }
+                    for (const std::string * body : {&_token, &_about, &_user, &_comments, &_inbox, &_reply, &_notfound}) {
+                        _gzipped[body] = _gzip(*body);
+                    }
+                    for (const std::string & page : _listing) {
+                        _gzipped[&page] = _gzip(page);
+                    }
+                }
+
+                ~MockServer () {
+                    if (_socket >= 0) {
+                        close(_socket);
+                    }
+                }
+
+                /**
+                 * @brief Start listening on the loopback interface.
+                 *
+                 * @param port The port to listen on (default: 0, which picks a free one)
+                 * @return int The port that the server is listening on
+                 */
+                int listen (int port = 0) {
+                    _socket = ::socket(AF_INET, SOCK_STREAM, 0);
+                    int yes = 1;
+                    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                    sockaddr_in address {};
+                    address.sin_family = AF_INET;
+                    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                    address.sin_port = htons(port);
+                    if (::bind(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+                        ::listen(_socket, 1024) != 0) {
+                        throw std::runtime_error("Could not listen on port " + std::to_string(port));
+                    }
+                    socklen_t size = sizeof(address);
+                    getsockname(_socket, reinterpret_cast<sockaddr *>(&address), &size);
+                    return ntohs(address.sin_port);
+                }
+
+                /**
+                 * @brief Accept and answer connections forever, with one thread per connection.
+                 */
+                void serve () {
+                    while (true) {
+                        int connection = ::accept(_socket, nullptr, nullptr);
+                        if (connection < 0) {
+                            continue;
+                        }
+                        int yes = 1;
+                        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                        std::thread(&MockServer::_handle, this, connection).detach();
+                    }
+                }
+        };
+    }
+}
@@ -0,0 +1,413 @@
+/*
+A load generator that runs CRAW++'s high-level calls against a local mock of the Reddit
+API and reports throughput, tail latency, retries, and the CPU cost and bytes received
+per request.
+
+By default a MockServer is started in a child process (so that its CPU time isn't counted)
+and the load is run once for each thread count given. Run "loadtest --help" for the options.
+*/
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crawpp/craw.h"
+#include "MockServer.hpp"
+
+/// What one worker thread measured
+struct Samples {
+    /// The latency of every HTTP request, in seconds
+    std::vector<double> requests;
+
+    /// The latency of every high-level call, in seconds
+    std::vector<double> operations;
+
+    /// Response body bytes received over the network
+    size_t wirebytes = 0;
+
+    /// Connections opened, and responses that came over HTTP/2
+    size_t connections = 0;
+    size_t http2 = 0;
+
+    size_t retries = 0;
+    size_t ratelimited = 0;
+    size_t servererrors = 0;
+    size_t failures = 0;
+};
+
+/// The Samples of the worker running on this thread
+thread_local Samples * current = nullptr;
+
+/// The Samples of requests sent from threads that aren't workers, such as hedged requests
+static Samples background;
+static std::mutex backgroundlock;
+static bool measuring = false;
+
+/**
+ * A Transport that passes requests on to another Transport and measures them
+ */
+class MeasuringTransport : public CRAW::Transport {
+    private:
+        std::shared_ptr<CRAW::Transport> _inner;
+    public:
+        MeasuringTransport (std::shared_ptr<CRAW::Transport> inner) {
+            _inner = inner;
+        }
+
+        CRAW::HTTPResponse send (const CRAW::HTTPRequest & request) override {
+            auto start = std::chrono::steady_clock::now();
+            CRAW::HTTPResponse response = _inner->send(request);
+            std::unique_lock<std::mutex> guard(backgroundlock, std::defer_lock);
+            Samples * samples = current;
+            if (samples == nullptr) {
+                guard.lock();
+                samples = measuring ? &background : nullptr;
+            }
+            if (samples != nullptr) {
+                samples->requests.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                samples->wirebytes += response.wirebytes;
+                samples->connections += response.newconnections;
+                samples->http2 += response.httpversion == "HTTP/2";
+                samples->retries += request.attempt > 0;
+                samples->ratelimited += response.status_code == 429;
+                samples->servererrors += response.status_code >= 500;
+            }
+            return response;
+        }
+};
+
+struct Options {
+    std::vector<int> threads = {1, 4, 16};
+    int sessions = 1;
+    double duration = 10;
+    std::string scenario = "mixed";
+    bool compression = true;
+    std::string transport = "cpr";
+    long connections = 2;
+    std::string cacert = "";
+    double hedge = 0;
+    int batch = 100;
+    std::chrono::milliseconds poll = std::chrono::milliseconds(0);
+    std::string url = "";
+    std::string fixtures = "fixtures";
+    int serve = -1;
+    CRAW::bench::MockOptions mock;
+};
+
+/// The ID of the post in the comments fixture
+static std::string fixturepost (const std::string & fixtures) {
+    std::ifstream file(fixtures + "/comments.json");
+    std::string path = nlohmann::json::parse(file)["path"];
+    return path.substr(path.find_last_of('/') + 1);
+}
+
+/// Run one worker until the deadline
+static void worker (CRAW::Reddit * reddit, const Options & options, const std::string & postid,
+                    std::chrono::steady_clock::time_point deadline, Samples * samples) {
+    current = samples;
+    std::optional<CRAW::Subreddit> subreddit;
+    std::optional<CRAW::Post> post;
+    std::optional<CRAW::Stream<CRAW::Post>> stream;
+    while (!post.has_value()) {
+        // keep trying, in case the server is injecting a lot of faults
+        try {
+            subreddit.emplace(reddit->subreddit("cpp"));
+            post.emplace(reddit->post(postid));
+        } catch (const CRAW::errors::CRAWError &) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return;
+            }
+        }
+    }
+    CRAW::ListingPage page;
+    if (options.scenario == "stream") {
+        stream.emplace(subreddit->stream(true));
+        stream->interval = options.poll;
+        stream->maxinterval = std::max(options.poll, std::chrono::milliseconds(100));
+    }
+    // a stream waiting for new posts gives up at the deadline
+    CRAW::CancellationToken stop(deadline);
+    std::vector<std::string> names;
+    for (int i = 0; i < options.batch; i++) {
+        names.push_back("loadtest" + std::to_string(i));
+    }
+    samples->requests.clear();
+    samples->connections = samples->http2 = 0;
+    samples->wirebytes = samples->retries = samples->ratelimited = samples->servererrors = 0;
+
+    for (unsigned long i = 0; std::chrono::steady_clock::now() < deadline; i++) {
+        std::string step = options.scenario;
+        if (step == "mixed") {
+            // half listing pagination, the rest split between posts, the inbox and replies
+            const char * mix [] = {"listing", "listing", "listing", "listing", "listing",
+                                   "post", "post", "inbox", "inbox", "reply"};
+            step = mix[i % 10];
+        }
+        auto start = std::chrono::steady_clock::now();
+        try {
+            if (step == "listing") {
+                subreddit->posts("hot", "all", 25, &page);
+                if (page.after == "") {
+                    page = CRAW::ListingPage();
+                }
+            } else if (step == "post") {
+                reddit->post(postid).comments("hot");
+            } else if (step == "inbox") {
+                reddit->inbox();
+            } else if (step == "reply") {
+                post->reply("Load test reply");
+            } else if (step == "info") {
+                for (auto & found : reddit->subreddits(names)) {
+                    if (!found.second) {
+                        samples->failures++;
+                    }
+                }
+            } else if (step == "stream") {
+                // each operation is one new post, which sometimes means polling for more
+                stream->next(stop);
+            }
+        } catch (const CRAW::errors::CRAWError &) {
+            samples->failures++;
+        }
+        samples->operations.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    current = nullptr;
+}
+
+/// The pth percentile (0 to 1) of a sorted vector, in milliseconds
+static double percentile (const std::vector<double> & sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[index == 0 ? 0 : index - 1] * 1000;
+}
+
+static double cputime () {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void run (const Options & options, const std::string & host, int threads) {
+    std::vector<std::unique_ptr<CRAW::Reddit>> sessions;
+    for (int i = 0; i < options.sessions; i++) {
+        std::shared_ptr<CRAW::Transport> inner;
+        if (options.transport == "cpr") {
+            auto cpr = std::make_shared<CRAW::CPRTransport>(host);
+            cpr->compression = options.compression;
+            inner = cpr;
+        } else {
+            auto multiplex = std::make_shared<CRAW::MultiplexTransport>(host, options.connections);
+            multiplex->compression = options.compression;
+            multiplex->http2 = options.transport != "h1";
+            multiplex->priorknowledge = options.transport == "h2c";
+            multiplex->cainfo = options.cacert;
+            inner = multiplex;
+        }
+        auto transport = std::make_shared<MeasuringTransport>(inner);
+        sessions.emplace_back(new CRAW::Reddit("crawpp_bot", "hunter2", "client", "secret", "crawpp-loadtest/1.0", transport));
+        if (options.hedge > 0) {
+            sessions.back()->hedging.enabled = true;
+            sessions.back()->hedging.percentile = options.hedge;
+        }
+    }
+    std::string postid = fixturepost(options.fixtures);
+
+    std::vector<Samples> samples(threads);
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> guard(backgroundlock);
+        background = Samples();
+        measuring = true;
+    }
+    double cpustart = cputime();
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(worker, sessions[i % sessions.size()].get(), std::cref(options), postid, deadline, &samples[i]);
+    }
+    for (auto & thread : workers) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = cputime() - cpustart;
+    {
+        std::lock_guard<std::mutex> guard(backgroundlock);
+        measuring = false;
+        samples.push_back(std::move(background));
+    }
+
+    Samples total;
+    for (auto & sample : samples) {
+        total.requests.insert(total.requests.end(), sample.requests.begin(), sample.requests.end());
+        total.operations.insert(total.operations.end(), sample.operations.begin(), sample.operations.end());
+        total.wirebytes += sample.wirebytes;
+        total.connections += sample.connections;
+        total.http2 += sample.http2;
+        total.retries += sample.retries;
+        total.ratelimited += sample.ratelimited;
+        total.servererrors += sample.servererrors;
+        total.failures += sample.failures;
+    }
+    std::sort(total.requests.begin(), total.requests.end());
+    std::sort(total.operations.begin(), total.operations.end());
+    // hedges are sent from their own threads, so they're counted from the metrics instead
+    uint64_t hedges = 0;
+    for (auto & session : sessions) {
+        for (auto & endpoint : session->metrics.snapshot()) {
+            hedges += endpoint.hedges;
+        }
+    }
+
+    printf("%7d %8d %9.1f %9.1f %8.2f %8.2f %8.2f %8.2f %8.2f %8zu %8zu %8zu %8zu %8zu %10.1f %8.1f %6zu %5.0f\n",
+           threads, options.sessions,
+           total.operations.size() / elapsed, total.requests.size() / elapsed,
+           percentile(total.requests, 0.5), percentile(total.requests, 0.95),
+           percentile(total.requests, 0.99), percentile(total.requests, 0.999),
+           percentile(total.operations, 0.99),
+           total.retries, static_cast<size_t>(hedges), total.ratelimited, total.servererrors, total.failures,
+           total.requests.empty() ? 0 : cpu / total.requests.size() * 1e6,
+           total.requests.empty() ? 0 : total.wirebytes / 1024.0 / total.requests.size(),
+           total.connections, total.requests.empty() ? 0 : 100.0 * total.http2 / total.requests.size());
+    fflush(stdout);
+}
+
+static void usage () {
+    std::cout << "Usage: loadtest [options]\n"
+                 "  --threads LIST     comma-separated worker thread counts to run (default: 1,4,16)\n"
+                 "  --sessions N       number of Reddit instances shared by the threads (default: 1)\n"
+                 "  --duration S       seconds to run each thread count for (default: 10)\n"
+                 "  --scenario NAME    mixed, listing, post, inbox, reply, info (bulk subreddit lookups\n"
+                 "                     through /api/info) or stream (new posts) (default: mixed)\n"
+                 "  --batch N          subreddits looked up at once in the info scenario (default: 100)\n"
+                 "  --poll-ms MS       how long streams wait between polls that find new posts (default: 0)\n"
+                 "  --new-posts N      posts the mock server adds to the new listing on each poll (default: 5)\n"
+                 "  --latency-ms MS    latency injected by the mock server (default: 0)\n"
+                 "  --jitter-ms MS     random extra latency of up to this much (default: 0)\n"
+                 "  --slow-rate F      fraction of requests that are slow (default: 0)\n"
+                 "  --slow-ms MS       extra latency of slow requests (default: 500)\n"
+                 "  --hedge P          hedge GETs after this percentile of recent latency, e.g. 0.95 (default: off)\n"
+                 "  --transport NAME   cpr (a new connection per request), or the multiplexing transport\n"
+                 "                     with h1 (HTTP/1.1), h2 (HTTP/2 over TLS, else HTTP/1.1) or h2c\n"
+                 "                     (HTTP/2 without TLS, e.g. through nghttpx) (default: cpr)\n"
+                 "  --connections N    most connections the multiplexing transport opens (default: 2)\n"
+                 "  --cacert FILE      CA certificate to trust, for an h2 server with a self-signed one\n"
+                 "  --compression X    on or off: whether to ask for gzipped responses (default: on)\n"
+                 "  --rate429 F        fraction of requests answered with HTTP 429 (default: 0)\n"
+                 "  --rate5xx F        fraction of requests answered with HTTP 503 (default: 0)\n"
+                 "  --pages N          pages in each listing (default: 10)\n"
+                 "  --fixtures DIR     fixtures directory (default: fixtures)\n"
+                 "  --url URL          use an already-running server instead of starting one\n"
+                 "  --serve PORT       only run the mock server, on the given port\n";
+}
+
+int main (int argc, char ** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--help" || i + 1 >= argc) {
+            usage();
+            return flag == "--help" ? 0 : 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--threads") {
+            options.threads.clear();
+            std::stringstream list(value);
+            for (std::string count; std::getline(list, count, ',');) {
+                options.threads.push_back(std::stoi(count));
+            }
+        } else if (flag == "--sessions") {
+            options.sessions = std::stoi(value);
+        } else if (flag == "--duration") {
+            options.duration = std::stod(value);
+        } else if (flag == "--scenario") {
+            options.scenario = value;
+        } else if (flag == "--transport") {
+            options.transport = value;
+        } else if (flag == "--connections") {
+            options.connections = std::stol(value);
+        } else if (flag == "--cacert") {
+            options.cacert = value;
+        } else if (flag == "--compression") {
+            options.compression = value != "off";
+        } else if (flag == "--latency-ms") {
+            options.mock.latency = std::chrono::microseconds(static_cast<long>(std::stod(value) * 1000));
+        } else if (flag == "--jitter-ms") {
+            options.mock.jitter = std::chrono::microseconds(static_cast<long>(std::stod(value) * 1000));
+        } else if (flag == "--slow-rate") {
+            options.mock.slowrate = std::stod(value);
+        } else if (flag == "--slow-ms") {
+            options.mock.slowlatency = std::chrono::microseconds(static_cast<long>(std::stod(value) * 1000));
+        } else if (flag == "--batch") {
+            options.batch = std::stoi(value);
+        } else if (flag == "--poll-ms") {
+            options.poll = std::chrono::milliseconds(std::stol(value));
+        } else if (flag == "--new-posts") {
+            options.mock.newposts = std::stoi(value);
+        } else if (flag == "--hedge") {
+            options.hedge = std::stod(value);
+        } else if (flag == "--rate429") {
+            options.mock.rate429 = std::stod(value);
+        } else if (flag == "--rate5xx") {
+            options.mock.rate5xx = std::stod(value);
+        } else if (flag == "--pages") {
+            options.mock.pages = std::stoi(value);
+        } else if (flag == "--fixtures") {
+            options.fixtures = value;
+        } else if (flag == "--url") {
+            options.url = value;
+        } else if (flag == "--serve") {
+            options.serve = std::stoi(value);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (options.serve >= 0) {
+        CRAW::bench::MockServer server(options.fixtures, options.mock);
+        std::cout << "Listening on http://127.0.0.1:" << server.listen(options.serve) << std::endl;
+        server.serve();
+    }
+
+    std::string host = options.url;
+    pid_t child = -1;
+    if (host == "") {
+        // the server runs in its own process so that its CPU time isn't counted
+        CRAW::bench::MockServer server(options.fixtures, options.mock);
+        host = "http://127.0.0.1:" + std::to_string(server.listen());
+        child = fork();
+        if (child == 0) {
+            server.serve();
+        }
+    }
+
+    printf("%7s %8s %9s %9s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %10s %8s %6s %5s\n",
+           "threads", "sessions", "ops/s", "req/s", "p50 ms", "p95 ms", "p99 ms", "p99.9 ms",
+           "op p99", "retries", "hedges", "429s", "5xxs", "failed", "cpu us/req", "KB/req", "conns", "h2 %");
+    for (int threads : options.threads) {
+        run(options, host, threads);
+    }
+
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+    }
+    return 0;
+}
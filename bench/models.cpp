@@ -0,0 +1,289 @@
+/*
+Microbenchmarks for parsing API responses and constructing CRAW++ models from them.
+
+The payloads are built from the recorded responses in the fixtures directory, scaled
+up to realistic sizes (100-post listings and 5000-comment threads). Besides the time
+per operation, each benchmark reports the number of heap allocations and the number
+of bytes allocated per operation.
+
+Run with "make bench". The fixtures directory can be given with the CRAWPP_FIXTURES
+environment variable (default: ./fixtures).
+*/
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "crawpp/craw.h"
+#include "crawpp/Award.hpp"
+
+// Every allocation made by the process is counted, so that the benchmarks can report
+// allocations/op and bytes/op.
+static std::atomic<size_t> allocations {0};
+static std::atomic<size_t> allocatedbytes {0};
+
+void * operator new (size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedbytes.fetch_add(size, std::memory_order_relaxed);
+    void * pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete (void * pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete (void * pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+/**
+ * Measures the allocations made between its construction and report(), and
+ * reports them as per-iteration counters.
+ */
+class AllocationCounter {
+    private:
+        size_t _allocations;
+        size_t _bytes;
+    public:
+        AllocationCounter () {
+            _allocations = allocations.load();
+            _bytes = allocatedbytes.load();
+        }
+
+        void report (benchmark::State & state) {
+            state.counters["allocs/op"] = benchmark::Counter(allocations.load() - _allocations,
+                                                             benchmark::Counter::kAvgIterations);
+            state.counters["bytes/op"] = benchmark::Counter(allocatedbytes.load() - _bytes,
+                                                            benchmark::Counter::kAvgIterations);
+        }
+};
+
+static std::string fixturedirectory () {
+    const char * directory = std::getenv("CRAWPP_FIXTURES");
+    return directory == nullptr ? "fixtures" : directory;
+}
+
+/// Load the response body of a fixture
+static nlohmann::json fixture (const std::string & name) {
+    std::ifstream file(fixturedirectory() + "/" + name);
+    if (!file) {
+        throw CRAW::errors::FileOperationError("Could not open fixture " + name);
+    }
+    return nlohmann::json::parse(file)["response"];
+}
+
+/// A Reddit instance that answers requests from the fixtures
+static CRAW::Reddit & reddit () {
+    static CRAW::Reddit instance("crawpp-bench/1.0", std::make_shared<CRAW::ReplayTransport>(fixturedirectory()));
+    return instance;
+}
+
+/// A listing of 100 posts, made by repeating the posts in the listing fixtures
+static const nlohmann::json & listing () {
+    static nlohmann::json listing = [] {
+        std::vector<nlohmann::json> pages = {fixture("listing_hot.json"),
+                                             fixture("listing_hot_after.json"),
+                                             fixture("listing_new.json")};
+        nlohmann::json result = pages[0];
+        nlohmann::json & children = result["data"]["children"];
+        children = nlohmann::json::array();
+        for (int i = 0; children.size() < 100; i++) {
+            const nlohmann::json & page = pages[i % pages.size()]["data"]["children"];
+            nlohmann::json post = page[(i / pages.size()) % page.size()];
+            post["data"]["id"] = post["data"]["id"].get<std::string>() + std::to_string(i);
+            post["data"]["name"] = "t3_" + post["data"]["id"].get<std::string>();
+            children.push_back(post);
+        }
+        return result;
+    }();
+    return listing;
+}
+
+/// Make a comment listing by copying the comment template, nested up to 5 levels deep
+static nlohmann::json commenttree (const nlohmann::json & comment, int depth, int fanout, int & remaining) {
+    nlohmann::json children = nlohmann::json::array();
+    for (int i = 0; i < fanout && remaining > 0; i++) {
+        nlohmann::json child = comment;
+        remaining--;
+        child["data"]["id"] = "c" + std::to_string(remaining);
+        child["data"]["name"] = "t1_c" + std::to_string(remaining);
+        child["data"]["depth"] = depth;
+        if (depth < 4 && remaining > 0) {
+            child["data"]["replies"] = {{"kind", "Listing"},
+                                        {"data", {{"children", commenttree(comment, depth + 1, fanout, remaining)}}}};
+        } else {
+            child["data"]["replies"] = "";
+        }
+        children.push_back(child);
+    }
+    return children;
+}
+
+/// The response to a request for a post with 5000 comments
+static const nlohmann::json & thread () {
+    static nlohmann::json thread = [] {
+        nlohmann::json result = fixture("comments.json");
+        nlohmann::json comment = result[1]["data"]["children"][0];
+        comment["data"]["replies"] = "";
+        nlohmann::json & children = result[1]["data"]["children"];
+        children = nlohmann::json::array();
+        int remaining = 5000;
+        while (remaining > 0) {
+            for (auto & child : commenttree(comment, 0, 3, remaining)) {
+                children.push_back(child);
+            }
+        }
+        return result;
+    }();
+    return thread;
+}
+
+static void BM_ListingParse (benchmark::State & state) {
+    std::string text = listing().dump();
+    AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(nlohmann::json::parse(text));
+    }
+    counter.report(state);
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ListingParse);
+
+static void BM_PostInit (benchmark::State & state) {
+    nlohmann::json children = listing()["data"]["children"];
+    AllocationCounter counter;
+    for (auto _ : state) {
+        std::vector<CRAW::Post> posts;
+        for (auto & i : children) {
+            posts.emplace_back(CRAW::Post(i["data"], &reddit()));
+        }
+        benchmark::DoNotOptimize(posts);
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * children.size());
+}
+BENCHMARK(BM_PostInit);
+
+static void BM_CommentConstruct (benchmark::State & state) {
+    const nlohmann::json & children = thread()[1]["data"]["children"];
+    AllocationCounter counter;
+    for (auto _ : state) {
+        std::vector<CRAW::Comment> comments;
+        for (auto & i : children) {
+            comments.emplace_back(CRAW::Comment(i["data"], &reddit()));
+        }
+        benchmark::DoNotOptimize(comments);
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * children.size());
+}
+BENCHMARK(BM_CommentConstruct);
+
+/// Visit every comment below the given one, returning the number visited
+static size_t walk (CRAW::Comment & comment) {
+    size_t visited = 1;
+    for (auto & reply : comment.replies()) {
+        visited += walk(reply);
+    }
+    return visited;
+}
+
+static void BM_CommentReplies (benchmark::State & state) {
+    nlohmann::json response = thread();
+    CRAW::Post post = CRAW::Post(response[0]["data"]["children"][0]["data"], &reddit());
+    std::vector<CRAW::Comment> toplevel;
+    for (auto & i : response[1]["data"]["children"]) {
+        toplevel.emplace_back(CRAW::Comment(i["data"], &reddit()));
+    }
+    size_t visited = 0;
+    AllocationCounter counter;
+    for (auto _ : state) {
+        visited = 0;
+        for (auto & comment : toplevel) {
+            visited += walk(comment);
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * visited);
+}
+BENCHMARK(BM_CommentReplies);
+
+static void BM_MessageConstruct (benchmark::State & state) {
+    nlohmann::json inboxfixture = fixture("inbox.json");
+    const nlohmann::json & children = inboxfixture["data"]["children"];
+    AllocationCounter counter;
+    for (auto _ : state) {
+        std::vector<CRAW::Message> inbox;
+        for (auto & i : children) {
+            inbox.emplace_back(CRAW::Message(i["data"], &reddit()));
+        }
+        benchmark::DoNotOptimize(inbox);
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * children.size());
+}
+BENCHMARK(BM_MessageConstruct);
+
+static void BM_AwardParse (benchmark::State & state) {
+    nlohmann::json award;
+    for (auto & i : listing()["data"]["children"]) {
+        if (!i["data"]["all_awardings"].empty()) {
+            award = i["data"]["all_awardings"][0];
+            break;
+        }
+    }
+    AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CRAW::Award(award));
+    }
+    counter.report(state);
+}
+BENCHMARK(BM_AwardParse);
+
+static void BM_SubredditFromAbout (benchmark::State & state) {
+    nlohmann::json data = fixture("subreddit_about.json")["data"];
+    AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CRAW::Subreddit(data, &reddit()));
+    }
+    counter.report(state);
+}
+BENCHMARK(BM_SubredditFromAbout);
+
+static void BM_RedditorSubscript (benchmark::State & state) {
+    CRAW::Redditor redditor = reddit().redditor("NateNate60");
+    // one of each kind of value: string, number, boolean and object
+    const std::vector<std::string> attributes = {"name", "total_karma", "verified", "subreddit"};
+    AllocationCounter counter;
+    for (auto _ : state) {
+        for (auto & attribute : attributes) {
+            benchmark::DoNotOptimize(redditor[attribute]);
+        }
+    }
+    counter.report(state);
+    state.SetItemsProcessed(state.iterations() * attributes.size());
+}
+BENCHMARK(BM_RedditorSubscript);
+
+static void BM_ReplayListing (benchmark::State & state) {
+    // the whole pipeline for one page: transport, parsing and model construction
+    CRAW::Subreddit subreddit = reddit().subreddit("cpp");
+    AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(subreddit.posts());
+    }
+    counter.report(state);
+}
+BENCHMARK(BM_ReplayListing);
+
+BENCHMARK_MAIN();
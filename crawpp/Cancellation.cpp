@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    struct CancellationToken::State {
+        std::atomic<bool> cancelled;
+        std::chrono::steady_clock::time_point deadline;
+
+        /// The state of the token that this one is a child of, if any
+        std::shared_ptr<State> parent;
+
+        /// Wakes up threads sleeping on the token when it is cancelled
+        std::mutex lock;
+        std::condition_variable wakeup;
+
+        /// What to call when the token is cancelled, by the id that subscribe() gave out
+        std::map<uint64_t, std::function<void ()>> callbacks;
+
+        State (std::chrono::steady_clock::time_point deadline) : cancelled(false), deadline(deadline) {}
+
+        /// Whether this token or any of its ancestors was cancelled (ignoring the deadline)
+        bool cancelledchain () const {
+            for (const State * state = this; state != nullptr; state = state->parent.get()) {
+                if (state->cancelled.load(std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    CancellationToken::CancellationToken (std::shared_ptr<State> state) {
+        _state = state;
+    }
+
+    CancellationToken::CancellationToken () {
+        _state = std::make_shared<State>(std::chrono::steady_clock::time_point::max());
+    }
+
+    CancellationToken::CancellationToken (std::chrono::steady_clock::time_point deadline) {
+        _state = std::make_shared<State>(deadline);
+    }
+
+    CancellationToken CancellationToken::after (std::chrono::milliseconds timeout) {
+        return CancellationToken(std::chrono::steady_clock::now() + timeout);
+    }
+
+    const CancellationToken & CancellationToken::none () {
+        static const CancellationToken token = CancellationToken(std::shared_ptr<State>());
+        return token;
+    }
+
+    CancellationToken CancellationToken::child () const {
+        if (_state == nullptr) {
+            return CancellationToken();
+        }
+        auto state = std::make_shared<State>(_state->deadline);
+        state->parent = _state;
+        return CancellationToken(state);
+    }
+
+    void CancellationToken::cancel () {
+        if (_state == nullptr) {
+            return;
+        }
+        std::map<uint64_t, std::function<void ()>> callbacks;
+        {
+            std::lock_guard<std::mutex> guard(_state->lock);
+            _state->cancelled = true;
+            callbacks.swap(_state->callbacks);
+        }
+        _state->wakeup.notify_all();
+        // outside the lock, so that a callback can subscribe or unsubscribe
+        for (auto & callback : callbacks) {
+            callback.second();
+        }
+    }
+
+    bool CancellationToken::cancelled () const {
+        return _state != nullptr && (_state->cancelledchain() || expired());
+    }
+
+    bool CancellationToken::expired () const {
+        return _state != nullptr &&
+               _state->deadline != std::chrono::steady_clock::time_point::max() &&
+               std::chrono::steady_clock::now() >= _state->deadline;
+    }
+
+    std::chrono::milliseconds CancellationToken::remaining () const {
+        if (_state == nullptr || _state->deadline == std::chrono::steady_clock::time_point::max()) {
+            return std::chrono::milliseconds::max();
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(_state->deadline - std::chrono::steady_clock::now());
+        return std::max(left, std::chrono::milliseconds(0));
+    }
+
+    void CancellationToken::check () const {
+        if (expired()) {
+            throw errors::DeadlineExceededError("The deadline passed before the operation finished.");
+        }
+        if (cancelled()) {
+            throw errors::CancelledError("The operation was cancelled.");
+        }
+    }
+
+    bool CancellationToken::sleep (std::chrono::milliseconds duration) const {
+        if (_state == nullptr) {
+            std::this_thread::sleep_for(duration);
+            return true;
+        }
+        auto until = std::min(std::chrono::steady_clock::now() + duration, _state->deadline);
+        std::unique_lock<std::mutex> guard(_state->lock);
+        if (_state->parent == nullptr) {
+            _state->wakeup.wait_until(guard, until, [this] {
+                return _state->cancelled.load();
+            });
+        } else {
+            // cancelling an ancestor doesn't wake this token's sleepers, so check every so often
+            while (!_state->cancelledchain() && std::chrono::steady_clock::now() < until) {
+                _state->wakeup.wait_until(guard, std::min(until, std::chrono::steady_clock::now() + std::chrono::milliseconds(20)));
+            }
+        }
+        return !cancelled();
+    }
+
+    uint64_t CancellationToken::subscribe (std::function<void ()> callback) const {
+        if (_state == nullptr) {
+            return 0;
+        }
+        static std::atomic<uint64_t> nextid(1);
+        uint64_t id = nextid.fetch_add(1, std::memory_order_relaxed);
+        // cancelling an ancestor cancels this token too, so the callback goes on every
+        // state in the chain and whichever is cancelled first calls it
+        auto once = std::make_shared<std::atomic<bool>>(false);
+        std::weak_ptr<State> weak = _state;
+        auto call = [once, callback, weak, id] {
+            if (once->exchange(true)) {
+                return;
+            }
+            callback();
+            // take it off the rest of the chain, which might never be cancelled
+            if (std::shared_ptr<State> state = weak.lock()) {
+                CancellationToken(state).unsubscribe(id);
+            }
+        };
+        for (State * state = _state.get(); state != nullptr; state = state->parent.get()) {
+            std::unique_lock<std::mutex> guard(state->lock);
+            if (state->cancelled.load()) {
+                guard.unlock();
+                call();
+                return 0;
+            }
+            state->callbacks.emplace(id, call);
+        }
+        return id;
+    }
+
+    void CancellationToken::unsubscribe (uint64_t id) const {
+        if (id == 0) {
+            return;
+        }
+        for (State * state = _state.get(); state != nullptr; state = state->parent.get()) {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->callbacks.erase(id);
+        }
+    }
+}
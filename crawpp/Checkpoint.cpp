@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "crawpp/Checkpoint.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    void writeatomically (const std::string & path, const std::string & contents) {
+        std::string temporary = path + ".tmp";
+        std::FILE * file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            throw errors::FileOperationError("Could not write to \"" + path + "\".");
+        }
+        bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size() &&
+                       std::fflush(file) == 0;
+#if defined(__unix__) || defined(__APPLE__)
+        // otherwise the rename can reach the disk before the contents do
+        written = written && fsync(fileno(file)) == 0;
+#endif
+        written = std::fclose(file) == 0 && written;
+        std::error_code error;
+        if (written) {
+            std::filesystem::rename(temporary, path, error);
+        }
+        if (!written || error) {
+            std::filesystem::remove(temporary, error);
+            throw errors::FileOperationError("Could not write to \"" + path + "\".");
+        }
+    }
+
+    std::optional<std::string> readfile (const std::string & path) {
+        if (!std::filesystem::exists(path)) {
+            return std::nullopt;
+        }
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        if (!file) {
+            throw errors::FileOperationError("Could not read \"" + path + "\".");
+        }
+        return contents.str();
+    }
+}
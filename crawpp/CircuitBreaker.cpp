@@ -0,0 +1,109 @@
+#include <algorithm>
+
+#include "crawpp/CircuitBreaker.h"
+#include "crawpp/Metrics.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    CircuitBreakerTransport::CircuitBreakerTransport (std::shared_ptr<Transport> inner) {
+        _inner = inner == nullptr ? std::make_shared<CPRTransport>() : inner;
+    }
+
+    CircuitState CircuitBreakerTransport::state (const std::string & path) {
+        std::lock_guard<std::mutex> guard(_lock);
+        auto circuit = _circuits.find(endpointtemplate(path));
+        return circuit == _circuits.end() ? CircuitState::closed : circuit->second.state;
+    }
+
+    const CircuitBreakerPolicy & CircuitBreakerTransport::_policy (const std::string & endpoint) const {
+        auto custom = endpoints.find(endpoint);
+        return custom == endpoints.end() ? defaults : custom->second;
+    }
+
+    bool CircuitBreakerTransport::_admit (const std::string & endpoint) {
+        std::lock_guard<std::mutex> guard(_lock);
+        Circuit & circuit = _circuits[endpoint];
+        auto now = std::chrono::steady_clock::now();
+        if (circuit.state == CircuitState::open && now >= circuit.reopens) {
+            circuit.state = CircuitState::halfopen;
+            return true;
+        } else if (circuit.state != CircuitState::closed) {
+            long seconds = std::chrono::duration_cast<std::chrono::seconds>(circuit.reopens - now).count();
+            throw errors::CircuitOpenError("Requests to " + endpoint + " have been stopped because it keeps failing" +
+                                           (circuit.state == CircuitState::open ?
+                                            " (it will be tried again in " + std::to_string(std::max(seconds, 0L) + 1) + " s)." :
+                                            " (it is being tried again)."));
+        }
+        return false;
+    }
+
+    void CircuitBreakerTransport::_abandon (const std::string & endpoint, bool probe) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (probe) {
+            // let the next request probe instead
+            _circuits[endpoint].state = CircuitState::open;
+        }
+    }
+
+    void CircuitBreakerTransport::_record (const std::string & endpoint,
+                                           bool probe,
+                                           const HTTPResponse & response,
+                                           const CancellationToken & cancellation) {
+        const CircuitBreakerPolicy & policy = _policy(endpoint);
+        bool failed = response.status_code >= 500 || (response.status_code == 0 && !cancellation.cancelled());
+        bool cancelled = response.status_code == 0 && !failed;
+
+        std::lock_guard<std::mutex> guard(_lock);
+        Circuit & circuit = _circuits[endpoint];
+        if (probe) {
+            if (failed) {
+                circuit.state = CircuitState::open;
+                circuit.reopens = std::chrono::steady_clock::now() + policy.cooldown;
+            } else if (cancelled) {
+                circuit.state = CircuitState::open;
+            } else {
+                circuit.state = CircuitState::closed;
+                circuit.failures = 0;
+            }
+        } else if (circuit.state == CircuitState::closed && !cancelled) {
+            circuit.failures = failed ? circuit.failures + 1 : 0;
+            if (circuit.failures >= policy.threshold) {
+                circuit.state = CircuitState::open;
+                circuit.reopens = std::chrono::steady_clock::now() + policy.cooldown;
+            }
+        }
+    }
+
+    HTTPResponse CircuitBreakerTransport::send (const HTTPRequest & request) {
+        std::string endpoint = endpointtemplate(request.path);
+        bool probe = _admit(endpoint);
+        HTTPResponse response;
+        try {
+            response = _inner->send(request);
+        } catch (...) {
+            _abandon(endpoint, probe);
+            throw;
+        }
+        _record(endpoint, probe, response, request.cancellation);
+        return response;
+    }
+
+    void CircuitBreakerTransport::sendasync (const HTTPRequest & request, Callback done) {
+        std::string endpoint = endpointtemplate(request.path);
+        bool probe = _admit(endpoint);
+        try {
+            _inner->sendasync(request, [this, endpoint, probe, cancellation = request.cancellation, done] (HTTPResponse response) {
+                _record(endpoint, probe, response, cancellation);
+                done(std::move(response));
+            });
+        } catch (...) {
+            _abandon(endpoint, probe);
+            throw;
+        }
+    }
+
+    bool CircuitBreakerTransport::after (std::chrono::milliseconds delay, std::function<void ()> task) {
+        return _inner->after(delay, std::move(task));
+    }
+}
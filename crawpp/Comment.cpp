@@ -6,9 +6,11 @@
 
 namespace CRAW {
     Comment::Comment (const nlohmann::json & data, Reddit * redditinstance) {
+        _redditinstance = redditinstance;
         information = data;
         id = data["id"].get<std::string>();
         authorname = data["author"].get<std::string>();
+        authorfullname = data.value("author_fullname", "");
         fullname = data["name"].get<std::string>();
         posted = data["created"].get<int>();
         score = data["score"].get<int>();
@@ -19,19 +21,28 @@ namespace CRAW {
         } else {
             edited = 0;
         }
-        depth = data["depth"].get<int>();
+        // comments outside a comment tree, such as those in a Redditor's history, have no depth
+        depth = data.value("depth", 0);
         content = data["body"].get<std::string>();
         selftext = content;
 
         awards = std::vector<Award> ();
-        for (auto & i : data["all_awardings"]) {
+        for (auto & i : data.value("all_awardings", nlohmann::json::array())) {
             awards.emplace_back(Award(i));
         }
     }
 
     std::vector<Comment> Comment::replies () {
         std::vector<Comment> replylist = {};
+        if (!information["replies"].is_object()) {
+            // if there are no replies, this value is "" instead of being a listing
+            return replylist;
+        }
         for (auto & i : information["replies"]["data"]["children"]) {
+            if (i["kind"] != "t1") {
+                // skip "load more comments" placeholders
+                continue;
+            }
             replylist.emplace_back(Comment(i["data"], _redditinstance));
         }
         return replylist;
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "crawpp/Concurrency.h"
+
+namespace CRAW {
+
+    ConcurrencyLimiter::ConcurrencyLimiter () {
+        _limit = 0;
+        _inflight = 0;
+        _nextid = 1;
+        for (auto & waiting : _waiting) {
+            waiting = 0;
+        }
+    }
+
+    std::chrono::steady_clock::time_point ConcurrencyLimiter::acquire (const ConcurrencyPolicy & policy,
+                                                                       Priority priority,
+                                                                       const CancellationToken & cancellation) {
+        int index = static_cast<int>(priority);
+        std::unique_lock<std::mutex> guard(_lock);
+        if (_limit == 0) {
+            _limit = std::clamp(policy.initial, policy.minimum, policy.maximum);
+        }
+        _waiting[index]++;
+        while (!_free() || std::any_of(_waiting, _waiting + index, [](long waiting) { return waiting > 0; })) {
+            if (cancellation.cancellable()) {
+                // cancelling the token doesn't signal this condition variable, so check it every so often
+                _released.wait_for(guard, std::chrono::milliseconds(20));
+                if (cancellation.cancelled()) {
+                    _waiting[index]--;
+                    _released.notify_all();
+                    // requests of lower priority may have been waiting for this one
+                    _dispatch(guard);
+                    cancellation.check();
+                }
+            } else {
+                _released.wait(guard);
+            }
+        }
+        _waiting[index]--;
+        _inflight++;
+        if (std::any_of(_waiting, _waiting + 3, [](long waiting) { return waiting > 0; })) {
+            // requests of lower priority may have been waiting for this one to go first
+            _released.notify_all();
+            _dispatch(guard);
+        }
+        return std::chrono::steady_clock::now();
+    }
+
+    bool ConcurrencyLimiter::tryacquire (const ConcurrencyPolicy & policy, std::chrono::steady_clock::time_point & start) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_limit == 0) {
+            _limit = std::clamp(policy.initial, policy.minimum, policy.maximum);
+        }
+        if (!_free() || std::any_of(_waiting, _waiting + 3, [](long waiting) { return waiting > 0; })) {
+            return false;
+        }
+        _inflight++;
+        start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    uint64_t ConcurrencyLimiter::acquireasync (const ConcurrencyPolicy & policy,
+                                               Priority priority,
+                                               std::chrono::steady_clock::time_point & start,
+                                               std::function<void (std::chrono::steady_clock::time_point)> ready) {
+        int index = static_cast<int>(priority);
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_limit == 0) {
+            _limit = std::clamp(policy.initial, policy.minimum, policy.maximum);
+        }
+        if (_free() && std::none_of(_waiting, _waiting + index + 1, [](long waiting) { return waiting > 0; })) {
+            _inflight++;
+            start = std::chrono::steady_clock::now();
+            return 0;
+        }
+        uint64_t id = _nextid++;
+        _waiting[index]++;
+        _waiters[index].push_back(Waiter{id, std::move(ready)});
+        return id;
+    }
+
+    bool ConcurrencyLimiter::cancel (uint64_t id) {
+        std::unique_lock<std::mutex> guard(_lock);
+        for (int index = 0; index < 3; index++) {
+            auto & waiters = _waiters[index];
+            auto waiter = std::find_if(waiters.begin(), waiters.end(), [id](const Waiter & waiter) {
+                return waiter.id == id;
+            });
+            if (waiter != waiters.end()) {
+                waiters.erase(waiter);
+                _waiting[index]--;
+                _released.notify_all();
+                _dispatch(guard);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ConcurrencyLimiter::release (const ConcurrencyPolicy & policy,
+                                      std::chrono::steady_clock::time_point start,
+                                      long status,
+                                      const std::string & endpoint) {
+        auto now = std::chrono::steady_clock::now();
+        double latency = std::chrono::duration<double>(now - start).count();
+        std::unique_lock<std::mutex> guard(_lock);
+        bool saturated = _inflight >= std::floor(_limit);
+        _inflight--;
+        if (status < 0) {
+            _released.notify_all();
+            _dispatch(guard);
+            return;
+        }
+
+        auto baseline = _baselines.find(endpoint);
+        bool slow = false;
+        if (baseline == _baselines.end()) {
+            _baselines[endpoint] = latency;
+        } else {
+            slow = latency > baseline->second * policy.latencytolerance;
+            if (latency < baseline->second) {
+                baseline->second = latency;
+            } else {
+                baseline->second += (latency - baseline->second) * 0.01;
+            }
+        }
+
+        bool overloaded = status == 0 || status == 429 || status >= 500 || slow;
+        if (overloaded && start >= _lastcut) {
+            _limit = std::max(_limit * policy.backoff, policy.minimum);
+            _lastcut = now;
+        } else if (!overloaded && saturated) {
+            // only grow while the limit is what's holding requests back
+            _limit = std::min(_limit + 1 / _limit, policy.maximum);
+        }
+        _released.notify_all();
+        _dispatch(guard);
+    }
+
+    bool ConcurrencyLimiter::_free () const {
+        return _inflight < std::max<long>(std::floor(_limit), 1);
+    }
+
+    void ConcurrencyLimiter::_dispatch (std::unique_lock<std::mutex> & guard) {
+        std::vector<std::function<void (std::chrono::steady_clock::time_point)>> granted;
+        for (int index = 0; index < 3 && _free(); index++) {
+            while (!_waiters[index].empty() && _free()) {
+                granted.push_back(std::move(_waiters[index].front().ready));
+                _waiters[index].pop_front();
+                _waiting[index]--;
+                _inflight++;
+            }
+            if (_waiting[index] > 0) {
+                // requests of lower priority wait for the ones of this priority that wait with acquire()
+                break;
+            }
+        }
+        guard.unlock();
+        auto now = std::chrono::steady_clock::now();
+        for (auto & ready : granted) {
+            ready(now);
+        }
+    }
+
+    double ConcurrencyLimiter::limit () {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _limit;
+    }
+
+    long ConcurrencyLimiter::inflight () {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _inflight;
+    }
+}
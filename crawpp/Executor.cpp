@@ -0,0 +1,171 @@
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "crawpp/Executor.h"
+
+namespace CRAW {
+
+    /// The executor that the calling thread is a worker of, if any, and which worker it is
+    static thread_local const Executor * _current = nullptr;
+    static thread_local size_t _index = 0;
+
+    Executor::Executor () {
+        _size = 0;
+        _queued = 0;
+        _stopping = false;
+    }
+
+    Executor::~Executor () {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _wakeup.notify_all();
+        for (auto & worker : _workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    void Executor::start (const ExecutorPolicy & policy) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_workers.empty()) {
+            return;
+        }
+        size_t threads = policy.threads == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : policy.threads;
+        for (size_t i = 0; i < threads; i++) {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+        // the workers look at each other's queues, so they can't start until they all exist
+        for (size_t i = 0; i < threads; i++) {
+            _workers[i]->thread = std::thread(&Executor::_run, this, i);
+#ifdef __linux__
+            if (!policy.cpus.empty()) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(policy.cpus[i % policy.cpus.size()], &cpus);
+                pthread_setaffinity_np(_workers[i]->thread.native_handle(), sizeof(cpus), &cpus);
+            }
+#endif
+        }
+        _size = threads;
+    }
+
+    size_t Executor::size () const {
+        return _size;
+    }
+
+    bool Executor::onworker () const {
+        return _current == this;
+    }
+
+    void Executor::post (Task task, std::chrono::milliseconds delay) {
+        if (_size == 0) {
+            start(ExecutorPolicy());
+        }
+        if (delay.count() > 0) {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                _timed.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+            }
+            // a sleeping worker may need to wake up sooner than it planned to
+            _wakeup.notify_one();
+            return;
+        }
+        if (onworker()) {
+            Worker & worker = *_workers[_index];
+            std::lock_guard<std::mutex> guard(worker.lock);
+            worker.tasks.push_back(std::move(task));
+            _queued++;
+        } else {
+            std::lock_guard<std::mutex> guard(_lock);
+            _injected.push_back(std::move(task));
+            _queued++;
+        }
+        {
+            // a worker that has just found nothing to do is either waiting already, or will
+            // see the new task before it waits
+            std::lock_guard<std::mutex> guard(_lock);
+        }
+        _wakeup.notify_one();
+    }
+
+    bool Executor::_runone () {
+        if (_queued <= 0) {
+            return false;
+        }
+        Task task;
+        {
+            // newest first from our own queue, so that a task's subtasks run while their data is in cache
+            Worker & own = *_workers[_index];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        if (!task) {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_injected.empty()) {
+                task = std::move(_injected.front());
+                _injected.pop_front();
+            }
+        }
+        for (size_t i = 1; !task && i < _workers.size(); i++) {
+            // oldest first from other workers' queues, since those are usually the biggest
+            Worker & victim = *_workers[(_index + i) % _workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) {
+            return false;
+        }
+        _queued--;
+        task();
+        return true;
+    }
+
+    void Executor::_run (size_t index) {
+        _current = this;
+        _index = index;
+        while (!_stopping) {
+            if (_runone()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(_lock);
+            if (_stopping) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            long due = 0;
+            while (!_timed.empty() && _timed.begin()->first <= now) {
+                _injected.push_back(std::move(_timed.begin()->second));
+                _timed.erase(_timed.begin());
+                due++;
+            }
+            if (due > 0) {
+                _queued += due;
+                if (due > 1) {
+                    _wakeup.notify_all();
+                }
+                continue;
+            }
+            if (_queued > 0) {
+                continue;
+            }
+            if (_timed.empty()) {
+                _wakeup.wait(guard);
+            } else {
+                _wakeup.wait_until(guard, _timed.begin()->first);
+            }
+        }
+    }
+}
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <exception>
+#include <string>
+
+#include "crawpp/Hedging.h"
+
+namespace CRAW {
+
+    /// The most hedges that can be saved up in the budget, in thousandths of a hedge
+    static const int64_t _maxbudget = 10000;
+
+    /// A request and its hedge, racing to be answered first
+    struct Hedger::Race {
+        std::shared_ptr<Transport> transport;
+        HedgePolicy policy;
+        HedgeGate gate;
+        EndpointMetrics * metrics;
+
+        /// The original request and the copy of it that is sent as the hedge, each with
+        /// a token of its own so that the loser can be aborted
+        HTTPRequest request;
+        HTTPRequest hedge;
+
+        std::mutex lock;
+
+        /// Signalled when the race has been decided
+        std::condition_variable decided;
+
+        /// Whether the race has been decided, after which no hedge is sent
+        bool finished;
+
+        /// Whether the hedge won
+        bool hedgewon;
+
+        /// The winner's response, or the exception that the original request threw
+        HTTPResponse response;
+        std::exception_ptr error;
+
+        Race () {
+            metrics = nullptr;
+            finished = false;
+            hedgewon = false;
+        }
+    };
+
+    Hedger::Hedger () {
+        _stopping = false;
+        _outstanding = 0;
+        _inflight.store(0);
+        _budget.store(0);
+        _ratelimit.store(-1);
+    }
+
+    Hedger::~Hedger () {
+        std::unique_lock<std::mutex> guard(_lock);
+        _stopping = true;
+        _wakeup.notify_all();
+        // copies still in flight call back into the hedger, and record into the endpoint metrics
+        _wakeup.wait(guard, [this] {
+            return _outstanding == 0;
+        });
+        guard.unlock();
+        if (_timerthread.joinable()) {
+            _timerthread.join();
+        }
+    }
+
+    HTTPResponse Hedger::send (const std::shared_ptr<Transport> & transport,
+                               const HTTPRequest & request,
+                               const HedgePolicy & policy,
+                               const std::string & endpoint,
+                               const HedgeGate & gate,
+                               EndpointMetrics * metrics) {
+        // every request earns a fraction of a hedge
+        int64_t earned = static_cast<int64_t>(policy.budget * 1000);
+        if (_budget.fetch_add(earned, std::memory_order_relaxed) + earned > _maxbudget) {
+            _budget.store(_maxbudget, std::memory_order_relaxed);
+        }
+
+        Endpoint * stats;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            std::unique_ptr<Endpoint> & found = _endpoints[endpoint];
+            if (found == nullptr) {
+                found = std::make_unique<Endpoint>();
+            }
+            stats = found.get();
+        }
+        std::chrono::nanoseconds delay = _delay(*stats, policy);
+        auto start = std::chrono::steady_clock::now();
+        if (delay.count() == 0 || !_reserve(policy)) {
+            HTTPResponse response = transport->send(request);
+            stats->latency.record(std::chrono::steady_clock::now() - start);
+            return response;
+        }
+
+        auto race = std::make_shared<Race>();
+        race->transport = transport;
+        race->policy = policy;
+        race->gate = gate;
+        race->metrics = metrics;
+        race->request = request;
+        race->request.cancellation = request.cancellation.child();
+        race->hedge = request;
+        race->hedge.cancellation = request.cancellation.child();
+        if (_senders.size() == 0) {
+            ExecutorPolicy senders;
+            senders.threads = static_cast<unsigned>(std::max<long>(policy.maxinflight, 1));
+            _senders.start(senders);
+        }
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (!_timerthread.joinable()) {
+                _timerthread = std::thread(&Hedger::_runtimers, this);
+            }
+            _timers.push(Timer{start + delay, race});
+            _outstanding++;
+        }
+        _wakeup.notify_all();
+        _senders.post([this, race] {
+            _sendcopy(race, false);
+        });
+
+        std::unique_lock<std::mutex> guard(race->lock);
+        race->decided.wait(guard, [&race] {
+            return race->finished;
+        });
+        stats->latency.record(std::chrono::steady_clock::now() - start);
+        if (race->error != nullptr) {
+            std::rethrow_exception(race->error);
+        }
+        if (race->hedgewon && metrics != nullptr) {
+            metrics->hedgewins.fetch_add(1, std::memory_order_relaxed);
+        }
+        return std::move(race->response);
+    }
+
+    void Hedger::observe (const HTTPResponse & response) {
+        auto remaining = response.header.find("X-Ratelimit-Remaining");
+        if (remaining == response.header.end()) {
+            return;
+        }
+        try {
+            // Reddit sends this as a decimal, e.g. "595.0"
+            _ratelimit.store(static_cast<long>(std::stod(remaining->second)), std::memory_order_relaxed);
+        } catch (const std::exception &) {
+            // leave the last known value
+        }
+    }
+
+    std::chrono::nanoseconds Hedger::_delay (Endpoint & endpoint, const HedgePolicy & policy) {
+        std::lock_guard<std::mutex> guard(_lock);
+        uint64_t requests = endpoint.requests++;
+        if (requests - endpoint.windowstart < policy.window) {
+            return endpoint.delay;
+        }
+
+        // only the requests made since the window started count, so that the delay follows
+        // the endpoint's latency as it changes
+        HistogramSnapshot current = endpoint.latency.snapshot();
+        HistogramSnapshot recent = current;
+        if (!endpoint.start.counts.empty()) {
+            recent.count = 0;
+            for (size_t i = 0; i < recent.counts.size(); i++) {
+                recent.counts[i] -= endpoint.start.counts[i];
+                recent.count += recent.counts[i];
+            }
+        }
+        if (recent.count > 0) {
+            std::chrono::nanoseconds percentile(static_cast<int64_t>(recent.percentile(policy.percentile) * 1e9));
+            endpoint.delay = std::max<std::chrono::nanoseconds>(percentile, policy.mindelay);
+        }
+        endpoint.start = std::move(current);
+        endpoint.windowstart = requests;
+        return endpoint.delay;
+    }
+
+    bool Hedger::_reserve (const HedgePolicy & policy) {
+        if (_inflight.fetch_add(1, std::memory_order_relaxed) >= policy.maxinflight) {
+            _inflight.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    bool Hedger::_charge (const HedgePolicy & policy) {
+        long ratelimit = _ratelimit.load(std::memory_order_relaxed);
+        if (ratelimit >= 0 && ratelimit < policy.ratelimitreserve) {
+            return false;
+        }
+        int64_t budget = _budget.load(std::memory_order_relaxed);
+        do {
+            if (budget < 1000) {
+                return false;
+            }
+        } while (!_budget.compare_exchange_weak(budget, budget - 1000, std::memory_order_relaxed));
+        if (ratelimit >= 0) {
+            _ratelimit.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void Hedger::_refund () {
+        _budget.fetch_add(1000, std::memory_order_relaxed);
+        if (_ratelimit.load(std::memory_order_relaxed) >= 0) {
+            _ratelimit.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Hedger::_runtimers () {
+        std::unique_lock<std::mutex> guard(_lock);
+        while (!_stopping) {
+            if (_timers.empty()) {
+                _wakeup.wait(guard);
+                continue;
+            }
+            if (std::chrono::steady_clock::now() < _timers.top().when) {
+                _wakeup.wait_until(guard, _timers.top().when);
+                continue;
+            }
+            std::shared_ptr<Race> race = _timers.top().race.lock();
+            _timers.pop();
+            if (race == nullptr) {
+                // the request was answered long ago
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> raceguard(race->lock);
+                if (race->finished) {
+                    continue;
+                }
+            }
+            if (!_reserve(race->policy)) {
+                continue;
+            }
+            if (!_charge(race->policy)) {
+                _inflight.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+            // a hedge that the scheduler or the concurrency limiter has no room for is
+            // skipped rather than waited for, since by then it would be too late to help
+            if (race->gate.admit != nullptr && !race->gate.admit()) {
+                _refund();
+                _inflight.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (race->metrics != nullptr) {
+                race->metrics->hedges.fetch_add(1, std::memory_order_relaxed);
+            }
+            _outstanding++;
+            _senders.post([this, race] {
+                _sendcopy(race, true);
+            });
+        }
+    }
+
+    void Hedger::_sendcopy (const std::shared_ptr<Race> & race, bool hedge) {
+        try {
+            race->transport->sendasync(hedge ? race->hedge : race->request, [this, race, hedge] (HTTPResponse response) {
+                _answered(race, std::move(response), nullptr, hedge);
+            });
+        } catch (...) {
+            // e.g. a CircuitOpenError from a transport that sends synchronously
+            _answered(race, HTTPResponse(), std::current_exception(), hedge);
+        }
+    }
+
+    void Hedger::_answered (const std::shared_ptr<Race> & race, HTTPResponse response, std::exception_ptr error, bool hedge) {
+        _inflight.fetch_sub(1, std::memory_order_relaxed);
+        if (hedge) {
+            if (error == nullptr) {
+                observe(response);
+            } else {
+                // a hedge that was never sent shouldn't use up the budget
+                _refund();
+            }
+            if (race->gate.answered != nullptr) {
+                bool aborted = error != nullptr || (response.status_code == 0 && race->hedge.cancellation.cancelled());
+                race->gate.answered(response, aborted, error == nullptr);
+            }
+        }
+
+        {
+            // a hedge that failed shouldn't cut short the original, which might still succeed
+            bool usable = !hedge || (error == nullptr && response.status_code != 0 &&
+                                     response.status_code != 429 && response.status_code < 500);
+            std::lock_guard<std::mutex> guard(race->lock);
+            if (!race->finished && usable) {
+                race->finished = true;
+                race->hedgewon = hedge;
+                race->response = std::move(response);
+                race->error = error;
+                (hedge ? race->request : race->hedge).cancellation.cancel();
+                race->decided.notify_all();
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(_lock);
+        _outstanding--;
+        _wakeup.notify_all();
+    }
+}
@@ -10,6 +10,7 @@ namespace CRAW {
         read = data["new"].get<bool>();
         subredditname = data["subreddit"].is_null() ? "" : data["subreddit"].get<std::string>();
         authorname = data["author"].get<std::string>();
+        authorfullname = data.value("author_fullname", "");
         score = data["score"].get<int>();
         id = data["name"].get<std::string>();
         type = data["type"].get<std::string>();
@@ -35,6 +36,7 @@ namespace CRAW {
     }
 
     void Message::reply (const std::string & contents) {
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/comment", cpr::Payload{{"thing_id", fullname}, {"text", contents}});
     }
 
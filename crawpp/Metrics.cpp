@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+
+#include "crawpp/Metrics.h"
+
+namespace CRAW {
+
+    std::string endpointtemplate (const std::string & path) {
+        std::string result;
+        result.reserve(path.size());
+        // the placeholder for the segment after the previous one, if any
+        const char * placeholder = nullptr;
+        size_t end = std::min(path.find('?'), path.size());
+        size_t start = path[0] == '/' ? 1 : 0;
+        while (start < end) {
+            size_t next = std::min(path.find('/', start), end);
+            std::string segment = path.substr(start, next - start);
+            result += '/';
+            if (placeholder != nullptr && segment != "") {
+                result += placeholder;
+                // a post's ID can be followed by its URL slug and then a comment's ID
+                if (std::string(placeholder) == "{id}") {
+                    placeholder = "{slug}";
+                } else if (std::string(placeholder) == "{slug}") {
+                    placeholder = "{comment}";
+                } else {
+                    placeholder = nullptr;
+                }
+            } else {
+                result += segment;
+                if (segment == "r") {
+                    placeholder = "{sub}";
+                } else if (segment == "user" || segment == "u") {
+                    placeholder = "{name}";
+                } else if (segment == "comments" || segment == "duplicates") {
+                    placeholder = "{id}";
+                } else if (segment == "by_id") {
+                    placeholder = "{names}";
+                } else {
+                    placeholder = nullptr;
+                }
+            }
+            start = next + 1;
+        }
+        return result == "" ? "/" : result;
+    }
+
+    double HistogramSnapshot::percentile (double p) const {
+        if (count == 0) {
+            return 0;
+        }
+        double rank = p * count;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] > 0 && seen + counts[i] >= rank) {
+                double lower = i == 0 ? 0 : bounds[i - 1];
+                // the last bucket has no upper bound, so the best guess is its lower bound
+                double upper = i < bounds.size() ? bounds[i] : lower;
+                return lower + (upper - lower) * (rank - seen) / counts[i];
+            }
+            seen += counts[i];
+        }
+        return bounds.back();
+    }
+
+    Histogram::Histogram () {
+        for (auto & count : _counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        _sum.store(0, std::memory_order_relaxed);
+    }
+
+    void Histogram::record (std::chrono::nanoseconds duration) {
+        uint64_t microseconds = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0);
+        // bucket k holds (10 * 2^(k-1), 10 * 2^k] microseconds
+        uint64_t scaled = microseconds == 0 ? 0 : (microseconds - 1) / 10;
+        int bucket = scaled == 0 ? 0 : 64 - __builtin_clzll(scaled);
+        _counts[std::min(bucket, buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(std::max<int64_t>(duration.count(), 0), std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot Histogram::snapshot () const {
+        HistogramSnapshot snapshot;
+        for (int i = 0; i < buckets; i++) {
+            if (i < buckets - 1) {
+                snapshot.bounds.push_back(10e-6 * (1 << i));
+            }
+            snapshot.counts.push_back(_counts[i].load(std::memory_order_relaxed));
+            snapshot.count += snapshot.counts.back();
+        }
+        snapshot.sum = _sum.load(std::memory_order_relaxed) / 1e9;
+        return snapshot;
+    }
+
+    EndpointMetrics::EndpointMetrics (const std::string & endpoint) : endpoint(endpoint) {
+        requests.store(0, std::memory_order_relaxed);
+        retries.store(0, std::memory_order_relaxed);
+        requestbytes.store(0, std::memory_order_relaxed);
+        responsebytes.store(0, std::memory_order_relaxed);
+        wirebytes.store(0, std::memory_order_relaxed);
+        hedges.store(0, std::memory_order_relaxed);
+        hedgewins.store(0, std::memory_order_relaxed);
+        for (auto & status : statuses) {
+            status.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void EndpointMetrics::record (long status, std::chrono::nanoseconds latency, size_t requestbytes, size_t responsebytes,
+                                  size_t wirebytes, bool retry) {
+        requests.fetch_add(1, std::memory_order_relaxed);
+        if (retry) {
+            retries.fetch_add(1, std::memory_order_relaxed);
+        }
+        this->requestbytes.fetch_add(requestbytes, std::memory_order_relaxed);
+        this->responsebytes.fetch_add(responsebytes, std::memory_order_relaxed);
+        this->wirebytes.fetch_add(wirebytes, std::memory_order_relaxed);
+        statuses[status >= 0 && status < 600 ? status : 0].fetch_add(1, std::memory_order_relaxed);
+        this->latency.record(latency);
+    }
+
+    EndpointSnapshot EndpointMetrics::snapshot () const {
+        EndpointSnapshot snapshot;
+        snapshot.endpoint = endpoint;
+        snapshot.requests = requests.load(std::memory_order_relaxed);
+        snapshot.retries = retries.load(std::memory_order_relaxed);
+        snapshot.requestbytes = requestbytes.load(std::memory_order_relaxed);
+        snapshot.responsebytes = responsebytes.load(std::memory_order_relaxed);
+        snapshot.wirebytes = wirebytes.load(std::memory_order_relaxed);
+        snapshot.hedges = hedges.load(std::memory_order_relaxed);
+        snapshot.hedgewins = hedgewins.load(std::memory_order_relaxed);
+        for (int i = 0; i < 600; i++) {
+            uint64_t count = statuses[i].load(std::memory_order_relaxed);
+            if (count > 0) {
+                snapshot.statuses[i] = count;
+            }
+        }
+        snapshot.latency = latency.snapshot();
+        snapshot.parsetime = parsetime.snapshot();
+        return snapshot;
+    }
+
+    Metrics::Metrics () : _other("{other}") {
+        enabled.store(true);
+        for (auto & slot : _endpoints) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    Metrics::~Metrics () {
+        for (auto & slot : _endpoints) {
+            delete slot.load();
+        }
+    }
+
+    EndpointMetrics & Metrics::endpoint (const std::string & path) {
+        std::string name = endpointtemplate(path);
+        size_t start = std::hash<std::string>()(name) % capacity;
+        EndpointMetrics * created = nullptr;
+        for (size_t probe = 0; probe < capacity - 1; probe++) {
+            std::atomic<EndpointMetrics *> & slot = _endpoints[(start + probe) % capacity];
+            EndpointMetrics * existing = slot.load(std::memory_order_acquire);
+            if (existing == nullptr) {
+                if (created == nullptr) {
+                    created = new EndpointMetrics(name);
+                }
+                if (slot.compare_exchange_strong(existing, created, std::memory_order_acq_rel)) {
+                    return *created;
+                }
+                // another thread claimed this slot first, and existing now holds what it put there
+            }
+            if (existing->endpoint == name) {
+                delete created;
+                return *existing;
+            }
+        }
+        // leave one slot empty so that lookups of unknown endpoints always stop
+        delete created;
+        return _other;
+    }
+
+    std::vector<EndpointSnapshot> Metrics::snapshot () const {
+        std::vector<EndpointSnapshot> snapshots;
+        for (auto & slot : _endpoints) {
+            EndpointMetrics * endpoint = slot.load(std::memory_order_acquire);
+            if (endpoint != nullptr) {
+                snapshots.emplace_back(endpoint->snapshot());
+            }
+        }
+        if (_other.requests.load() > 0) {
+            snapshots.emplace_back(_other.snapshot());
+        }
+        std::sort(snapshots.begin(), snapshots.end(), [](const EndpointSnapshot & a, const EndpointSnapshot & b) {
+            return a.endpoint < b.endpoint;
+        });
+        return snapshots;
+    }
+
+    /**
+     * Escape a label value for the Prometheus text format
+     */
+    static std::string _label (const std::string & value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += c;
+            }
+        }
+        return "endpoint=\"" + escaped + "\"";
+    }
+
+    static void _histogram (std::ostringstream & output, const std::string & name, const std::string & label, const HistogramSnapshot & histogram) {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < histogram.counts.size(); i++) {
+            cumulative += histogram.counts[i];
+            output << name << "_bucket{" << label << ",le=\"";
+            if (i < histogram.bounds.size()) {
+                output << histogram.bounds[i];
+            } else {
+                output << "+Inf";
+            }
+            output << "\"} " << cumulative << "\n";
+        }
+        output << name << "_sum{" << label << "} " << histogram.sum << "\n";
+        output << name << "_count{" << label << "} " << histogram.count << "\n";
+    }
+
+    std::string Metrics::prometheus (const std::string & prefix) const {
+        std::vector<EndpointSnapshot> snapshots = snapshot();
+        std::ostringstream output;
+        output << std::setprecision(9);
+
+        output << "# HELP " << prefix << "_requests_total Requests sent to the Reddit API, by endpoint and status code (0 if there was no response).\n";
+        output << "# TYPE " << prefix << "_requests_total counter\n";
+        for (auto & endpoint : snapshots) {
+            for (auto & [status, count] : endpoint.statuses) {
+                output << prefix << "_requests_total{" << _label(endpoint.endpoint) << ",status=\"" << status << "\"} " << count << "\n";
+            }
+        }
+
+        const std::pair<const char *, uint64_t EndpointSnapshot::*> counters [] = {
+            {"_retries_total Requests that were retries of an earlier request.", &EndpointSnapshot::retries},
+            {"_request_bytes_total Bytes sent in request bodies.", &EndpointSnapshot::requestbytes},
+            {"_response_bytes_total Bytes received in response bodies, after decompression.", &EndpointSnapshot::responsebytes},
+            {"_response_wire_bytes_total Bytes received in response bodies over the network, before decompression.", &EndpointSnapshot::wirebytes},
+            {"_hedges_total Duplicate requests sent because the original was slow.", &EndpointSnapshot::hedges},
+            {"_hedge_wins_total Duplicate requests that were answered before the original.", &EndpointSnapshot::hedgewins}
+        };
+        for (auto & [help, member] : counters) {
+            std::string name = prefix + std::string(help).substr(0, std::string(help).find(' '));
+            output << "# HELP " << prefix << help << "\n";
+            output << "# TYPE " << name << " counter\n";
+            for (auto & endpoint : snapshots) {
+                output << name << "{" << _label(endpoint.endpoint) << "} " << endpoint.*member << "\n";
+            }
+        }
+
+        output << "# HELP " << prefix << "_request_duration_seconds How long requests to the Reddit API took to be answered.\n";
+        output << "# TYPE " << prefix << "_request_duration_seconds histogram\n";
+        for (auto & endpoint : snapshots) {
+            _histogram(output, prefix + "_request_duration_seconds", _label(endpoint.endpoint), endpoint.latency);
+        }
+
+        output << "# HELP " << prefix << "_parse_duration_seconds How long responses from the Reddit API took to parse.\n";
+        output << "# TYPE " << prefix << "_parse_duration_seconds histogram\n";
+        for (auto & endpoint : snapshots) {
+            _histogram(output, prefix + "_parse_duration_seconds", _label(endpoint.endpoint), endpoint.parsetime);
+        }
+
+        std::lock_guard<std::mutex> guard(_gaugelock);
+        for (auto & gauge : _gauges) {
+            output << "# HELP " << prefix << "_" << gauge.name << " " << gauge.help << "\n";
+            output << "# TYPE " << prefix << "_" << gauge.name << " gauge\n";
+            output << prefix << "_" << gauge.name << " " << gauge.read() << "\n";
+        }
+        return output.str();
+    }
+
+    void Metrics::gauge (const std::string & name, const std::string & help, std::function<double ()> read) {
+        std::lock_guard<std::mutex> guard(_gaugelock);
+        _gauges.push_back(Gauge{name, help, read});
+    }
+
+    void Metrics::removegauge (const std::string & name) {
+        std::lock_guard<std::mutex> guard(_gaugelock);
+        _gauges.erase(std::remove_if(_gauges.begin(), _gauges.end(), [&name] (const Gauge & gauge) {
+            return gauge.name == name;
+        }), _gauges.end());
+    }
+
+    std::map<std::string, double> Metrics::gauges () const {
+        std::lock_guard<std::mutex> guard(_gaugelock);
+        std::map<std::string, double> values;
+        for (auto & gauge : _gauges) {
+            values[gauge.name] = gauge.read();
+        }
+        return values;
+    }
+}
@@ -12,6 +12,7 @@ namespace CRAW {
         information = data;
         id = data["id"].get<std::string>();
         authorname = data["author"].get<std::string>();
+        authorfullname = data.value("author_fullname", "");
         fullname = data["name"].get<std::string>();
         title = data["title"].get<std::string>();
         posted = data["created"].get<time_t>();
@@ -45,6 +46,8 @@ namespace CRAW {
     }
 
     Post::Post (const std::string & id, Reddit * redditinstance) {
+        ScopedSpan span(redditinstance->tracer, "Post::Post");
+        span.attribute("post", id);
         nlohmann::json responsejson;
         try {
             responsejson = redditinstance->_sendrequest("GET", "/comments/" + id);
@@ -53,22 +56,35 @@ namespace CRAW {
         } catch (errors::UnauthorisedError &) {
             throw errors::UnauthorisedError("You are not authorised to view the post with ID " + id);
         }
-        if (responsejson[0]["data"].is_null()) {
+        _redditinstance = redditinstance;
+        _initlisting(id, responsejson);
+    }
+
+    Post::Post (const std::string & id, nlohmann::json & listing, Reddit * redditinstance) {
+        _redditinstance = redditinstance;
+        _initlisting(id, listing);
+    }
+
+    void Post::_initlisting (const std::string & id, nlohmann::json & listing) {
+        if (listing[0]["data"].is_null()) {
             throw errors::CommunicationError("Received a malformed response from the server when attempting to get post with ID " + id);
         }
-
-        _init(responsejson[0]["data"]["children"][0]["data"], responsejson[1]["data"]["children"]);
+        _init(listing[0]["data"]["children"][0]["data"], listing[1]["data"]["children"]);
     }
 
     Post::Post (nlohmann::json & data, Reddit * redditinstance) {
+        _redditinstance = redditinstance;
         _init(data);
     }
 
-    std::vector<Comment> Post::comments (const std::string & sort, const unsigned int limit) {
+    std::vector<Comment> Post::comments (const std::string & sort, const unsigned int limit,
+                                         const CancellationToken & cancellation) {
+        ScopedSpan span(_redditinstance->tracer, "Post::comments");
+        span.attribute("post", id);
         if (_comments.is_null()) {
             nlohmann::json responsejson;
             try {
-                responsejson = _redditinstance->_sendrequest("GET", "/" + id)[1]["data"]["children"];
+                responsejson = _redditinstance->_sendrequest("GET", _commentsurl(sort, limit), "", cancellation)[1]["data"]["children"];
             } catch (errors::NotFoundError &) {
                 throw errors::NotFoundError("No such post with ID " + id);
             } catch (errors::UnauthorisedError &) {
@@ -80,12 +96,45 @@ namespace CRAW {
             }
             _comments = responsejson;
         }
-        std::vector<Comment> commentvector = {};
+        return _commentobjects();
+    }
+
+    std::vector<Comment> Post::_commentobjects () {
+        std::vector<nlohmann::json *> items;
         for (auto & i : _comments) {
-            commentvector.emplace_back(Comment(i["data"], _redditinstance));
+            if (i["kind"] != "t1") {
+                // skip "load more comments" placeholders
+                continue;
+            }
+            items.push_back(&i["data"]);
         }
         // note that the returning by value is actually not that slow because of RVO
-        return commentvector;
+        return _redditinstance->_objects<Comment>(items);
+    }
+
+    std::string Post::_commentsurl (const std::string & sort, unsigned int limit) const {
+        return "/comments/" + id + "?sort=" + sort + "&limit=" + std::to_string(limit);
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<std::vector<Comment>> Post::comments_co (std::string sort, unsigned int limit, CancellationToken cancellation) {
+        if (_comments.is_null()) {
+            nlohmann::json responsejson;
+            try {
+                responsejson = (co_await _redditinstance->_sendrequestco("GET", _commentsurl(sort, limit), "", cancellation))[1]["data"]["children"];
+            } catch (errors::NotFoundError &) {
+                throw errors::NotFoundError("No such post with ID " + id);
+            } catch (errors::UnauthorisedError &) {
+                throw errors::UnauthorisedError("You are not authorised to view the post with ID " + id);
+            }
+
+            if (responsejson.is_null()) {
+                throw errors::CommunicationError("Received a malformed response from the server when attempting to get post with ID " + id);
+            }
+            _comments = responsejson;
+        }
+        co_return _commentobjects();
     }
+#endif
 
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <nlohmann/json.hpp>
 #include <cpr/cpr.h>
 #include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include <cctype>
 
 #include "crawpp/Reddit.h"
 #include "crawpp/Subreddit.h"
@@ -9,15 +12,97 @@
 #include "crawpp/Comment.h"
 #include "crawpp/Message.h"
 #include "crawpp/ListingPage.hpp"
+#include "crawpp/RedditPool.h"
 #include "crawpp/crawexceptions.hpp"
 
 namespace CRAW {
 
+    /**
+     * Encode a string as base64, for HTTP basic authentication
+     */
+    static std::string _base64 (const std::string & input) {
+        static const char alphabet [] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string output;
+        output.reserve((input.size() + 2) / 3 * 4);
+        for (size_t i = 0; i < input.size(); i += 3) {
+            unsigned int chunk = static_cast<unsigned char>(input[i]) << 16;
+            if (i + 1 < input.size()) {
+                chunk |= static_cast<unsigned char>(input[i + 1]) << 8;
+            }
+            if (i + 2 < input.size()) {
+                chunk |= static_cast<unsigned char>(input[i + 2]);
+            }
+            output += alphabet[(chunk >> 18) & 63];
+            output += alphabet[(chunk >> 12) & 63];
+            output += i + 1 < input.size() ? alphabet[(chunk >> 6) & 63] : '=';
+            output += i + 2 < input.size() ? alphabet[chunk & 63] : '=';
+        }
+        return output;
+    }
+
+    /**
+     * The size of a response's body as it came over the network, which is the decoded
+     * size if the transport doesn't know it
+     */
+    static size_t _wirebytes (const HTTPResponse & response) {
+        return response.wirebytes == 0 ? response.text.size() : response.wirebytes;
+    }
+
+    /**
+     * How long one attempt at a request may take: the endpoint's timeout, cut short by the
+     * deadline if there is one
+     */
+    static std::chrono::milliseconds _attempttimeout (const Timeout & timeout, const CancellationToken & cancellation) {
+        if (cancellation.remaining() == std::chrono::milliseconds::max()) {
+            return timeout.total;
+        }
+        // 0 would mean no timeout at all
+        std::chrono::milliseconds remaining = std::max(cancellation.remaining(), std::chrono::milliseconds(1));
+        return timeout.total.count() == 0 ? remaining : std::min(timeout.total, remaining);
+    }
+
+    /**
+     * Whether a request that got a response (or none) is safe to send again
+     */
+    static bool _retryable (const std::string & method, const HTTPResponse & response) {
+        // a POST that got no response or a server error might have gone through anyway
+        return response.status_code == 429 ||
+               (method != "POST" && (response.status_code == 0 || response.status_code >= 500));
+    }
+
+    /**
+     * The data of a message in the form that the API sends it, so that it can be rebuilt
+     */
+    static nlohmann::json _messagedata (const Message & message) {
+        nlohmann::json data = {
+            {"new", message.read},
+            {"subreddit", message.subredditname == "" ? nlohmann::json() : nlohmann::json(message.subredditname)},
+            {"author", message.authorname},
+            {"author_fullname", message.authorfullname},
+            {"score", message.score},
+            {"name", message.fullname},
+            {"type", message.type},
+            {"subject", message.subject},
+            {"body", message.body},
+            {"created", message.created},
+            {"replies", ""}
+        };
+        if (!message.children.empty()) {
+            data["replies"] = {{"data", {{"children", nlohmann::json::array()}}}};
+            nlohmann::json & children = data["replies"]["data"]["children"];
+            for (const Message & child : message.children) {
+                children.push_back({{"data", _messagedata(child)}});
+            }
+        }
+        return data;
+    }
+
     Reddit::Reddit (const std::string & user_name, 
                     const std::string & password, 
                     const std::string & client_id, 
                     const std::string & api_secret, 
-                    const std::string & user_agent) {
+                    const std::string & user_agent,
+                    std::shared_ptr<Transport> transport) {
         if (user_agent == "") {
             throw std::invalid_argument("User agent string must not be empty");
         }
@@ -27,20 +112,48 @@ namespace CRAW {
         this->clientid = client_id;
         this->_apisecret = api_secret;
         this->_password = password;
+        this->_token = "";
+        this->_expiration = 0;
+        this->_transport = transport == nullptr ? std::make_shared<CPRTransport>() : transport;
         this->authenticated = true;
+        this->_pool = nullptr;
+        _registergauges();
 
         _gettoken();
 
     }
 
 
-    Reddit::Reddit (const std::string & user_agent) {
+    Reddit::Reddit (const std::string & user_agent, std::shared_ptr<Transport> transport) {
         this->username = "";
         this->useragent = user_agent;
         this->clientid = "";
         this->_apisecret = "";
         this->_password = "";
         this->_token = "";
+        this->_expiration = 0;
+        this->_transport = transport == nullptr ? std::make_shared<CPRTransport>() : transport;
+        this->authenticated = false;
+        this->_pool = nullptr;
+        _registergauges();
+    }
+
+    void Reddit::_registergauges () {
+        metrics.gauge("concurrency_limit", "The adaptive limit on requests in flight (0 until adaptive concurrency is used).", [this] {
+            return _limiter.limit();
+        });
+        metrics.gauge("concurrency_in_flight", "Requests in flight, counted while adaptive concurrency is on.", [this] {
+            return static_cast<double>(_limiter.inflight());
+        });
+        const std::pair<const char *, Priority> priorities [] = {
+            {"interactive", Priority::interactive}, {"normal", Priority::normal}, {"background", Priority::background}
+        };
+        for (auto & [name, priority] : priorities) {
+            metrics.gauge(std::string("scheduler_queued_") + name, std::string("Requests of ") + name + " priority waiting to be sent.",
+                          [this, priority = priority] {
+                return static_cast<double>(_scheduler.queued(priority));
+            });
+        }
     }
 
     void Reddit::_gettoken () {
@@ -50,14 +163,31 @@ namespace CRAW {
             return;
         }
 
-        cpr::Response response = cpr::Post(cpr::Url{"https://www.reddit.com/api/v1/access_token"},
-                                        cpr::Authentication{clientid, _apisecret, cpr::AuthMode::BASIC},
-                                        cpr::Payload{{"grant_type", "password"}, {"username", username}, {"password", _password}},
-                                        cpr::Header{{"User-Agent", useragent}},
-                                        cpr::Ssl(cpr::ssl::TLSv1_2())); // this might otherwise default to TLS 1.0
-        nlohmann::json responsejson = nlohmann::json::parse(response.text);
+        HTTPRequest request;
+        request.method = "POST";
+        request.host = "https://www.reddit.com";
+        request.path = "/api/v1/access_token";
+        request.header = {{"User-Agent", useragent},
+                          {"Authorization", "Basic " + _base64(clientid + ":" + _apisecret)},
+                          {"Content-Type", "application/x-www-form-urlencoded"}};
+        request.body = cpr::Payload{{"grant_type", "password"}, 
+                                    {"username", username}, 
+                                    {"password", _password}}.GetContent(cpr::CurlHolder());
+        ScopedSpan span(tracer, "POST /api/v1/access_token");
+        auto start = std::chrono::steady_clock::now();
+        HTTPResponse response = _transport->send(request);
+        span.attribute("http.status", std::to_string(response.status_code));
+        span.timings(response.timings);
+        if (metrics.enabled) {
+            metrics.endpoint(request.path).record(response.status_code, std::chrono::steady_clock::now() - start,
+                                                  request.body.size(), response.text.size(), _wirebytes(response), false);
+        }
+        nlohmann::json responsejson = nlohmann::json::parse(response.text, nullptr, false);
+        if (responsejson.is_discarded()) {
+            throw errors::LoginError("The server gave a malformed response when attempting to retrieve a token.");
+        }
         if (response.status_code != 200 || !responsejson["error"].is_null()) {
-            std::string errormessage = responsejson["error"];
+            std::string errormessage = responsejson["error"].dump();
             throw errors::LoginError("An error occurred when attempting to retrieve a token: " + errormessage);
         }
 
@@ -65,92 +195,329 @@ namespace CRAW {
         _expiration = (time_t)responsejson["expires_in"] + time(nullptr);
     }
 
-    nlohmann::json Reddit::_sendrequest (const std::string & method, 
-                                         const std::string & targeturl, 
-                                         const std::string & body) {
-
-        if (time(nullptr) >= _expiration - 5) {
-            // the token is expiring soon, get another one
-            _gettoken();
+    HTTPRequest Reddit::_makerequest (const std::string & method,
+                                      const std::string & targeturl,
+                                      const std::string & body,
+                                      const std::string & contenttype,
+                                      const CancellationToken & cancellation) {
+        if (method != "GET" && method != "POST" && method != "PUT" && method != "DELETE") {
+            throw std::invalid_argument(method + " is not a recognised HTTP method.");
         }
+        cancellation.check();
 
-        // this might otherwise default to TLS 1.0. TLS 1.2+ is more secure
-        cpr::SslOptions tls = cpr::Ssl(cpr::ssl::TLSv1_2());
+        std::string token;
+        if (authenticated) {
+            std::lock_guard<std::mutex> guard(_tokenlock);
+            if (time(nullptr) >= _expiration - 5) {
+                // the token is expiring soon, get another one
+                _gettoken();
+            }
+            token = _token;
+        }
 
-        cpr::Header header;
-        cpr::Url url;
+        HTTPRequest request;
+        request.method = method;
+        request.path = targeturl;
+        request.body = body;
         if (authenticated) {
-            header = {{"User-Agent", useragent}, {"Authorization", "bearer " + _token}};
-            url = "https://oauth.reddit.com" + targeturl;
-        } else {
-            header = {{"User-Agent", useragent}};
-            url = "https://api.reddit.com" + targeturl;
-        }
-
-        
-        cpr::Response response;
-        if (method == "GET") {
-            response = cpr::Get(url, header, tls);
-        } else if (method == "POST") {
-            response = cpr::Post(url, header, cpr::Body{body}, tls);
-        } else if (method == "PUT") {
-            response = cpr::Put(url, header, cpr::Body{body}, tls);
-        } else if (method == "DELETE") {
-            response = cpr::Delete(url, header, tls);
+            request.header = {{"User-Agent", useragent}, {"Authorization", "bearer " + token}};
+            request.host = "https://oauth.reddit.com";
         } else {
-            throw std::invalid_argument(method + " is not a recognised HTTP method.");
+            request.header = {{"User-Agent", useragent}};
+            request.host = "https://api.reddit.com";
+        }
+        if (contenttype != "") {
+            request.header["Content-Type"] = contenttype;
+        }
+        request.connecttimeout = timeouts.get(targeturl).connect;
+        request.cancellation = cancellation;
+        return request;
+    }
+
+
+    HTTPResponse Reddit::_send (const std::string & method,
+                                const std::string & targeturl,
+                                const std::string & body,
+                                const std::string & contenttype,
+                                const CancellationToken & cancellation,
+                                bool route) {
+        if (route && _pool != nullptr) {
+            Reddit & sender = _pool->_sender(*this, method, targeturl);
+            if (&sender != this) {
+                return sender._send(method, targeturl, body, contenttype, cancellation, false);
+            }
+        }
+        HTTPRequest request = _makerequest(method, targeturl, body, contenttype, cancellation);
+        const Timeout & timeout = timeouts.get(targeturl);
+
+        EndpointMetrics * stats = metrics.enabled ? &metrics.endpoint(targeturl) : nullptr;
+        std::string endpoint = stats != nullptr ? stats->endpoint : endpointtemplate(targeturl);
+        HTTPResponse response;
+        Priority priority = PriorityScope::current();
+        for (request.attempt = 0; ; request.attempt++) {
+            if (scheduling.enabled) {
+                _scheduler.acquire(scheduling, priority, cancellation);
+            }
+            std::chrono::steady_clock::time_point slot;
+            if (concurrency.enabled) {
+                slot = _limiter.acquire(concurrency, priority, cancellation);
+            }
+            request.timeout = _attempttimeout(timeout, cancellation);
+            ScopedSpan span(tracer, tracer.enabled() ? method + " " + endpoint : "");
+            _scheduler.sending();
+            auto start = std::chrono::steady_clock::now();
+            try {
+                if (hedging.enabled && method == "GET") {
+                    response = _hedger.send(_transport, request, hedging, endpoint, _hedgegate(endpoint), stats);
+                } else {
+                    response = _transport->send(request);
+                }
+            } catch (const errors::CircuitOpenError &) {
+                // the request wasn't sent, so it shouldn't use up the budget of the ones that are
+                if (concurrency.enabled) {
+                    _limiter.release(concurrency, slot, -1, endpoint);
+                }
+                _scheduler.refund(scheduling, scheduling.enabled);
+                throw;
+            } catch (...) {
+                if (concurrency.enabled) {
+                    _limiter.release(concurrency, slot, -1, endpoint);
+                }
+                throw;
+            }
+            if (concurrency.enabled) {
+                bool cancelled = response.status_code == 0 && cancellation.cancelled();
+                _limiter.release(concurrency, slot, cancelled ? -1 : response.status_code, endpoint);
+            }
+            if (hedging.enabled) {
+                _hedger.observe(response);
+            }
+            // RedditPool reads the rate limit even when scheduling is off
+            _scheduler.observe(response);
+            if (stats != nullptr) {
+                stats->record(response.status_code, std::chrono::steady_clock::now() - start,
+                              body.size(), response.text.size(), _wirebytes(response), request.attempt > 0);
+            }
+            if (span.active()) {
+                span.attribute("http.path", targeturl);
+                span.attribute("http.status", std::to_string(response.status_code));
+                span.attribute("attempt", std::to_string(request.attempt));
+                if (response.error != "") {
+                    span.attribute("error", response.error);
+                }
+                span.timings(response.timings);
+            }
+            if (response.status_code == 0 && cancellation.cancelled()) {
+                cancellation.check();
+            }
+            if (!_retryable(method, response) || request.attempt >= retrypolicy.maxretries) {
+                return response;
+            }
+            if (!cancellation.sleep(_retrywait(response, request.attempt))) {
+                cancellation.check();
+            }
+        }
+    }
+
+    HedgeGate Reddit::_hedgegate (const std::string & endpoint) {
+        HedgeGate gate;
+        auto slot = std::make_shared<std::chrono::steady_clock::time_point>();
+        gate.admit = [this, slot, endpoint] () {
+            if (concurrency.enabled && !_limiter.tryacquire(concurrency, *slot)) {
+                return false;
+            }
+            if (scheduling.enabled && !_scheduler.tryacquire(scheduling)) {
+                if (concurrency.enabled) {
+                    _limiter.release(concurrency, *slot, -1, endpoint);
+                }
+                return false;
+            }
+            _scheduler.sending();
+            return true;
+        };
+        gate.answered = [this, slot, endpoint] (const HTTPResponse & response, bool aborted, bool sent) {
+            if (concurrency.enabled) {
+                _limiter.release(concurrency, *slot, aborted ? -1 : response.status_code, endpoint);
+            }
+            if (!sent) {
+                // as in _send(), a hedge that the transport refused gives back its token
+                _scheduler.refund(scheduling, scheduling.enabled);
+            }
+            _scheduler.observe(response);
+        };
+        return gate;
+    }
+
+    std::chrono::milliseconds Reddit::_retrywait (const HTTPResponse & response, int attempt) const {
+        std::chrono::milliseconds wait = retrypolicy.backoff * (1 << attempt);
+        auto retryafter = response.header.find("Retry-After");
+        if (retryafter != response.header.end()) {
+            try {
+                wait = std::max(wait, std::chrono::milliseconds(std::stol(retryafter->second) * 1000));
+            } catch (const std::exception &) {
+                // Retry-After can also be an HTTP date, which Reddit doesn't send
+            }
+        }
+        return std::min(wait, retrypolicy.maxwait);
+    }
+
+    nlohmann::json Reddit::_sendrequest (const std::string & method, 
+                                         const std::string & targeturl, 
+                                         const std::string & body,
+                                         const CancellationToken & cancellation) {
+        HTTPResponse response = _send(method, targeturl, body, "", cancellation);
+        return _check(targeturl, response);
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<HTTPResponse> Reddit::_sendco (std::string method,
+                                        std::string targeturl,
+                                        std::string body,
+                                        std::string contenttype,
+                                        CancellationToken cancellation,
+                                        Priority priority,
+                                        bool route) {
+        if (route && _pool != nullptr) {
+            Reddit & sender = _pool->_sender(*this, method, targeturl);
+            if (&sender != this) {
+                co_return co_await sender._sendco(method, targeturl, body, contenttype, cancellation, priority, false);
+            }
+        }
+        HTTPRequest request = _makerequest(method, targeturl, body, contenttype, cancellation);
+        const Timeout & timeout = timeouts.get(targeturl);
+        EndpointMetrics * stats = metrics.enabled ? &metrics.endpoint(targeturl) : nullptr;
+        std::string endpoint = stats != nullptr ? stats->endpoint : endpointtemplate(targeturl);
+        for (request.attempt = 0; ; request.attempt++) {
+            if (scheduling.enabled) {
+                Scheduler::Ticket ticket;
+                for (auto wait = _scheduler.poll(scheduling, priority, ticket); wait.count() > 0; wait = _scheduler.poll(scheduling, priority, ticket)) {
+                    co_await DelayAwaiter(*_transport, _executor, execution, wait, cancellation);
+                    if (cancellation.cancelled()) {
+                        _scheduler.leave(ticket);
+                        cancellation.check();
+                    }
+                }
+            }
+            std::chrono::steady_clock::time_point slot;
+            if (concurrency.enabled) {
+                slot = co_await SlotAwaiter(*_transport, _executor, execution, _limiter, concurrency, priority, cancellation);
+            }
+            request.timeout = _attempttimeout(timeout, cancellation);
+            ScopedSpan span(tracer, tracer.enabled() ? method + " " + endpoint : "", false);
+            _scheduler.sending();
+            auto start = std::chrono::steady_clock::now();
+            HTTPResponse response;
+            try {
+                response = co_await SendAwaiter(*_transport, request);
+            } catch (const errors::CircuitOpenError &) {
+                // the request wasn't sent, so it shouldn't use up the budget of the ones that are
+                if (concurrency.enabled) {
+                    _limiter.release(concurrency, slot, -1, endpoint);
+                }
+                _scheduler.refund(scheduling, scheduling.enabled);
+                throw;
+            } catch (...) {
+                if (concurrency.enabled) {
+                    _limiter.release(concurrency, slot, -1, endpoint);
+                }
+                throw;
+            }
+            if (concurrency.enabled) {
+                bool cancelled = response.status_code == 0 && cancellation.cancelled();
+                _limiter.release(concurrency, slot, cancelled ? -1 : response.status_code, endpoint);
+            }
+            if (hedging.enabled) {
+                _hedger.observe(response);
+            }
+            _scheduler.observe(response);
+            if (stats != nullptr) {
+                stats->record(response.status_code, std::chrono::steady_clock::now() - start,
+                              body.size(), response.text.size(), _wirebytes(response), request.attempt > 0);
+            }
+            if (span.active()) {
+                span.attribute("http.path", targeturl);
+                span.attribute("http.status", std::to_string(response.status_code));
+                span.attribute("attempt", std::to_string(request.attempt));
+                if (response.error != "") {
+                    span.attribute("error", response.error);
+                }
+                span.timings(response.timings);
+            }
+            if (response.status_code == 0 && cancellation.cancelled()) {
+                cancellation.check();
+            }
+            if (!_retryable(method, response) || request.attempt >= retrypolicy.maxretries) {
+                co_return response;
+            }
+            co_await DelayAwaiter(*_transport, _executor, execution, _retrywait(response, request.attempt), cancellation);
+            cancellation.check();
         }
+    }
+
+    Task<nlohmann::json> Reddit::_sendrequestco (std::string method,
+                                                 std::string targeturl,
+                                                 std::string body,
+                                                 CancellationToken cancellation,
+                                                 Priority priority) {
+        HTTPResponse response = co_await _sendco(method, targeturl, body, "", cancellation, priority);
+        co_return _check(targeturl, response);
+    }
+#endif
+
+    nlohmann::json Reddit::_check (const std::string & targeturl, const HTTPResponse & response) {
         switch (response.status_code) {
             case 404:
                 throw errors::NotFoundError("Server responded with HTTP 404 (Not Found)");
             case 403:
                 throw errors::UnauthorisedError("Server responded with HTTP 403 (Unauthorised)");
             case 200:
-                return nlohmann::json::parse(response.text);
+                return _parse(targeturl, response.text);
+            case 0:
+                throw errors::CommunicationError("No response from the server: " + response.error);
             default:
-                throw errors::CommunicationError("Server responded with error code " + response.status_code);
+                throw errors::CommunicationError("Server responded with error code " + std::to_string(response.status_code));
         }
-
-        
     }
 
     nlohmann::json Reddit::_sendrequest (const std::string & method, 
                                          const std::string & targeturl, 
                                          const cpr::Payload & body,
-                                         const cpr::Parameters & parameters) {
-
-        if (time(nullptr) >= _expiration - 5) {
-            // the token is expiring soon, get another one
-            _gettoken();
+                                         const cpr::Parameters & parameters,
+                                         const CancellationToken & cancellation) {
+        cpr::CurlHolder holder;
+        std::string query = parameters.GetContent(holder);
+        std::string url = query == "" ? targeturl : targeturl + "?" + query;
+        HTTPResponse response;
+        if (method == "GET" || method == "DELETE") {
+            response = _send(method, url, "", "", cancellation);
+        } else {
+            response = _send(method, url, body.GetContent(holder), "application/x-www-form-urlencoded", cancellation);
         }
+        return _check(targeturl, response);
+    }
 
-        // this might otherwise default to TLS 1.0. TLS 1.2+ is more secure
-        cpr::SslOptions tls = cpr::Ssl(cpr::ssl::TLSv1_2());
+    Expected<nlohmann::json> Reddit::_tryrequest (const std::string & targeturl,
+                                                  const cpr::Parameters & parameters,
+                                                  const CancellationToken & cancellation) {
+        cpr::CurlHolder holder;
+        std::string query = parameters.GetContent(holder);
+        HTTPResponse response = _send("GET", query == "" ? targeturl : targeturl + "?" + query, "", "", cancellation);
+        if (response.status_code == 404) {
+            return ErrorCode::notfound;
+        } else if (response.status_code == 403) {
+            return ErrorCode::unauthorised;
+        }
+        return Expected<nlohmann::json>(_check(targeturl, response));
+    }
 
-        cpr::Header header;
-        cpr::Url url;
-        if (authenticated) {
-            header = {{"User-Agent", useragent}, {"Authorization", "bearer " + _token}};
-            url = "https://oauth.reddit.com" + targeturl;
-        } else {
-            header = {{"User-Agent", useragent}};
-            url = "https://api.reddit.com" + targeturl;
-        }
-
-        
-        cpr::Response response;
-        if (method == "GET") {
-            response = cpr::Get(url, header, parameters, tls);
-        } else if (method == "POST") {
-            response = cpr::Post(url, header, body, parameters, tls);
-        } else if (method == "PUT") {
-            response = cpr::Put(url, header, body, parameters, tls);
-        } else if (method == "DELETE") {
-            response = cpr::Delete(url, header, parameters, tls);
-        } else {
-            throw std::invalid_argument(method + " is not a recognised HTTP method.");
+    nlohmann::json Reddit::_parse (const std::string & targeturl, const std::string & text) {
+        if (!metrics.enabled) {
+            return nlohmann::json::parse(text);
         }
-        return nlohmann::json::parse(response.text);
+        auto start = std::chrono::steady_clock::now();
+        nlohmann::json parsed = nlohmann::json::parse(text);
+        metrics.endpoint(targeturl).parsetime.record(std::chrono::steady_clock::now() - start);
+        return parsed;
     }
 
 
@@ -167,15 +534,260 @@ namespace CRAW {
         return Redditor(name, this);
     }
 
+    Expected<Redditor> Reddit::tryredditor (const std::string & name, const CancellationToken & cancellation) {
+        try {
+            Expected<nlohmann::json> response = _tryrequest("/user/" + name + "/about", {}, cancellation);
+            if (!response) {
+                return response.error();
+            }
+            const nlohmann::json & about = (*response)["data"];
+            // suspended accounts have an about page with nothing but their name
+            if (!about.is_object() || about.value("is_suspended", false)) {
+                return ErrorCode::notfound;
+            }
+            return Redditor(this, about);
+        } catch (const errors::CancelledError &) {
+            return ErrorCode::cancelled;
+        } catch (const errors::CommunicationError &) {
+            return ErrorCode::communication;
+        } catch (const nlohmann::json::exception &) {
+            return ErrorCode::communication;
+        }
+    }
+
+    std::map<std::string, Expected<Redditor>> Reddit::_lookupredditors (const std::vector<std::string> & fullnames,
+                                                                        const CancellationToken & cancellation,
+                                                                        bool throwing) {
+        std::set<std::string> unique;
+        std::vector<std::string> wanted;
+        for (const std::string & fullname : fullnames) {
+            if (fullname != "" && unique.insert(fullname).second) {
+                wanted.push_back(fullname);
+            }
+        }
+        std::map<std::string, Expected<Redditor>> results;
+        // the endpoint takes up to 100 ids at a time
+        for (size_t start = 0; start < wanted.size(); start += 100) {
+            size_t end = std::min(start + 100, wanted.size());
+            std::string ids;
+            for (size_t i = start; i < end; i++) {
+                ids += (ids == "" ? "" : ",") + wanted[i];
+            }
+            ErrorCode failure = ErrorCode::none;
+            try {
+                // a 404 means that none of the batch exist any more
+                Expected<nlohmann::json> response = _tryrequest("/api/user_data_by_account_ids", cpr::Parameters{{"ids", ids}}, cancellation);
+                if (response && !response->is_object()) {
+                    throw errors::CommunicationError("Malformed response from server when fetching Redditors by fullname.");
+                }
+                // suspended and deleted accounts are missing from the response, or have no name
+                if (response) {
+                    for (auto & [fullname, data] : response->items()) {
+                        if (data.is_object() && data["name"].is_string() && unique.count(fullname) != 0) {
+                            results.emplace(fullname, Redditor(fullname, data, this));
+                        }
+                    }
+                }
+            } catch (const errors::CancelledError &) {
+                if (throwing) {
+                    throw;
+                }
+                failure = ErrorCode::cancelled;
+            } catch (const errors::CommunicationError &) {
+                if (throwing) {
+                    throw;
+                }
+                failure = ErrorCode::communication;
+            }
+            for (size_t i = start; i < end; i++) {
+                results.emplace(wanted[i], failure == ErrorCode::none ? ErrorCode::notfound : failure);
+            }
+        }
+        return results;
+    }
+
+    std::map<std::string, Redditor> Reddit::redditors (const std::vector<std::string> & fullnames,
+                                                       const CancellationToken & cancellation) {
+        std::map<std::string, Redditor> found;
+        for (auto & [fullname, redditor] : _lookupredditors(fullnames, cancellation, true)) {
+            if (redditor) {
+                found.emplace(fullname, std::move(*redditor));
+            }
+        }
+        return found;
+    }
+
+    std::map<std::string, Expected<Redditor>> Reddit::tryredditors (const std::vector<std::string> & fullnames,
+                                                                    const CancellationToken & cancellation) {
+        return _lookupredditors(fullnames, cancellation, false);
+    }
+
     Subreddit Reddit::subreddit (const std::string & name) {
         return Subreddit(name, this);
     }
 
+    Expected<Subreddit> Reddit::trysubreddit (const std::string & name, const CancellationToken & cancellation) {
+        try {
+            Expected<nlohmann::json> response = _tryrequest("/r/" + name + "/about", {}, cancellation);
+            if (!response) {
+                return response.error();
+            }
+            nlohmann::json & about = (*response)["data"];
+            // a search listing means there isn't a subreddit with that exact name
+            if (!about.is_object() || about.contains("children")) {
+                return ErrorCode::notfound;
+            }
+            return Subreddit(about, this);
+        } catch (const errors::CancelledError &) {
+            return ErrorCode::cancelled;
+        } catch (const errors::CommunicationError &) {
+            return ErrorCode::communication;
+        } catch (const nlohmann::json::exception &) {
+            return ErrorCode::communication;
+        }
+    }
+
+    std::map<std::string, Expected<Subreddit>> Reddit::subreddits (const std::vector<std::string> & names,
+                                                                   const CancellationToken & cancellation) {
+        // /api/info takes up to 100 fullnames or up to 100 names, but not both at once
+        std::set<std::string> unique;
+        std::vector<std::string> byid;
+        std::vector<std::string> byname;
+        for (const std::string & name : names) {
+            if (name != "" && unique.insert(name).second) {
+                (name.compare(0, 3, "t5_") == 0 ? byid : byname).push_back(name);
+            }
+        }
+        std::vector<std::vector<std::string>> chunks;
+        for (const std::vector<std::string> * kind : {&byid, &byname}) {
+            for (size_t start = 0; start < kind->size(); start += 100) {
+                chunks.emplace_back(kind->begin() + start, kind->begin() + std::min(start + 100, kind->size()));
+            }
+        }
+        auto lowercase = [] (std::string name) {
+            std::transform(name.begin(), name.end(), name.begin(), [] (unsigned char c) {
+                return std::tolower(c);
+            });
+            return name;
+        };
+        // the workers don't inherit the caller's PriorityScope, so pass it on
+        Priority priority = PriorityScope::current(Priority::background);
+
+        auto lookup = [&] (size_t index) {
+            PriorityScope scope(priority);
+            const std::vector<std::string> & chunk = chunks[index];
+            bool ids = chunk.front().compare(0, 3, "t5_") == 0;
+            std::string joined;
+            for (const std::string & name : chunk) {
+                joined += (joined == "" ? "" : ",") + name;
+            }
+            nlohmann::json responsejson;
+            ErrorCode failure = ErrorCode::none;
+            try {
+                Expected<nlohmann::json> response = _tryrequest("/api/info", cpr::Parameters{{ids ? "id" : "sr_name", joined}}, cancellation);
+                if (!response) {
+                    failure = response.error();
+                } else if (!(*response)["data"]["children"].is_array()) {
+                    failure = ErrorCode::communication;
+                } else {
+                    responsejson = std::move(*response);
+                }
+            } catch (const errors::CommunicationError &) {
+                failure = ErrorCode::communication;
+            } catch (const errors::CancelledError &) {
+                failure = ErrorCode::cancelled;
+            } catch (const nlohmann::json::exception &) {
+                failure = ErrorCode::communication;
+            }
+
+            // subreddits that don't exist or are banned are missing from the listing
+            std::map<std::string, nlohmann::json *> found;
+            if (failure == ErrorCode::none) {
+                for (auto & child : responsejson["data"]["children"]) {
+                    if (child["kind"] == "t5") {
+                        nlohmann::json & data = child["data"];
+                        found[ids ? data["name"].get<std::string>() : lowercase(data["display_name"].get<std::string>())] = &data;
+                    }
+                }
+            }
+            std::vector<std::pair<std::string, Expected<Subreddit>>> results;
+            for (const std::string & name : chunk) {
+                auto match = found.find(ids ? name : lowercase(name));
+                if (failure != ErrorCode::none) {
+                    results.emplace_back(name, failure);
+                } else if (match == found.end()) {
+                    results.emplace_back(name, ErrorCode::notfound);
+                } else {
+                    try {
+                        results.emplace_back(name, Subreddit(*match->second, this));
+                    } catch (const nlohmann::json::exception &) {
+                        results.emplace_back(name, ErrorCode::communication);
+                    }
+                }
+            }
+            return results;
+        };
+
+        std::map<std::string, Expected<Subreddit>> results;
+        for (auto & chunk : executor().map(chunks.size(), lookup)) {
+            for (auto & [name, subreddit] : chunk) {
+                results.emplace(name, std::move(subreddit));
+            }
+        }
+        return results;
+    }
+
     Post Reddit::post (const std::string & id) {
         return Post(id, this);
 
     }
 
+    Expected<Post> Reddit::trypost (const std::string & id, const CancellationToken & cancellation) {
+        try {
+            Expected<nlohmann::json> listing = _tryrequest("/comments/" + id, {}, cancellation);
+            if (!listing) {
+                return listing.error();
+            }
+            if (!listing->is_array() || listing->size() < 2 || (*listing)[0]["data"]["children"].empty()) {
+                return ErrorCode::communication;
+            }
+            return Post(id, *listing, this);
+        } catch (const errors::CancelledError &) {
+            return ErrorCode::cancelled;
+        } catch (const errors::CommunicationError &) {
+            return ErrorCode::communication;
+        } catch (const nlohmann::json::exception &) {
+            return ErrorCode::communication;
+        }
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<Subreddit> Reddit::subreddit_co (std::string name) {
+        nlohmann::json about;
+        try {
+            about = (co_await _sendrequestco("GET", "/r/" + name + "/about"))["data"];
+        } catch (errors::NotFoundError &) {
+            throw errors::NotFoundError("Could not find a subreddit with name r/" + name);
+        } catch (errors::UnauthorisedError &) {
+            throw errors::UnauthorisedError("You aren't allowed to access r/" + name);
+        }
+        Subreddit::_checkabout(name, about);
+        co_return Subreddit(about, this);
+    }
+
+    Task<Post> Reddit::post_co (std::string id) {
+        nlohmann::json listing;
+        try {
+            listing = co_await _sendrequestco("GET", "/comments/" + id);
+        } catch (errors::NotFoundError &) {
+            throw errors::NotFoundError("No such post with ID " + id);
+        } catch (errors::UnauthorisedError &) {
+            throw errors::UnauthorisedError("You are not authorised to view the post with ID " + id);
+        }
+        co_return Post(id, listing, this);
+    }
+#endif
+
     std::multiset<std::string> Reddit::search (const std::string & query, bool exact, bool nsfw, bool autocomplete, int limit) {
         if (limit < 0 || limit > 10) {
             throw std::invalid_argument("The limit of results to return must be between 0 and 10.");
@@ -199,15 +811,61 @@ namespace CRAW {
         return results;
     }
 
-    std::vector<Message> Reddit::inbox (const std::string & filter, ListingPage listingpage, const std::string & direction) {
+    std::vector<Message> Reddit::inbox (const std::string & filter, ListingPage listingpage, const std::string & direction,
+                                        const CancellationToken & cancellation) {
         if (filter != "inbox" && filter != "sent" && filter != "unread" && filter != "messages") {
             throw std::invalid_argument("filter must be either \"inbox\", \"unread\", \"sent\", or \"messages\" not " + filter + ".");
         }
-        nlohmann::json response = _sendrequest("GET", "/message/" + filter);
-        std::vector<Message> inbox;
+        nlohmann::json response = _sendrequest("GET", "/message/" + filter, "", cancellation);
+        return _inboxobjects(response);
+    }
+
+    std::vector<Message> Reddit::_inboxobjects (nlohmann::json & response) {
+        std::vector<nlohmann::json *> items;
         for (auto & object : response["data"]["children"]) {
-            inbox.emplace_back(Message(object["data"], this));
+            items.push_back(&object["data"]);
+        }
+        return _objects<Message>(items);
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<std::vector<Message>> Reddit::inbox_co (std::string filter, CancellationToken cancellation) {
+        if (filter != "inbox" && filter != "sent" && filter != "unread" && filter != "messages") {
+            throw std::invalid_argument("filter must be either \"inbox\", \"unread\", \"sent\", or \"messages\" not " + filter + ".");
+        }
+        nlohmann::json response = co_await _sendrequestco("GET", "/message/" + filter, "", cancellation);
+        co_return _inboxobjects(response);
+    }
+#endif
+
+    Stream<Message> Reddit::inboxstream (const std::string & filter, bool skipexisting) {
+        if (filter != "inbox" && filter != "sent" && filter != "unread" && filter != "messages") {
+            throw std::invalid_argument("filter must be either \"inbox\", \"unread\", \"sent\", or \"messages\" not " + filter + ".");
+        }
+        Stream<Message> stream([this, filter] (const CancellationToken & cancellation) {
+            return inbox(filter, ListingPage(), "after", cancellation);
+        }, skipexisting);
+        if (execution.enabled) {
+            stream.executor = &executor();
+        }
+        stream.metrics = &metrics;
+        stream.encode = [] (const Message & message) {
+            return _messagedata(message).dump();
+        };
+        stream.decode = [this] (const std::string & line) {
+            return Message(nlohmann::json::parse(line), this);
+        };
+        return stream;
+    }
+
+    RateLimit Reddit::ratelimit () {
+        return _scheduler.ratelimit();
+    }
+
+    Executor & Reddit::executor () {
+        if (_executor.size() == 0) {
+            _executor.start(execution);
         }
-        return inbox;
+        return _executor;
     }
-}
\ No newline at end of file
+}
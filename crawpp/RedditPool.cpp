@@ -0,0 +1,160 @@
+#include <limits>
+#include <stdexcept>
+
+#include "crawpp/RedditPool.h"
+#include "crawpp/Subreddit.h"
+#include "crawpp/Redditor.h"
+#include "crawpp/Post.h"
+#include "crawpp/Metrics.h"
+
+namespace CRAW {
+
+    RedditPool::RedditPool (const std::vector<Credentials> & credentials,
+                            const std::string & useragent,
+                            std::shared_ptr<Transport> transport) {
+        if (credentials.empty()) {
+            throw std::invalid_argument("A RedditPool needs at least one account");
+        }
+        for (const Credentials & account : credentials) {
+            _accounts.push_back({std::make_unique<Reddit>(account.username, account.password, account.clientid,
+                                                          account.apisecret, useragent, transport), 0, 0});
+            _accounts.back().reddit->scheduling.enabled = true;
+            _accounts.back().reddit->_pool = this;
+        }
+        _writer = 0;
+    }
+
+    /// Whether a request reads something that looks the same to every account, so that any
+    /// of them can send it
+    static bool _shared (const std::string & method, const std::string & path) {
+        if (method != "GET") {
+            return false;
+        }
+        std::string endpoint = endpointtemplate(path);
+        if (endpoint.rfind("/r/{sub}/about/", 0) == 0) {
+            // the rest of about/ is for moderators, e.g. /about/modqueue
+            return endpoint == "/r/{sub}/about/rules" || endpoint == "/r/{sub}/about/moderators";
+        }
+        if (endpoint.rfind("/user/{name}/", 0) == 0) {
+            // only the account itself can see these
+            for (const char * own : {"/saved", "/upvoted", "/downvoted", "/hidden"}) {
+                if (endpoint == "/user/{name}" + std::string(own)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        for (const char * prefix : {"/r/{sub}", "/comments/", "/duplicates/", "/by_id/"}) {
+            if (endpoint.rfind(prefix, 0) == 0) {
+                return true;
+            }
+        }
+        return endpoint == "/api/info" || endpoint == "/api/user_data_by_account_ids" || endpoint == "/api/morechildren";
+    }
+
+    Reddit & RedditPool::_sender (Reddit & from, const std::string & method, const std::string & path) {
+        return _shared(method, path) ? reader() : from;
+    }
+
+    Reddit & RedditPool::reader () {
+        size_t best = _choose();
+        std::lock_guard<std::mutex> guard(_lock);
+        _accounts[best].reads++;
+        return *_accounts[best].reddit;
+    }
+
+    size_t RedditPool::_choose () {
+        size_t best = 0;
+        double bestremaining = -1;
+        for (size_t i = 0; i < _accounts.size(); i++) {
+            double remaining = _accounts[i].reddit->ratelimit().remaining;
+            if (remaining < 0) {
+                remaining = std::numeric_limits<double>::max();
+            }
+            std::lock_guard<std::mutex> guard(_lock);
+            if (remaining > bestremaining || (remaining == bestremaining && _accounts[i].reads < _accounts[best].reads)) {
+                best = i;
+                bestremaining = remaining;
+            }
+        }
+        return best;
+    }
+
+    Reddit & RedditPool::writer () {
+        std::lock_guard<std::mutex> guard(_lock);
+        _accounts[_writer].writes++;
+        return *_accounts[_writer].reddit;
+    }
+
+    void RedditPool::pin (const std::string & username) {
+        Reddit * chosen = &account(username);
+        std::lock_guard<std::mutex> guard(_lock);
+        for (size_t i = 0; i < _accounts.size(); i++) {
+            if (_accounts[i].reddit.get() == chosen) {
+                _writer = i;
+            }
+        }
+    }
+
+    Reddit & RedditPool::account (const std::string & username) {
+        for (Account & account : _accounts) {
+            if (account.reddit->username == username) {
+                return *account.reddit;
+            }
+        }
+        throw std::invalid_argument("There is no account called " + username + " in the pool");
+    }
+
+    size_t RedditPool::size () const {
+        return _accounts.size();
+    }
+
+    Reddit & RedditPool::operator[] (size_t index) {
+        return *_accounts.at(index).reddit;
+    }
+
+    // the requests these make are counted as reads when they are handed to the reader, so
+    // choosing the account to start from doesn't count
+
+    Subreddit RedditPool::subreddit (const std::string & name) {
+        return _accounts[_choose()].reddit->subreddit(name);
+    }
+
+    Redditor RedditPool::redditor (const std::string & name) {
+        return _accounts[_choose()].reddit->redditor(name);
+    }
+
+    Post RedditPool::post (const std::string & id) {
+        return _accounts[_choose()].reddit->post(id);
+    }
+
+    std::map<std::string, Expected<Subreddit>> RedditPool::subreddits (const std::vector<std::string> & names,
+                                                                       const CancellationToken & cancellation) {
+        return _accounts[_choose()].reddit->subreddits(names, cancellation);
+    }
+
+    std::map<std::string, Redditor> RedditPool::redditors (const std::vector<std::string> & fullnames,
+                                                           const CancellationToken & cancellation) {
+        return _accounts[_choose()].reddit->redditors(fullnames, cancellation);
+    }
+
+    std::vector<AccountUsage> RedditPool::usage () {
+        std::vector<AccountUsage> usage;
+        for (Account & account : _accounts) {
+            AccountUsage entry;
+            entry.username = account.reddit->username;
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                entry.reads = account.reads;
+                entry.writes = account.writes;
+            }
+            entry.requests = 0;
+            for (const EndpointSnapshot & endpoint : account.reddit->metrics.snapshot()) {
+                entry.requests += endpoint.requests;
+            }
+            entry.ratelimit = account.reddit->ratelimit();
+            usage.push_back(entry);
+        }
+        return usage;
+    }
+}
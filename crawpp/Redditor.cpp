@@ -1,7 +1,18 @@
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
 
 #include "crawpp/Redditor.h"
+#include "crawpp/Post.h"
+#include "crawpp/Comment.h"
+#include "crawpp/Scheduler.h"
+#include "crawpp/Tracing.h"
 #include "crawpp/crawexceptions.hpp"
 
 using namespace CRAW;
@@ -20,34 +31,58 @@ Redditor::Redditor (const std::string & name, Reddit * redditinstance) {
     }
 
     _redditinstance = redditinstance;
-    username = responsejson["name"];
-    created = responsejson["created"];
-    totalkarma = responsejson["total_karma"];
-    awardeekarma = responsejson["awardee_karma"];
-    awarderkarma = responsejson["awarder_karma"];
-    commentkarma = responsejson["comment_karma"];
-    postkarma = responsejson["link_karma"];
-    fullname = std::string("t2_") + static_cast<std::string>(responsejson["id"]);
-    information = responsejson;
+    _init(responsejson);
+}
+
+Redditor::Redditor (Reddit * redditinstance, const nlohmann::json & about) {
+    _redditinstance = redditinstance;
+    _init(about);
+}
+
+void Redditor::_init (const nlohmann::json & about) {
+    username = about["name"];
+    created = about["created"];
+    totalkarma = about["total_karma"];
+    awardeekarma = about["awardee_karma"];
+    awarderkarma = about["awarder_karma"];
+    commentkarma = about["comment_karma"];
+    postkarma = about["link_karma"];
+    fullname = std::string("t2_") + static_cast<std::string>(about["id"]);
+    information = about;
+}
+
+Redditor::Redditor (const std::string & fullname, const nlohmann::json & data, Reddit * redditinstance) {
+    _redditinstance = redditinstance;
+    username = data["name"].get<std::string>();
+    created = data.value("created_utc", 0.0);
+    postkarma = data.value("link_karma", 0);
+    commentkarma = data.value("comment_karma", 0);
+    // the bulk endpoint doesn't report award karma
+    awardeekarma = 0;
+    awarderkarma = 0;
+    totalkarma = postkarma + commentkarma;
+    this->fullname = fullname;
+    information = data;
+    information["id"] = fullname.substr(3);
 }
 
 std::string Redditor::operator[] (const std::string & attribute) {
-    nlohmann::json value = information[attribute];
-    if (value.is_null()) {
+    auto value = information.find(attribute);
+    if (value == information.end() || value->is_null()) {
         throw std::invalid_argument("Attribute " + attribute + " doesn't exist.");
     }
-    if (value.is_boolean()) {
-        return value ? "true" : "false";
+    if (value->is_boolean()) {
+        return value->get<bool>() ? "true" : "false";
     }
-    if (value.is_number()) {
-        return std::to_string((double) value);
+    if (value->is_number()) {
+        return std::to_string(value->get<double>());
     }
-    if (value.is_string()) {
-        return value;
+    if (value->is_string()) {
+        return value->get<std::string>();
     }
     // This means the value is an object or an array (which is technically also an object)
     // return it as a JSON-string
-    return value.dump();
+    return value->dump();
 }
 
 void Redditor::follow () {
@@ -80,4 +115,239 @@ void Redditor::block () {
     nlohmann::json body;
     body["name"] = username;
     _redditinstance->_sendrequest("POST", "/api/block_user", cpr::Payload{{"name", username}});
-}
\ No newline at end of file
+}
+
+template <typename T>
+Expected<std::vector<T>> Redditor::_tryhistorypage (const std::string & name,
+                                                   Reddit * redditinstance,
+                                                   const HistoryOptions & options,
+                                                   ListingPage & page,
+                                                   const CancellationToken & cancellation) {
+    std::string listing;
+    if constexpr (std::is_same_v<T, Post>) {
+        listing = "submitted";
+    } else if constexpr (std::is_same_v<T, Comment>) {
+        listing = "comments";
+    } else {
+        listing = "overview";
+    }
+    if (options.sort != "new" && options.sort != "hot" && options.sort != "top" && options.sort != "controversial") {
+        throw std::invalid_argument("Invalid sort type: " + options.sort);
+    }
+    if (options.period != "hour" && options.period != "day" && options.period != "week" &&
+        options.period != "month" && options.period != "year" && options.period != "all") {
+        throw std::invalid_argument("Invalid period: " + options.period);
+    }
+
+    ScopedSpan span(redditinstance->tracer, "Redditor::" + listing);
+    if (span.active()) {
+        span.attribute("redditor", name);
+        span.attribute("page.after", page.after);
+    }
+    cpr::Parameters parameters = page.after == ""
+        ? cpr::Parameters{{"sort", options.sort}, {"t", options.period}, {"limit", "100"}}
+        : cpr::Parameters{{"sort", options.sort}, {"t", options.period}, {"limit", "100"}, {"after", page.after}};
+    Expected<nlohmann::json> response = redditinstance->_tryrequest("/user/" + name + "/" + listing, parameters, cancellation);
+    if (!response) {
+        return response.error();
+    }
+    nlohmann::json & responsejson = *response;
+    if (!responsejson["data"].is_object()) {
+        throw errors::CommunicationError("Malformed response from server when fetching u/" + name + "'s " + listing + ".");
+    }
+
+    // the last page has null in place of after
+    const nlohmann::json & after = responsejson["data"]["after"];
+    const nlohmann::json & before = responsejson["data"]["before"];
+    page.after = after.is_null() ? "" : after.get<std::string>();
+    page.before = before.is_null() ? "" : before.get<std::string>();
+
+    if constexpr (std::is_same_v<T, Activity>) {
+        std::vector<Activity> items;
+        for (auto & i : responsejson["data"]["children"]) {
+            if (i["kind"] == "t3") {
+                items.emplace_back(std::in_place_type<Post>, i["data"], redditinstance);
+            } else if (i["kind"] == "t1") {
+                items.emplace_back(std::in_place_type<Comment>, i["data"], redditinstance);
+            }
+        }
+        return Expected<std::vector<T>>(std::move(items));
+    } else {
+        std::vector<nlohmann::json *> items;
+        for (auto & i : responsejson["data"]["children"]) {
+            if (i["kind"] == (std::is_same_v<T, Post> ? "t3" : "t1")) {
+                items.push_back(&i["data"]);
+            }
+        }
+        return Expected<std::vector<T>>(redditinstance->_objects<T>(items));
+    }
+}
+
+template <typename T>
+std::vector<T> Redditor::_historypage (const std::string & name,
+                                       Reddit * redditinstance,
+                                       const HistoryOptions & options,
+                                       ListingPage & page,
+                                       const CancellationToken & cancellation) {
+    Expected<std::vector<T>> items = _tryhistorypage<T>(name, redditinstance, options, page, cancellation);
+    if (items.error() == ErrorCode::notfound) {
+        throw errors::NotFoundError("Could not find any user with username " + name + ".");
+    } else if (items.error() == ErrorCode::unauthorised) {
+        throw errors::UnauthorisedError("You aren't allowed to see u/" + name + "'s history.");
+    }
+    return std::move(*items);
+}
+
+template <typename T>
+History<T> Redditor::_history (const HistoryOptions & options, const CancellationToken & cancellation) {
+    std::string name = username;
+    Reddit * redditinstance = _redditinstance;
+    Executor * executor = _redditinstance->execution.enabled ? &_redditinstance->executor() : nullptr;
+    return History<T>([name, redditinstance, options] (ListingPage & page, const CancellationToken & cancellation) {
+        return _historypage<T>(name, redditinstance, options, page, cancellation);
+    }, options.maxpages, executor, cancellation);
+}
+
+History<Post> Redditor::submitted (const HistoryOptions & options, const CancellationToken & cancellation) {
+    return _history<Post>(options, cancellation);
+}
+
+History<Comment> Redditor::comments (const HistoryOptions & options, const CancellationToken & cancellation) {
+    return _history<Comment>(options, cancellation);
+}
+
+History<Activity> Redditor::overview (const HistoryOptions & options, const CancellationToken & cancellation) {
+    return _history<Activity>(options, cancellation);
+}
+
+template <typename T>
+std::map<std::string, Expected<std::vector<T>>> Redditor::_histories (const std::vector<std::string> & usernames,
+                                                                      Reddit * redditinstance,
+                                                                      const HistoryOptions & options,
+                                                                      const CancellationToken & cancellation,
+                                                                      bool throwing) {
+    // where each Redditor's history is up to
+    struct Cursor {
+        size_t index;
+        ListingPage page;
+        size_t pages;
+    };
+    std::deque<Cursor> cursors;
+    for (size_t i = 0; i < usernames.size(); i++) {
+        cursors.push_back(Cursor{i, ListingPage(), 0});
+    }
+    std::vector<std::vector<T>> found(usernames.size());
+    std::vector<ErrorCode> failures(usernames.size(), ErrorCode::none);
+    std::exception_ptr error;
+    std::mutex lock;
+    CancellationToken stopping = cancellation.child();
+    // the workers don't inherit the caller's PriorityScope, so pass it on
+    Priority priority = PriorityScope::current(Priority::background);
+
+    auto work = [&] {
+        PriorityScope scope(priority);
+        while (true) {
+            Cursor cursor;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (cursors.empty() || error != nullptr) {
+                    return;
+                }
+                cursor = std::move(cursors.front());
+                cursors.pop_front();
+            }
+            Expected<std::vector<T>> items = ErrorCode::communication;
+            std::exception_ptr failure;
+            try {
+                items = _tryhistorypage<T>(usernames[cursor.index], redditinstance, options, cursor.page, stopping);
+            } catch (const errors::CancelledError &) {
+                items = ErrorCode::cancelled;
+                failure = std::current_exception();
+            } catch (const errors::CommunicationError &) {
+                failure = std::current_exception();
+            } catch (const nlohmann::json::exception &) {
+                failure = std::current_exception();
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            if (failure != nullptr && throwing) {
+                if (error == nullptr) {
+                    error = failure;
+                }
+                stopping.cancel();
+                return;
+            }
+            if (!items) {
+                // a Redditor who is deleted or hides their history part of the way through keeps what was fetched
+                bool missing = items.error() == ErrorCode::notfound || items.error() == ErrorCode::unauthorised;
+                if (!missing || cursor.pages == 0) {
+                    failures[cursor.index] = items.error();
+                }
+                continue;
+            }
+            cursor.pages++;
+            std::vector<T> & history = found[cursor.index];
+            history.insert(history.end(), std::make_move_iterator(items->begin()), std::make_move_iterator(items->end()));
+            if (cursor.page.after != "" && (options.maxpages == 0 || cursor.pages < options.maxpages)) {
+                // to the back of the line, so the others get their turn first
+                cursors.push_back(std::move(cursor));
+            }
+        }
+    };
+
+    size_t workers = std::min(std::max<size_t>(options.concurrency, 1), usernames.size());
+    Executor & executor = redditinstance->executor();
+    std::vector<std::future<void>> pending;
+    for (size_t i = 1; i < workers; i++) {
+        pending.push_back(executor.submit(work));
+    }
+    // the calling thread does its share
+    if (workers > 0) {
+        work();
+    }
+    for (std::future<void> & future : pending) {
+        executor.wait(future);
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+
+    std::map<std::string, Expected<std::vector<T>>> results;
+    for (size_t i = 0; i < usernames.size(); i++) {
+        if (failures[i] == ErrorCode::none) {
+            results.emplace(usernames[i], std::move(found[i]));
+        } else {
+            results.emplace(usernames[i], failures[i]);
+        }
+    }
+    return results;
+}
+
+template <typename T>
+std::map<std::string, std::vector<T>> Redditor::histories (const std::vector<std::string> & usernames,
+                                                           Reddit * redditinstance,
+                                                           const HistoryOptions & options,
+                                                           const CancellationToken & cancellation) {
+    std::map<std::string, std::vector<T>> results;
+    for (auto & [username, history] : _histories<T>(usernames, redditinstance, options, cancellation, true)) {
+        // anything else would have thrown, so only missing and hidden Redditors are left out
+        if (history) {
+            results.emplace(username, std::move(*history));
+        }
+    }
+    return results;
+}
+
+template <typename T>
+std::map<std::string, Expected<std::vector<T>>> Redditor::tryhistories (const std::vector<std::string> & usernames,
+                                                                        Reddit * redditinstance,
+                                                                        const HistoryOptions & options,
+                                                                        const CancellationToken & cancellation) {
+    return _histories<T>(usernames, redditinstance, options, cancellation, false);
+}
+
+template std::map<std::string, std::vector<Post>> Redditor::histories<Post> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
+template std::map<std::string, std::vector<Comment>> Redditor::histories<Comment> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
+template std::map<std::string, std::vector<Activity>> Redditor::histories<Activity> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
+template std::map<std::string, Expected<std::vector<Post>>> Redditor::tryhistories<Post> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
+template std::map<std::string, Expected<std::vector<Comment>>> Redditor::tryhistories<Comment> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
+template std::map<std::string, Expected<std::vector<Activity>>> Redditor::tryhistories<Activity> (const std::vector<std::string> &, Reddit *, const HistoryOptions &, const CancellationToken &);
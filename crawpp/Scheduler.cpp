@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <string>
+
+#include "crawpp/Scheduler.h"
+
+namespace CRAW {
+
+    /// The priority of the innermost PriorityScope on each thread, or -1 if there is none
+    static thread_local int _priority = -1;
+
+    PriorityScope::PriorityScope (Priority priority) {
+        _previous = _priority;
+        _priority = static_cast<int>(priority);
+    }
+
+    PriorityScope::~PriorityScope () {
+        _priority = _previous;
+    }
+
+    Priority PriorityScope::current (Priority fallback) {
+        return _priority < 0 ? fallback : static_cast<Priority>(_priority);
+    }
+
+    Scheduler::Scheduler () {
+        for (int i = 0; i < 3; i++) {
+            _lastfinish[i] = 0;
+        }
+        _virtualtime = 0;
+        _tokens = 0;
+        _reported = -1;
+        _unreported = 0;
+    }
+
+    Scheduler::Ticket * Scheduler::_next () {
+        Ticket * next = nullptr;
+        for (auto & queue : _queues) {
+            if (!queue.empty() && (next == nullptr || queue.front()->tag < next->tag)) {
+                next = queue.front();
+            }
+        }
+        return next;
+    }
+
+    void Scheduler::_refill (const SchedulerPolicy & policy, std::chrono::steady_clock::time_point now) {
+        if (_refilled == std::chrono::steady_clock::time_point()) {
+            _tokens = policy.burst;
+            _refilled = now;
+        }
+        _tokens = std::min(_tokens + std::chrono::duration<double>(now - _refilled).count() * policy.rate, policy.burst);
+        _refilled = now;
+    }
+
+    void Scheduler::_enqueue (const SchedulerPolicy & policy, Priority priority, Ticket & ticket) {
+        int index = static_cast<int>(priority);
+        ticket.priority = priority;
+        ticket.tag = std::max(_virtualtime, _lastfinish[index]) + 1 / policy.weights[index];
+        ticket.queued = true;
+        _lastfinish[index] = ticket.tag;
+        _queues[index].push_back(&ticket);
+    }
+
+    bool Scheduler::_take (Ticket & ticket, std::chrono::steady_clock::time_point now) {
+        if (_next() != &ticket || _tokens < 1 || now < _blockeduntil) {
+            return false;
+        }
+        _tokens -= 1;
+        _virtualtime = ticket.tag;
+        _queues[static_cast<int>(ticket.priority)].pop_front();
+        ticket.queued = false;
+        // the next waiter may be able to go too
+        _wakeup.notify_all();
+        return true;
+    }
+
+    void Scheduler::_remove (Ticket & ticket) {
+        if (!ticket.queued) {
+            return;
+        }
+        auto & queue = _queues[static_cast<int>(ticket.priority)];
+        queue.erase(std::find(queue.begin(), queue.end(), &ticket));
+        ticket.queued = false;
+        _wakeup.notify_all();
+    }
+
+    void Scheduler::acquire (const SchedulerPolicy & policy, Priority priority, const CancellationToken & cancellation) {
+        std::unique_lock<std::mutex> guard(_lock);
+        Ticket ticket;
+        _refill(policy, std::chrono::steady_clock::now());
+        _enqueue(policy, priority, ticket);
+
+        while (true) {
+            auto now = std::chrono::steady_clock::now();
+            _refill(policy, now);
+            if (_take(ticket, now)) {
+                return;
+            }
+
+            if (cancellation.cancelled()) {
+                _remove(ticket);
+                guard.unlock();
+                cancellation.check();
+            }
+            auto wake = std::chrono::steady_clock::time_point::max();
+            if (_next() == &ticket) {
+                auto refill = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((1 - _tokens) / policy.rate));
+                wake = std::max(refill, _blockeduntil);
+            }
+            if (cancellation.cancellable()) {
+                // cancelling the token doesn't signal this condition variable, so check it every so often
+                wake = std::min(wake, now + std::chrono::milliseconds(20));
+            }
+            if (wake == std::chrono::steady_clock::time_point::max()) {
+                _wakeup.wait(guard);
+            } else {
+                _wakeup.wait_until(guard, wake);
+            }
+        }
+    }
+
+    bool Scheduler::tryacquire (const SchedulerPolicy & policy) {
+        std::lock_guard<std::mutex> guard(_lock);
+        auto now = std::chrono::steady_clock::now();
+        _refill(policy, now);
+        if (_next() != nullptr || _tokens < 1 || now < _blockeduntil) {
+            return false;
+        }
+        _tokens -= 1;
+        return true;
+    }
+
+    std::chrono::milliseconds Scheduler::poll (const SchedulerPolicy & policy, Priority priority, Ticket & ticket) {
+        std::lock_guard<std::mutex> guard(_lock);
+        auto now = std::chrono::steady_clock::now();
+        _refill(policy, now);
+        if (!ticket.queued) {
+            _enqueue(policy, priority, ticket);
+        }
+        if (_take(ticket, now)) {
+            return std::chrono::milliseconds(0);
+        }
+
+        // nothing wakes a caller that polls, so work out when its turn will come at the
+        // soonest: once the tokens for the tickets ahead of it and its own have been earned
+        double ahead = 0;
+        for (auto & queue : _queues) {
+            for (Ticket * waiting : queue) {
+                if (waiting->tag < ticket.tag) {
+                    ahead++;
+                }
+            }
+        }
+        auto turn = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(std::max(ahead + 1 - _tokens, 0.0) / policy.rate));
+        turn = std::max(turn, _blockeduntil);
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(turn - now);
+        return std::max(wait, std::chrono::milliseconds(1));
+    }
+
+    void Scheduler::leave (Ticket & ticket) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _remove(ticket);
+    }
+
+    void Scheduler::observe (const HTTPResponse & response) {
+        auto remaining = response.header.find("X-Ratelimit-Remaining");
+        auto reset = response.header.find("X-Ratelimit-Reset");
+        if (remaining == response.header.end() || reset == response.header.end()) {
+            return;
+        }
+        double left;
+        std::chrono::steady_clock::time_point resets;
+        try {
+            // Reddit sends the remaining requests as a decimal, e.g. "595.0"
+            left = std::stod(remaining->second);
+            resets = std::chrono::steady_clock::now() + std::chrono::seconds(std::stol(reset->second));
+        } catch (const std::exception &) {
+            // ignore headers that can't be read
+            return;
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        _reported = left;
+        _unreported = 0;
+        _resets = resets;
+        if (left < 1) {
+            _blockeduntil = resets;
+        }
+    }
+
+    void Scheduler::sending () {
+        std::lock_guard<std::mutex> guard(_lock);
+        _unreported++;
+    }
+
+    void Scheduler::refund (const SchedulerPolicy & policy, bool scheduled) {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_unreported > 0) {
+                _unreported--;
+            }
+            if (scheduled) {
+                _tokens = std::min(_tokens + 1, policy.burst);
+            }
+        }
+        _wakeup.notify_all();
+    }
+
+    RateLimit Scheduler::ratelimit () {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_reported < 0 || std::chrono::steady_clock::now() >= _resets) {
+            return {-1, std::chrono::steady_clock::time_point()};
+        }
+        return {std::max(_reported - _unreported, 0.0), _resets};
+    }
+
+    size_t Scheduler::queued (Priority priority) {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _queues[static_cast<int>(priority)].size();
+    }
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "crawpp/Checkpoint.h"
+#include "crawpp/SeenFilter.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /// Identifies a file written by SeenFilter::save(), followed by the version of its format
+    static const char _magic [8] = {'C', 'R', 'A', 'W', 'S', 'E', 'E', 'N'};
+    static const uint32_t _version = 1;
+
+    /**
+     * Spread the bits of an id evenly over a 64-bit hash (the finaliser of splitmix64)
+     */
+    static uint64_t _mix (uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    SeenFilter::SeenFilter (const SeenFilterPolicy & policy) {
+        if (policy.capacity == 0) {
+            throw std::invalid_argument("A SeenFilter must hold at least one item");
+        }
+        if (policy.falsepositive <= 0 || policy.falsepositive >= 1) {
+            throw std::invalid_argument("The false positive rate must be between 0 and 1");
+        }
+        _policy = policy;
+        // blocking makes collisions likelier than in a plain Bloom filter, so use half as many bits again
+        double bitsperitem = -std::log(policy.falsepositive) / (std::log(2) * std::log(2)) * 1.5;
+        _blocks = static_cast<size_t>(std::ceil(policy.capacity * bitsperitem / 512));
+        _hashes = static_cast<unsigned>(std::clamp(std::round(-std::log2(policy.falsepositive)), 1.0, 16.0));
+        _allocate();
+    }
+
+    void SeenFilter::_allocate () {
+        for (Window & window : _windows) {
+            window.words = std::make_unique<std::atomic<uint64_t> []>(_blocks * 8);
+            for (size_t i = 0; i < _blocks * 8; i++) {
+                window.words[i].store(0, std::memory_order_relaxed);
+            }
+            window.count = 0;
+            window.started = std::chrono::system_clock::now();
+        }
+        _current = 0;
+    }
+
+    uint64_t SeenFilter::pack (const std::string & fullname) {
+        // "t3_abc123": a type from 1 to 9, then up to 11 base-36 digits, which fit in 59 bits
+        if (fullname.size() >= 4 && fullname.size() <= 14 && fullname[0] == 't' &&
+            fullname[1] >= '1' && fullname[1] <= '9' && fullname[2] == '_') {
+            uint64_t id = 0;
+            bool valid = true;
+            for (size_t i = 3; i < fullname.size() && valid; i++) {
+                char c = fullname[i];
+                if (c >= '0' && c <= '9') {
+                    id = id * 36 + (c - '0');
+                } else if (c >= 'a' && c <= 'z') {
+                    id = id * 36 + (c - 'a' + 10);
+                } else {
+                    valid = false;
+                }
+            }
+            if (valid) {
+                return static_cast<uint64_t>(fullname[1] - '0') << 59 | id;
+            }
+        }
+        // anything else is hashed (FNV-1a), with the top bit set so it can't clash with a packed id
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (char c : fullname) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+        }
+        return hash | 1ULL << 63;
+    }
+
+    bool SeenFilter::_test (const Window & window, uint64_t hash) const {
+        const std::atomic<uint64_t> * block = &window.words[((hash >> 32) * _blocks >> 32) * 8];
+        uint64_t step = _mix(hash) | 1;
+        for (unsigned i = 0; i < _hashes; i++) {
+            unsigned bit = (hash + i * step) & 511;
+            if (!(block[bit / 64].load(std::memory_order_relaxed) & 1ULL << (bit % 64))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SeenFilter::insert (const std::string & fullname) {
+        _rotate();
+        uint64_t hash = _mix(pack(fullname));
+        std::shared_lock<std::shared_mutex> guard(_lock);
+        Window & current = _windows[_current];
+        if (_test(current, hash) || _test(_windows[1 - _current], hash)) {
+            return false;
+        }
+        std::atomic<uint64_t> * block = &current.words[((hash >> 32) * _blocks >> 32) * 8];
+        uint64_t step = _mix(hash) | 1;
+        for (unsigned i = 0; i < _hashes; i++) {
+            unsigned bit = (hash + i * step) & 511;
+            block[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+        }
+        current.count++;
+        return true;
+    }
+
+    bool SeenFilter::contains (const std::string & fullname) const {
+        uint64_t hash = _mix(pack(fullname));
+        std::shared_lock<std::shared_mutex> guard(_lock);
+        return _test(_windows[0], hash) || _test(_windows[1], hash);
+    }
+
+    void SeenFilter::_rotate () {
+        auto now = std::chrono::system_clock::now();
+        {
+            std::shared_lock<std::shared_mutex> guard(_lock);
+            const Window & current = _windows[_current];
+            if (current.count < _policy.capacity && now - current.started < _policy.window) {
+                return;
+            }
+        }
+        std::unique_lock<std::shared_mutex> guard(_lock);
+        const Window & current = _windows[_current];
+        if (current.count < _policy.capacity && now - current.started < _policy.window) {
+            // another thread got here first
+            return;
+        }
+        Window & next = _windows[1 - _current];
+        for (size_t i = 0; i < _blocks * 8; i++) {
+            next.words[i].store(0, std::memory_order_relaxed);
+        }
+        next.count = 0;
+        next.started = now;
+        _current = 1 - _current;
+    }
+
+    size_t SeenFilter::size () const {
+        std::shared_lock<std::shared_mutex> guard(_lock);
+        return _windows[_current].count;
+    }
+
+    size_t SeenFilter::bytes () const {
+        return _blocks * 64 * 2;
+    }
+
+    void SeenFilter::save (const std::string & path) const {
+        std::string contents;
+        auto append = [&contents] (const void * data, size_t size) {
+            contents.append(static_cast<const char *>(data), size);
+        };
+        {
+            // a shared lock is enough, since writers only ever set bits
+            std::shared_lock<std::shared_mutex> guard(_lock);
+            uint64_t header [] = {
+                static_cast<uint64_t>(_policy.capacity),
+                static_cast<uint64_t>(_policy.window.count()),
+                static_cast<uint64_t>(_blocks),
+                _hashes
+            };
+            contents.reserve(sizeof(_magic) + sizeof(_version) + sizeof(_policy.falsepositive) + sizeof(header) + 2 * (16 + _blocks * 64));
+            append(_magic, sizeof(_magic));
+            append(&_version, sizeof(_version));
+            append(&_policy.falsepositive, sizeof(_policy.falsepositive));
+            append(header, sizeof(header));
+            // oldest window first
+            for (int i : {1 - _current, _current}) {
+                const Window & window = _windows[i];
+                uint64_t count = window.count;
+                int64_t started = std::chrono::duration_cast<std::chrono::seconds>(window.started.time_since_epoch()).count();
+                append(&count, sizeof(count));
+                append(&started, sizeof(started));
+                for (size_t word = 0; word < _blocks * 8; word++) {
+                    uint64_t bits = window.words[word].load(std::memory_order_relaxed);
+                    append(&bits, sizeof(bits));
+                }
+            }
+        }
+        writeatomically(path, contents);
+    }
+
+    std::shared_ptr<SeenFilter> SeenFilter::load (const std::string & path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw errors::FileOperationError("Could not read the seen filter in \"" + path + "\".");
+        }
+        char magic [sizeof(_magic)];
+        uint32_t version = 0;
+        SeenFilterPolicy policy;
+        uint64_t header [4];
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(&version), sizeof(version));
+        file.read(reinterpret_cast<char *>(&policy.falsepositive), sizeof(policy.falsepositive));
+        file.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!file || std::memcmp(magic, _magic, sizeof(_magic)) != 0 || version != _version) {
+            throw errors::FileOperationError("\"" + path + "\" is not a saved seen filter.");
+        }
+        policy.capacity = header[0];
+        policy.window = std::chrono::seconds(header[1]);
+        auto filter = std::make_shared<SeenFilter>(policy);
+        if (filter->_blocks != header[2] || filter->_hashes != header[3]) {
+            throw errors::FileOperationError("\"" + path + "\" was saved by an incompatible version of the seen filter.");
+        }
+        for (Window & window : filter->_windows) {
+            uint64_t count = 0;
+            int64_t started = 0;
+            file.read(reinterpret_cast<char *>(&count), sizeof(count));
+            file.read(reinterpret_cast<char *>(&started), sizeof(started));
+            std::vector<uint64_t> bits(filter->_blocks * 8);
+            file.read(reinterpret_cast<char *>(bits.data()), bits.size() * sizeof(uint64_t));
+            for (size_t word = 0; word < bits.size(); word++) {
+                window.words[word].store(bits[word], std::memory_order_relaxed);
+            }
+            window.count = count;
+            window.started = std::chrono::system_clock::time_point(std::chrono::seconds(started));
+        }
+        if (!file) {
+            throw errors::FileOperationError("\"" + path + "\" is not a saved seen filter.");
+        }
+        // the windows were saved oldest first
+        filter->_current = 1;
+        return filter;
+    }
+}
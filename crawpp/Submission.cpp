@@ -17,8 +17,43 @@ namespace CRAW {
         body["return_rtjson"] = true;
         body["text"] = contents;
         body["thing_id"] = fullname;
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/comment", body.dump());
-        return Comment(response, _redditinstance);
+        Comment comment = Comment(response, _redditinstance);
+        if (distinguish) {
+            _redditinstance->_sendrequest("POST", "/api/distinguish", _distinguishbody(comment));
+        }
+        return comment;
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<Comment> Submission::reply_co (std::string contents, bool distinguish) {
+        if (!_redditinstance->authenticated) {
+            throw errors::NotLoggedInError("You must be logged in to leave a reply.");
+        }
+        nlohmann::json body = {};
+        body["return_rtjson"] = true;
+        body["text"] = contents;
+        body["thing_id"] = fullname;
+        // the same priority as reply() gives it. It is passed rather than set with a
+        // PriorityScope, which would be undone on whichever thread the coroutine ends on.
+        Priority priority = PriorityScope::current(Priority::interactive);
+        nlohmann::json response = co_await _redditinstance->_sendrequestco("POST", "/api/comment", body.dump(),
+                                                                           CancellationToken::none(), priority);
+        Comment comment = Comment(response, _redditinstance);
+        if (distinguish) {
+            co_await _redditinstance->_sendrequestco("POST", "/api/distinguish", _distinguishbody(comment),
+                                                     CancellationToken::none(), priority);
+        }
+        co_return comment;
+    }
+#endif
+
+    std::string Submission::_distinguishbody (const Submission & reply) {
+        nlohmann::json body = {};
+        body["id"] = reply.fullname;
+        body["how"] = "yes";
+        return body.dump();
     }
 
     Subreddit Submission::subreddit () {
@@ -32,6 +67,7 @@ namespace CRAW {
         nlohmann::json body = {};
         body["id"] = fullname;
         body["spam"] = spam;
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         _redditinstance->_sendrequest("POST", "/api/remove", body.dump());
     }
 
@@ -52,6 +88,7 @@ namespace CRAW {
         body["id"] = fullname;
         body["return_rtjson"] = true;
         body["text"] = newcontents;
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/editusertext", body.dump());
         if (response["code"] == 500) {
             // e.g. editing an image post
@@ -12,7 +12,10 @@
 
 namespace CRAW {
 
-    std::string Subreddit::_upload (const std::string & mediapath, const std::string & caption) {
+    std::string Subreddit::_upload (const std::string & mediapath, const std::string & caption,
+                                    const CancellationToken & cancellation) {
+        ScopedSpan span(_redditinstance->tracer, "Subreddit::_upload");
+        span.attribute("file", mediapath);
         std::string mimetype;
         // gets the filename extension
         try {
@@ -39,11 +42,26 @@ namespace CRAW {
 
         nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/media/asset.json", 
                                                                 cpr::Payload{{"filepath", mediapath}, 
-                                                                             {"mimetype", mimetype}});
+                                                                             {"mimetype", mimetype}},
+                                                                {}, cancellation);
         std::string uploadurl = "http:" + response["args"]["action"].get<std::string>();
         const nlohmann::json & fields = response["args"]["fields"];
 
-        nlohmann::json uploaded = cpr::Post(cpr::Url(uploadurl),
+        ScopedSpan uploadspan(_redditinstance->tracer, "POST " + uploadurl);
+        const Timeout & timeout = _redditinstance->timeouts.upload;
+        std::chrono::milliseconds total = timeout.total;
+        if (cancellation.remaining() != std::chrono::milliseconds::max()) {
+            std::chrono::milliseconds remaining = std::max(cancellation.remaining(), std::chrono::milliseconds(1));
+            total = total.count() == 0 ? remaining : std::min(total, remaining);
+        }
+        cpr::Response uploaded = cpr::Post(cpr::Url(uploadurl),
+                                            cpr::ConnectTimeout{timeout.connect},
+                                            cpr::Timeout{total},
+                                            cpr::ProgressCallback{
+                                                [&cancellation](cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t, intptr_t) {
+                                                    return !cancellation.cancelled();
+                                                }
+                                            },
                                             cpr::Multipart {
                                                 {"acl", "private"},
                                                 {"key", fields[1]["value"].get<std::string>()},
@@ -59,108 +77,326 @@ namespace CRAW {
                                                 {"x-amz-security-token", fields[11]["value"].get<std::string>()},
                                                 {"file", cpr::File(mediapath)}
                                             }
-                                           ).text;
+                                           );
+        if (uploaded.status_code == 0) {
+            cancellation.check();
+            throw errors::CommunicationError("Could not upload " + mediapath + ": " + uploaded.error.message);
+        }
         std::string imageurl = uploadurl + "/" + fields[1]["value"].get<std::string>();
         return imageurl;
     }
 
+    void Subreddit::_init (const nlohmann::json & data) {
+        information = data;
+        name = data["display_name"];
+        fullname = data["name"];
+        if (!data.contains("user_is_banned") || data["user_is_banned"].is_null()) {
+            banned = false;
+        } else {
+            banned = data["user_is_banned"];
+        }
+        postingrestricted = data["restrict_posting"];
+        quarantined = data["quarantine"];
+        language = data["lang"];
+        created = static_cast<time_t>(data["created"]);
+        // these are null in some listings, such as /api/info
+        subscribers = data["subscribers"].is_number() ? data["subscribers"].get<int>() : 0;
+        activeusers = data["active_user_count"].is_number() ? data["active_user_count"].get<int>() : 0;
+    }
+
     Subreddit::Subreddit (const std::string & subredditname, Reddit * redditinstance) {
+        nlohmann::json responsejson;
         try {
-            information = redditinstance->_sendrequest("GET", "/r/" + subredditname + "/about")["data"];
+            responsejson = redditinstance->_sendrequest("GET", "/r/" + subredditname + "/about")["data"];
         } catch (errors::NotFoundError &) {
             throw errors::NotFoundError("Could not find a subreddit with name r/" + subredditname);
         } catch (errors::UnauthorisedError &) {
             throw errors::UnauthorisedError("You aren't allowed to access r/" + subredditname);
         }
 
-        if (!information["children"].is_null()) {
+        _checkabout(subredditname, responsejson);
+        _redditinstance = redditinstance;
+        _init(responsejson);
+    }
+
+    void Subreddit::_checkabout (const std::string & subredditname, const nlohmann::json & about) {
+        if (about.contains("children")) {
             // the listing having "children" means it's actually a search listing
             // and there isn't a subreddit with that exact name
             std::string similars = "";
-            for (auto & i : information["children"]) {
+            for (auto & i : about["children"]) {
                 similars += " ";
                 similars += i["data"]["display_name"];
             }
             throw errors::NotFoundError("No subreddit named \"" + subredditname + "\" exists. Did you mean any of these?" + similars);
         }
+    }
+
+    Subreddit::Subreddit (nlohmann::json & data, Reddit * redditinstance) {
         _redditinstance = redditinstance;
-        name = information["display_name"];
-        fullname = information["name"];
-        if (information["user_is_banned"].is_null()) {
-            banned = false;
-        } else {
-            banned = information["user_is_banned"];
-        }
-        postingrestricted = information["restrict_posting"];
-        quarantined = information["quarantine"];
-        language = information["lang"];
-        created = static_cast<time_t>(information["created"]);
-        subscribers = information["subscribers"];
-        activeusers = information["active_user_count"];
+        _init(data);
     }
 
     std::string Subreddit::operator[] (const std::string & attribute) {
-        nlohmann::json value = information[attribute];
-        if (value.is_null()) {
+        auto value = information.find(attribute);
+        if (value == information.end() || value->is_null()) {
             throw std::invalid_argument("Attribute " + attribute + " doesn't exist.");
         }
-        return value.dump();
+        return value->dump();
     }
 
-    std::vector<Post> Subreddit::posts (const std::string & sort,
-                                        const std::string & period,
-                                        const int limit,
-                                        ListingPage * listingpage,
-                                        const std::string & direction) {
-        if (limit < 0 || limit > 100) {
-            throw std::invalid_argument("limit must be a number in [0, 100], not " + std::to_string(limit));
+    /**
+     * Find the Sort with the given path fragment
+     */
+    static bool _parsesort (const std::string & text, Sort & sort) {
+        for (Sort candidate : {Sort::hot, Sort::newest, Sort::rising, Sort::top, Sort::controversial}) {
+            if (text == fragment(candidate)) {
+                sort = candidate;
+                return true;
+            }
         }
+        return false;
+    }
+
+    /**
+     * Find the Period with the given name
+     */
+    static bool _parseperiod (const std::string & text, Period & period) {
+        for (Period candidate : {Period::hour, Period::day, Period::week, Period::month, Period::year, Period::all}) {
+            if (text == fragment(candidate)) {
+                period = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ListingRequest Subreddit::_parselisting (const std::string & sort,
+                                             const std::string & period,
+                                             const int limit,
+                                             const ListingPage * listingpage,
+                                             const std::string & direction,
+                                             Direction & parseddirection) const {
         if (listingpage != nullptr && direction != "after" && direction != "before") {
             throw std::invalid_argument("The direction must be either \"after\" or \"before\", not " + direction);
         }
-        if (sort != "hot" &&
-            sort != "rising" &&
-            sort != "top" &&
-            sort != "controversial" &&
-            sort != "new") {
-                throw std::invalid_argument("Invalid sort type: " + sort);
-        } else if ((sort == "top" || sort == "controversial") 
-                    && ( period != "hour" &&
-                    period != "day" &&
-                    period != "week" &&
-                    period != "month" &&
-                    period != "year" &&
-                    period != "all")) {
-                        throw std::invalid_argument("Sorting by " + sort + " requires a valid period.");
+        parseddirection = direction == "before" ? Direction::before : Direction::after;
+        Sort parsedsort;
+        if (!_parsesort(sort, parsedsort)) {
+            throw std::invalid_argument("Invalid sort type: " + sort);
         }
-        nlohmann::json responsejson;
-        try {
-            cpr::Parameters parameters = {};
-            if (listingpage != nullptr) {
-                parameters = direction == "after" ? cpr::Parameters{{"after", listingpage->after}} : cpr::Parameters{{"before", listingpage->before}};
-            }
-            responsejson = _redditinstance->_sendrequest("GET", "/r/" + name + "/" + sort, {}, parameters);
-        } catch (errors::UnauthorisedError &) {
-            throw errors::UnauthorisedError("You don't have permission to look at r/" + name + " posts.");
+        Period parsedperiod = Period::all;
+        if (!_parseperiod(period, parsedperiod) && periodic(parsedsort)) {
+            throw std::invalid_argument("Sorting by " + sort + " requires a valid period.");
+        }
+        return listing(parsedsort, parsedperiod, limit);
+    }
+
+    /**
+     * Whether a listing's limit has to be sent. Reddit's default is left out, so that the
+     * first pages of listings have the same URLs as the recordings in the fixtures.
+     */
+    static bool _sendslimit (int limit) {
+        return limit != 0 && limit != 25;
+    }
+
+    ListingRequest Subreddit::listing (Sort sort, Period period, int limit) const {
+        if (limit < 0 || limit > 100) {
+            throw std::invalid_argument("limit must be a number in [0, 100], not " + std::to_string(limit));
         }
+        ListingRequest request;
+        request.sort = sort;
+        request.period = period;
+        request.limit = limit;
+        request.url = "/r/" + name + "/";
+        request.url += fragment(sort);
+        char separator = '?';
+        if (_sendslimit(limit)) {
+            request.url += "?limit=" + std::to_string(limit);
+            separator = '&';
+        }
+        if (periodic(sort)) {
+            request.url += separator;
+            request.url += "t=";
+            request.url += fragment(period);
+        }
+        return request;
+    }
+
+    const std::string & Subreddit::_listingurl (const ListingRequest & request,
+                                                const ListingPage * listingpage,
+                                                Direction direction,
+                                                std::string & buffer) {
+        if (listingpage == nullptr) {
+            return request.url;
+        }
+        const std::string & cursor = direction == Direction::after ? listingpage->after : listingpage->before;
+        if (cursor == "") {
+            return request.url;
+        }
+        buffer.reserve(request.url.size() + cursor.size() + 8);
+        buffer = request.url;
+        buffer += _sendslimit(request.limit) || periodic(request.sort) ? '&' : '?';
+        buffer += fragment(direction);
+        buffer += '=';
+        buffer += cursor;
+        return buffer;
+    }
+
+    std::vector<Post> Subreddit::_listingposts (nlohmann::json & responsejson, ListingPage * listingpage) {
         if (responsejson.is_null()) {
             throw errors::CommunicationError("Malformed response from server when fetching r/" + name + " posts.");
         }
 
         if (listingpage != nullptr) {
-            listingpage->after = responsejson["data"]["after"];
-            listingpage->before = responsejson["data"]["before"];
+            // the first and last pages have null in place of before and after respectively
+            const nlohmann::json & after = responsejson["data"]["after"];
+            const nlohmann::json & before = responsejson["data"]["before"];
+            listingpage->after = after.is_null() ? "" : after.get<std::string>();
+            listingpage->before = before.is_null() ? "" : before.get<std::string>();
         }
 
-        std::vector<Post> postvector = {};
-
+        std::vector<nlohmann::json *> items;
         for (auto & i : responsejson["data"]["children"]) {
-            postvector.emplace_back(Post(i["data"], _redditinstance));
+            items.push_back(&i["data"]);
+        }
+        return _redditinstance->_objects<Post>(items);
+    }
+
+    std::vector<Post> Subreddit::posts (const std::string & sort,
+                                        const std::string & period,
+                                        const int limit,
+                                        ListingPage * listingpage,
+                                        const std::string & direction,
+                                        const CancellationToken & cancellation) {
+        Direction parseddirection;
+        ListingRequest request = _parselisting(sort, period, limit, listingpage, direction, parseddirection);
+        return posts(request, listingpage, parseddirection, cancellation);
+    }
+
+    std::vector<Post> Subreddit::posts (const ListingRequest & request,
+                                        ListingPage * listingpage,
+                                        Direction direction,
+                                        const CancellationToken & cancellation) {
+        ScopedSpan span(_redditinstance->tracer, "Subreddit::posts");
+        if (span.active()) {
+            span.attribute("subreddit", name);
+            span.attribute("sort", std::string(fragment(request.sort)));
+            if (listingpage != nullptr) {
+                span.attribute("page." + std::string(fragment(direction)), direction == Direction::after ? listingpage->after : listingpage->before);
+            }
+        }
+        std::string buffer;
+        nlohmann::json responsejson;
+        try {
+            responsejson = _redditinstance->_sendrequest("GET", _listingurl(request, listingpage, direction, buffer), "", cancellation);
+        } catch (errors::UnauthorisedError &) {
+            throw errors::UnauthorisedError("You don't have permission to look at r/" + name + " posts.");
+        }
+        return _listingposts(responsejson, listingpage);
+    }
+
+    Stream<Post> Subreddit::stream (bool skipexisting) {
+        Subreddit subreddit = *this;
+        // built once, since the same listing is polled for as long as the stream runs
+        ListingRequest newest = listing(Sort::newest, Period::all, 100);
+        Stream<Post> stream([subreddit, newest] (const CancellationToken & cancellation) mutable {
+            return subreddit.posts(newest, nullptr, Direction::after, cancellation);
+        }, skipexisting, [subreddit, newest] (ListingPage & page, const CancellationToken & cancellation) mutable {
+            return subreddit.posts(newest, &page, Direction::after, cancellation);
+        });
+        if (_redditinstance->execution.enabled) {
+            stream.executor = &_redditinstance->executor();
+        }
+        stream.metrics = &_redditinstance->metrics;
+        // a Post keeps the whole of its listing data, so it can be rebuilt without fetching it again
+        stream.encode = [] (const Post & post) {
+            return post.information.dump();
+        };
+        stream.decode = [reddit = _redditinstance] (const std::string & line) {
+            nlohmann::json data = nlohmann::json::parse(line);
+            return Post(data, reddit);
+        };
+        return stream;
+    }
+
+#ifdef CRAW_COROUTINES
+    Task<std::vector<Post>> Subreddit::posts_co (std::string sort,
+                                                 std::string period,
+                                                 int limit,
+                                                 ListingPage * listingpage,
+                                                 std::string direction,
+                                                 CancellationToken cancellation) {
+        Direction parseddirection;
+        ListingRequest request = _parselisting(sort, period, limit, listingpage, direction, parseddirection);
+        co_return co_await posts_co(std::move(request), listingpage, parseddirection, std::move(cancellation));
+    }
+
+    Task<std::vector<Post>> Subreddit::posts_co (ListingRequest request,
+                                                 ListingPage * listingpage,
+                                                 Direction direction,
+                                                 CancellationToken cancellation) {
+        std::string buffer;
+        std::string targeturl = _listingurl(request, listingpage, direction, buffer);
+        nlohmann::json responsejson;
+        try {
+            responsejson = co_await _redditinstance->_sendrequestco("GET", targeturl, "", cancellation);
+        } catch (errors::UnauthorisedError &) {
+            throw errors::UnauthorisedError("You don't have permission to look at r/" + name + " posts.");
         }
-        return postvector;
+        co_return _listingposts(responsejson, listingpage);
+    }
 
+    AsyncGenerator<Post> Subreddit::posts_all_co (std::string sort, std::string period, CancellationToken cancellation) {
+        ListingPage page;
+        Direction direction;
+        ListingRequest request = _parselisting(sort, period, 100, &page, "after", direction);
+        do {
+            std::vector<Post> posts = co_await posts_co(request, &page, direction, cancellation);
+            for (Post & post : posts) {
+                co_yield std::move(post);
+            }
+        } while (page.after != "");
+    }
 
+    AsyncGenerator<Post> Subreddit::stream_co (bool skipexisting,
+                                               CancellationToken cancellation,
+                                               std::shared_ptr<SeenFilter> seenfilter) {
+        // polls the same way as a Stream with the default settings
+        const std::chrono::milliseconds interval = std::chrono::seconds(1);
+        const std::chrono::milliseconds maxinterval = std::chrono::seconds(16);
+        ListingRequest newest = listing(Sort::newest, Period::all, 100);
+        SeenSet seen;
+        seen.filter = seenfilter;
+        std::chrono::milliseconds wait(0);
+        bool skip = skipexisting;
+        while (true) {
+            co_await DelayAwaiter(*_redditinstance->_transport, _redditinstance->_executor, _redditinstance->execution, wait, cancellation);
+            if (cancellation.cancelled()) {
+                co_return;
+            }
+            std::vector<Post> posts;
+            try {
+                posts = co_await posts_co(newest, nullptr, Direction::after, cancellation);
+            } catch (const errors::CancelledError &) {
+                co_return;
+            }
+            bool found = false;
+            // the listing is newest first
+            for (auto post = posts.rbegin(); post != posts.rend(); post++) {
+                if (!seen.insert(post->fullname, 1000)) {
+                    continue;
+                }
+                found = true;
+                if (!skip) {
+                    co_yield std::move(*post);
+                }
+            }
+            skip = false;
+            wait = found ? interval : std::min(std::max(wait * 2, interval), maxinterval);
+        }
     }
+#endif
 
 
 
@@ -168,6 +404,9 @@ namespace CRAW {
                           const std::string & contents,
                           const std::string & type,
                           const PostOptions & options) {
+        ScopedSpan span(_redditinstance->tracer, "Subreddit::post");
+        span.attribute("subreddit", name);
+        span.attribute("type", type);
         if (type != "text" && type != "link") {
             throw std::invalid_argument("Post type must be \"text\" or \"link\", not " + type + ". To make a media post, use postmedia().");
         }
@@ -247,7 +486,11 @@ namespace CRAW {
     void Subreddit::postmedia (const std::string & title,
                                const std::string & contents,
                                const std::string & type,
-                               const PostOptions & options) {
+                               const PostOptions & options,
+                               const CancellationToken & cancellation) {
+        ScopedSpan span(_redditinstance->tracer, "Subreddit::postmedia");
+        span.attribute("subreddit", name);
+        span.attribute("type", type);
         if (!_redditinstance->authenticated) {
             throw errors::NotLoggedInError("You must be logged in to make a post.");
         }
@@ -291,16 +534,16 @@ namespace CRAW {
 
         if (type == "image") {
             payload.Add({"kind", "image"});
-            payload.Add({"url", _upload(contents)});
+            payload.Add({"url", _upload(contents, "", cancellation)});
         } else if (type == "video") {
             payload.Add({"kind", "video"});
-            payload.Add({"url", _upload(contents)});
-            payload.Add({"video_poster_url", _upload("./blank.png")});
+            payload.Add({"url", _upload(contents, "", cancellation)});
+            payload.Add({"video_poster_url", _upload("./blank.png", "", cancellation)});
         } else {
             throw std::invalid_argument("Post type must be \"image\" or \"video\", not " + type + ". To make a text post, use post().");
         }
 
-        nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/submit", payload);
+        nlohmann::json response = _redditinstance->_sendrequest("POST", "/api/submit", payload, {}, cancellation);
         if (!response["status"].is_null()) {
             throw errors::CommunicationError("The server gave a malformed response while attempting to make a post.");
         }
@@ -367,6 +610,7 @@ namespace CRAW {
         if (length > 999 || length < 0) {
             throw errors::BanDurationError("A user can only be banned for either 0 (permanent) or up to 999 days.");
         }
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         cpr::Payload payload = {{"api_type", "json"}, 
                                 {"ban_reason", reason},
                                 {"ban_message", message},
@@ -392,6 +636,7 @@ namespace CRAW {
         if (!_redditinstance->authenticated) {
             throw errors::NotLoggedInError("You must be logged in to unban a user from a subreddit.");
         }
+        PriorityScope scope(PriorityScope::current(Priority::interactive));
         std::string subject = fullname;
         if (fullname == "") {
             subject = _redditinstance->redditor(username).fullname;
@@ -0,0 +1,63 @@
+#include <atomic>
+#include <exception>
+
+#include "crawpp/Tracing.h"
+
+namespace CRAW {
+
+    /// The innermost open span on each thread
+    static thread_local Span * _current = nullptr;
+
+    /// The ID of the next span to start
+    static std::atomic<uint64_t> _nextid {1};
+
+    Span * Tracer::current () {
+        return _current;
+    }
+
+    ScopedSpan::ScopedSpan (Tracer & tracer, const std::string & name, bool nested) {
+        _tracer = tracer.enabled() ? &tracer : nullptr;
+        _previous = nullptr;
+        _exceptions = 0;
+        _nested = nested;
+        if (_tracer == nullptr) {
+            return;
+        }
+        _span.id = _nextid.fetch_add(1, std::memory_order_relaxed);
+        _span.parent = _current == nullptr ? 0 : _current->id;
+        _span.name = name;
+        _exceptions = std::uncaught_exceptions();
+        if (_nested) {
+            _previous = _current;
+            _current = &_span;
+        }
+        _span.start = std::chrono::steady_clock::now();
+        if (_tracer->onbegin) {
+            _tracer->onbegin(_span);
+        }
+    }
+
+    ScopedSpan::~ScopedSpan () {
+        if (_tracer == nullptr) {
+            return;
+        }
+        _span.end = std::chrono::steady_clock::now();
+        _span.failed = std::uncaught_exceptions() > _exceptions;
+        if (_nested) {
+            _current = _previous;
+        }
+        if (_tracer->onend) {
+            _tracer->onend(_span);
+        }
+    }
+
+    void ScopedSpan::attribute (const std::string & name, const std::string & value) {
+        if (_tracer != nullptr) {
+            _span.attributes[name] = value;
+        }
+    }
+
+    void ScopedSpan::timings (const HTTPTimings & timings) {
+        _span.timings = timings;
+    }
+}
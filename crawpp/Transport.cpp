@@ -0,0 +1,618 @@
+#include <cpr/cpr.h>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <future>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "crawpp/Transport.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /**
+     * The value of the Accept-Encoding header: every encoding that this build of curl
+     * can decode, since it decompresses responses as they are received
+     */
+    static const std::string & _acceptencoding () {
+        static const std::string encodings = [] {
+            std::string encodings = "gzip, deflate";
+            const curl_version_info_data * curl = curl_version_info(CURLVERSION_NOW);
+            if (curl->features & CURL_VERSION_BROTLI) {
+                encodings += ", br";
+            }
+            if (curl->features & CURL_VERSION_ZSTD) {
+                encodings += ", zstd";
+            }
+            return encodings;
+        }();
+        return encodings;
+    }
+
+    /**
+     * Fill in what curl knows about a finished transfer: how long each phase took,
+     * the HTTP version, and whether a new connection was needed
+     */
+    static void _transferinfo (CURL * handle, HTTPResponse & result) {
+        // curl gives the time from the start of the request to the end of each phase
+        curl_off_t namelookup = 0, connect = 0, appconnect = 0, pretransfer = 0, starttransfer = 0, total = 0;
+        curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+        curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+        curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+        result.timings.dns = namelookup / 1e6;
+        result.timings.connect = std::max<curl_off_t>(connect - namelookup, 0) / 1e6;
+        result.timings.tls = appconnect == 0 ? 0 : std::max<curl_off_t>(appconnect - connect, 0) / 1e6;
+        result.timings.wait = std::max<curl_off_t>(starttransfer - pretransfer, 0) / 1e6;
+        result.timings.transfer = std::max<curl_off_t>(total - starttransfer, 0) / 1e6;
+
+        long version = 0;
+        curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+        switch (version) {
+            case CURL_HTTP_VERSION_1_0:
+                result.httpversion = "HTTP/1.0";
+                break;
+            case CURL_HTTP_VERSION_1_1:
+                result.httpversion = "HTTP/1.1";
+                break;
+            case CURL_HTTP_VERSION_2_0:
+                result.httpversion = "HTTP/2";
+                break;
+            case CURL_HTTP_VERSION_3:
+                result.httpversion = "HTTP/3";
+                break;
+        }
+        curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &result.newconnections);
+    }
+
+    CPRTransport::CPRTransport (const std::string & host) {
+        this->host = host;
+        this->compression = true;
+    }
+
+    HTTPResponse CPRTransport::send (const HTTPRequest & request) {
+        cpr::Session session;
+        session.SetUrl(cpr::Url{(host == "" ? request.host : host) + request.path});
+        session.SetHeader(request.header);
+        // this might otherwise default to TLS 1.0. TLS 1.2+ is more secure
+        session.SetSslOptions(cpr::Ssl(cpr::ssl::TLSv1_2()));
+        if (compression) {
+            session.SetAcceptEncoding(cpr::AcceptEncoding{{_acceptencoding()}});
+        } else {
+            session.SetAcceptEncoding(cpr::AcceptEncoding{cpr::AcceptEncodingMethods::identity});
+        }
+        if (request.connecttimeout.count() > 0) {
+            session.SetConnectTimeout(cpr::ConnectTimeout{request.connecttimeout});
+        }
+        if (request.timeout.count() > 0) {
+            session.SetTimeout(cpr::Timeout{request.timeout});
+        }
+        if (request.cancellation.cancellable()) {
+            // returning false from the progress callback aborts the transfer
+            const CancellationToken & cancellation = request.cancellation;
+            session.SetProgressCallback(cpr::ProgressCallback{
+                [&cancellation](cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t, intptr_t) {
+                    return !cancellation.cancelled();
+                }
+            });
+        }
+
+        cpr::Response response;
+        if (request.method == "GET") {
+            response = session.Get();
+        } else if (request.method == "POST") {
+            session.SetBody(cpr::Body{request.body});
+            response = session.Post();
+        } else if (request.method == "PUT") {
+            session.SetBody(cpr::Body{request.body});
+            response = session.Put();
+        } else if (request.method == "DELETE") {
+            response = session.Delete();
+        } else {
+            throw std::invalid_argument(request.method + " is not a recognised HTTP method.");
+        }
+
+        HTTPResponse result;
+        result.status_code = response.status_code;
+        result.header = response.header;
+        result.text = std::move(response.text);
+        result.elapsed = response.elapsed;
+        result.wirebytes = response.downloaded_bytes;
+        if (response.error) {
+            result.error = response.error.message;
+        }
+
+        _transferinfo(session.GetCurlHolder()->handle, result);
+        return result;
+    }
+
+    /**
+     * Hash a request key into a file name. FNV-1a is used rather than std::hash
+     * so that the names are the same on every platform.
+     */
+    static std::string _recordingname (const std::string & key) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : key) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        char name [24];
+        snprintf(name, sizeof(name), "%016llx.json", static_cast<unsigned long long>(hash));
+        return name;
+    }
+
+    /// Stands in for the credentials and tokens that aren't saved in recordings
+    static const std::string _redacted = "[redacted]";
+
+    /**
+     * Whether a request is for an access token, whose body holds the account's password
+     */
+    static bool _istokenrequest (const HTTPRequest & request) {
+        return request.path == "/api/v1/access_token";
+    }
+
+    RecordingTransport::RecordingTransport (const std::string & directory, std::shared_ptr<Transport> inner) {
+        _inner = inner == nullptr ? std::make_shared<CPRTransport>() : inner;
+        _directory = directory;
+        try {
+            std::filesystem::create_directories(directory);
+        } catch (const std::filesystem::filesystem_error &) {
+            throw errors::FileOperationError("Could not create the recording directory \"" + directory + "\".");
+        }
+    }
+
+    HTTPResponse RecordingTransport::send (const HTTPRequest & request) {
+        HTTPResponse response = _inner->send(request);
+        bool tokenrequest = _istokenrequest(request);
+
+        nlohmann::json recording;
+        recording["method"] = request.method;
+        recording["path"] = request.path;
+        // the body of a token request has the username and password in it
+        recording["body"] = tokenrequest ? _redacted : request.body;
+        recording["status"] = response.status_code;
+        recording["header"] = nlohmann::json::object();
+        for (auto & [name, value] : response.header) {
+            recording["header"][name] = value;
+        }
+        // store JSON responses as JSON so that the recordings can be read (and edited) by a human
+        nlohmann::json parsed = nlohmann::json::parse(response.text, nullptr, false);
+        if (parsed.is_object() || parsed.is_array()) {
+            if (tokenrequest && parsed.is_object()) {
+                for (const char * secret : {"access_token", "refresh_token"}) {
+                    if (parsed.contains(secret)) {
+                        parsed[secret] = _redacted;
+                    }
+                }
+            }
+            recording["response"] = parsed;
+        } else {
+            recording["response"] = tokenrequest ? _redacted : response.text;
+        }
+
+        HTTPRequest saved = request;
+        saved.body = recording["body"].get<std::string>();
+        std::lock_guard<std::mutex> guard(_lock);
+        std::ofstream file(_directory + "/" + _recordingname(saved.key()));
+        if (!file) {
+            throw errors::FileOperationError("Could not write a recording to \"" + _directory + "\".");
+        }
+        file << recording.dump(4) << std::endl;
+        return response;
+    }
+
+    ReplayTransport::ReplayTransport (const std::string & directory, std::chrono::microseconds latency) {
+        this->latency = latency;
+        load(directory);
+    }
+
+    void ReplayTransport::load (const std::string & directory) {
+        if (!std::filesystem::is_directory(directory)) {
+            throw errors::FileOperationError("\"" + directory + "\" is not a directory of recordings.");
+        }
+        for (auto & entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() != ".json") {
+                continue;
+            }
+            std::ifstream file(entry.path());
+            nlohmann::json recording = nlohmann::json::parse(file, nullptr, false);
+            if (recording.is_discarded() || !recording.contains("path")) {
+                throw errors::FileOperationError("\"" + entry.path().string() + "\" is not a valid recording.");
+            }
+
+            HTTPRequest request;
+            request.method = recording.value("method", "GET");
+            request.path = recording["path"].get<std::string>();
+            request.body = recording.value("body", "");
+
+            HTTPResponse response;
+            response.status_code = recording.value("status", 200);
+            if (recording.contains("header")) {
+                for (auto & [name, value] : recording["header"].items()) {
+                    response.header[name] = value.get<std::string>();
+                }
+            }
+            const nlohmann::json & body = recording["response"];
+            response.text = body.is_string() ? body.get<std::string>() : body.dump();
+            add(request.key(), response);
+        }
+    }
+
+    void ReplayTransport::add (const std::string & key, const HTTPResponse & response) {
+        _responses[key] = response;
+    }
+
+    HTTPResponse ReplayTransport::send (const HTTPRequest & request) {
+        if (latency.count() > 0) {
+            std::this_thread::sleep_for(latency);
+        }
+        auto recording = _responses.find(request.key());
+        if (recording == _responses.end() && _istokenrequest(request)) {
+            // recordings of token requests don't have the credentials in them
+            HTTPRequest redacted = request;
+            redacted.body = _redacted;
+            recording = _responses.find(redacted.key());
+        }
+        if (recording == _responses.end()) {
+            HTTPResponse notfound;
+            notfound.status_code = 404;
+            notfound.text = "{\"message\": \"Not Found\", \"error\": 404}";
+            return notfound;
+        }
+        HTTPResponse response = recording->second;
+        response.elapsed = std::chrono::duration<double>(latency).count();
+        return response;
+    }
+
+    struct MultiplexTransport::Pending {
+        /// A copy of the request, since the caller may not wait for it to finish
+        HTTPRequest request;
+        HTTPResponse response;
+        CURL * handle;
+        curl_slist * headers;
+        char error [CURL_ERROR_SIZE];
+
+        /// Called by the background thread when the response is complete
+        Callback done;
+
+        Pending (const HTTPRequest & request, Callback done) : request(request), done(std::move(done)) {
+            handle = curl_easy_init();
+            headers = nullptr;
+            error[0] = '\0';
+        }
+
+        ~Pending () {
+            // the background thread cleans up the handle once it has been handed over
+            curl_easy_cleanup(handle);
+            curl_slist_free_all(headers);
+        }
+
+        static size_t write (char * data, size_t size, size_t count, void * pending) {
+            static_cast<Pending *>(pending)->response.text.append(data, size * count);
+            return size * count;
+        }
+
+        static size_t header (char * data, size_t size, size_t count, void * pending) {
+            std::string line(data, size * count);
+            cpr::Header & header = static_cast<Pending *>(pending)->response.header;
+            if (line.rfind("HTTP/", 0) == 0) {
+                // the status line of a new response (e.g. after a 100 Continue)
+                header.clear();
+            } else if (line.find(':') != std::string::npos) {
+                size_t colon = line.find(':');
+                size_t start = line.find_first_not_of(" \t", colon + 1);
+                size_t end = line.find_last_not_of(" \t\r\n");
+                header[line.substr(0, colon)] = start == std::string::npos || end < start ? "" : line.substr(start, end - start + 1);
+            }
+            return size * count;
+        }
+    };
+
+    MultiplexTransport::MultiplexTransport (const std::string & host, long maxconnections, EventLoop * loop) {
+        this->host = host;
+        this->compression = true;
+        this->http2 = true;
+        this->priorknowledge = false;
+        _stopping = false;
+        _connections = 0;
+        _loop = loop;
+        _multi = curl_multi_init();
+        if (_multi == nullptr) {
+            throw errors::CommunicationError("Could not initialise curl.");
+        }
+        curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, maxconnections);
+        if (_loop != nullptr) {
+            curl_multi_setopt(_multi, CURLMOPT_SOCKETFUNCTION, &MultiplexTransport::_socketcallback);
+            curl_multi_setopt(_multi, CURLMOPT_SOCKETDATA, this);
+            curl_multi_setopt(_multi, CURLMOPT_TIMERFUNCTION, &MultiplexTransport::_timercallback);
+            curl_multi_setopt(_multi, CURLMOPT_TIMERDATA, this);
+        } else {
+            _thread = std::thread(&MultiplexTransport::_run, this);
+        }
+    }
+
+    MultiplexTransport::~MultiplexTransport () {
+        _stopping = true;
+        if (_loop != nullptr) {
+            _abandon();
+            _loop->timer(std::chrono::milliseconds(-1));
+        } else {
+            curl_multi_wakeup(_multi);
+            _thread.join();
+        }
+        curl_multi_cleanup(_multi);
+    }
+
+    HTTPResponse MultiplexTransport::send (const HTTPRequest & request) {
+        if (_loop != nullptr) {
+            // the loop may be the thread that is waiting, so it can't be relied on to send this
+            CPRTransport transport(host);
+            transport.compression = compression;
+            return transport.send(request);
+        }
+        std::promise<HTTPResponse> response;
+        std::future<HTTPResponse> done = response.get_future();
+        sendasync(request, [&response] (HTTPResponse result) {
+            response.set_value(std::move(result));
+        });
+        return done.get();
+    }
+
+    void MultiplexTransport::sendasync (const HTTPRequest & request, Callback done) {
+        // owned by the background thread once it has been queued
+        auto pending = std::make_unique<Pending>(request, std::move(done));
+        CURL * handle = pending->handle;
+        if (handle == nullptr) {
+            throw errors::CommunicationError("Could not initialise curl.");
+        }
+        std::string url = (host == "" ? request.host : host) + request.path;
+        curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, pending.get());
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &Pending::write);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, pending.get());
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, &Pending::header);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, pending.get());
+        curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, pending->error);
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        // this might otherwise default to TLS 1.0. TLS 1.2+ is more secure
+        curl_easy_setopt(handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+        if (cainfo != "") {
+            curl_easy_setopt(handle, CURLOPT_CAINFO, cainfo.c_str());
+        }
+        curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, compression ? _acceptencoding().c_str() : "identity");
+        // wait for a connection that is still being set up, in case it can be shared
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(request.connecttimeout.count()));
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, static_cast<long>(request.timeout.count()));
+
+        long version = CURL_HTTP_VERSION_1_1;
+        if (http2) {
+            version = priorknowledge ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS;
+        }
+        if (curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, version) != CURLE_OK) {
+            // this curl was built without HTTP/2
+            curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+        }
+
+        if (request.method == "POST" || request.method == "PUT") {
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(request.body.size()));
+            // curl doesn't copy the body, so it has to be the copy that outlives this call
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, pending->request.body.c_str());
+            if (request.method == "PUT") {
+                curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "PUT");
+            }
+        } else if (request.method == "DELETE") {
+            curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "DELETE");
+        } else if (request.method != "GET") {
+            throw std::invalid_argument(request.method + " is not a recognised HTTP method.");
+        }
+        for (auto & [name, value] : request.header) {
+            pending->headers = curl_slist_append(pending->headers, (name + ": " + value).c_str());
+        }
+        // don't wait for a 100 Continue before sending the body
+        pending->headers = curl_slist_append(pending->headers, "Expect:");
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, pending->headers);
+
+        if (_loop != nullptr) {
+            if (_stopping) {
+                throw errors::CommunicationError("The transport is shutting down.");
+            }
+            // already on the loop's thread, so there is nobody to hand the request to
+            _inflight.push_back(pending.release());
+            curl_multi_add_handle(_multi, handle);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_stopping) {
+                throw errors::CommunicationError("The transport is shutting down.");
+            }
+            _incoming.push_back(pending.release());
+        }
+        curl_multi_wakeup(_multi);
+    }
+
+    void MultiplexTransport::ready (int socket, int events) {
+        int mask = 0;
+        if (events & EventLoop::readable) {
+            mask |= CURL_CSELECT_IN;
+        }
+        if (events & EventLoop::writable) {
+            mask |= CURL_CSELECT_OUT;
+        }
+        if (events & EventLoop::error) {
+            mask |= CURL_CSELECT_ERR;
+        }
+        int running = 0;
+        curl_multi_socket_action(_multi, socket, mask, &running);
+        _collect();
+    }
+
+    bool MultiplexTransport::after (std::chrono::milliseconds delay, std::function<void ()> task) {
+        if (_loop == nullptr) {
+            return false;
+        }
+        _timed.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+        long timeout = -1;
+        curl_multi_timeout(_multi, &timeout);
+        _arm(timeout);
+        return true;
+    }
+
+    void MultiplexTransport::expired () {
+        int running = 0;
+        curl_multi_socket_action(_multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        _collect();
+        // a task may call after() itself, so take each one out before running it
+        while (!_timed.empty() && _timed.begin()->first <= std::chrono::steady_clock::now()) {
+            std::function<void ()> task = std::move(_timed.begin()->second);
+            _timed.erase(_timed.begin());
+            task();
+        }
+        long timeout = -1;
+        curl_multi_timeout(_multi, &timeout);
+        _arm(timeout);
+    }
+
+    int MultiplexTransport::_socketcallback (CURL *, curl_socket_t socket, int what, void * transport, void *) {
+        int events = 0;
+        if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) {
+            events |= EventLoop::readable;
+        }
+        if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) {
+            events |= EventLoop::writable;
+        }
+        static_cast<MultiplexTransport *>(transport)->_loop->watch(socket, events);
+        return 0;
+    }
+
+    int MultiplexTransport::_timercallback (CURLM *, long timeout, void * transport) {
+        static_cast<MultiplexTransport *>(transport)->_arm(timeout);
+        return 0;
+    }
+
+    void MultiplexTransport::_arm (long timeout) {
+        // nothing tells the loop when a token is cancelled, so have it look every so often
+        bool cancellable = std::any_of(_inflight.begin(), _inflight.end(), [] (Pending * pending) {
+            return pending->request.cancellation.cancellable();
+        });
+        if (cancellable && (timeout < 0 || timeout > 20)) {
+            timeout = 20;
+        }
+        if (!_timed.empty()) {
+            auto due = std::chrono::ceil<std::chrono::milliseconds>(_timed.begin()->first - std::chrono::steady_clock::now());
+            long wait = std::max<long>(due.count(), 0);
+            if (timeout < 0 || wait < timeout) {
+                timeout = wait;
+            }
+        }
+        _loop->timer(std::chrono::milliseconds(timeout));
+    }
+
+    void MultiplexTransport::_run () {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                for (Pending * pending : _incoming) {
+                    curl_multi_add_handle(_multi, pending->handle);
+                    _inflight.push_back(pending);
+                }
+                _incoming.clear();
+            }
+
+            int running = 0;
+            curl_multi_perform(_multi, &running);
+            _collect();
+
+            if (_stopping) {
+                break;
+            }
+            // nothing signals this thread when a token is cancelled, so look every so often
+            bool cancellable = std::any_of(_inflight.begin(), _inflight.end(), [] (Pending * pending) {
+                return pending->request.cancellation.cancellable();
+            });
+            curl_multi_poll(_multi, nullptr, 0, cancellable ? 20 : 1000, nullptr);
+        }
+
+        // fail everything that is still waiting, whether or not it was started
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _inflight.insert(_inflight.end(), _incoming.begin(), _incoming.end());
+            _incoming.clear();
+        }
+        _abandon();
+    }
+
+    void MultiplexTransport::_collect () {
+        int queued = 0;
+        while (CURLMsg * message = curl_multi_info_read(_multi, &queued)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            Pending * pending = nullptr;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &pending);
+            HTTPResponse & response = pending->response;
+            if (message->data.result == CURLE_OK) {
+                curl_easy_getinfo(pending->handle, CURLINFO_RESPONSE_CODE, &response.status_code);
+            } else {
+                response.status_code = 0;
+                response.error = pending->error[0] != '\0' ? pending->error : curl_easy_strerror(message->data.result);
+            }
+            double elapsed = 0;
+            curl_easy_getinfo(pending->handle, CURLINFO_TOTAL_TIME, &elapsed);
+            response.elapsed = elapsed;
+            curl_off_t downloaded = 0;
+            curl_easy_getinfo(pending->handle, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+            response.wirebytes = downloaded;
+            _transferinfo(pending->handle, response);
+            _connections += response.newconnections;
+
+            // the handle must be cleaned up on this thread, as its connection may still be in use
+            curl_multi_remove_handle(_multi, pending->handle);
+            curl_easy_cleanup(pending->handle);
+            pending->handle = nullptr;
+            _inflight.erase(std::find(_inflight.begin(), _inflight.end(), pending));
+            // the callback may send another request, which adds to _inflight
+            _finish(pending);
+        }
+
+        for (size_t i = 0; i < _inflight.size();) {
+            Pending * pending = _inflight[i];
+            if (!pending->request.cancellation.cancelled()) {
+                i++;
+                continue;
+            }
+            curl_multi_remove_handle(_multi, pending->handle);
+            curl_easy_cleanup(pending->handle);
+            pending->handle = nullptr;
+            pending->response.error = "The request was cancelled.";
+            _inflight.erase(_inflight.begin() + i);
+            _finish(pending);
+        }
+    }
+
+    void MultiplexTransport::_abandon () {
+        std::vector<Pending *> abandoned;
+        abandoned.swap(_inflight);
+        for (Pending * pending : abandoned) {
+            curl_multi_remove_handle(_multi, pending->handle);
+            curl_easy_cleanup(pending->handle);
+            pending->handle = nullptr;
+            pending->response.error = "The transport was destroyed before the request finished.";
+            _finish(pending);
+        }
+    }
+
+    void MultiplexTransport::_finish (Pending * pending) {
+        std::unique_ptr<Pending> finished(pending);
+        finished->done(std::move(finished->response));
+    }
+}
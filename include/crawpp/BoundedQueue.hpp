@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace CRAW {
+
+    /**
+     * @brief A fixed-size, lock-free queue that any number of threads can push to and pop
+     * from at once.
+     *
+     * Each slot has a sequence number that says whose turn it is to use it, so pushing and
+     * popping only take one compare-and-swap each and never wait for each other, except
+     * for the brief moment that another thread is copying into or out of the same slot.
+     *
+     * @tparam T The type of item
+     */
+    template <typename T>
+    class BoundedQueue {
+        public:
+            /**
+             * @brief Construct a new, empty BoundedQueue
+             *
+             * @param capacity The most items the queue holds. It is rounded up to a power of 2.
+             */
+            explicit BoundedQueue (size_t capacity) {
+                size_t size = 2;
+                while (size < capacity) {
+                    size *= 2;
+                }
+                _mask = size - 1;
+                _slots = std::make_unique<Slot []>(size);
+                for (size_t i = 0; i < size; i++) {
+                    _slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+                _head.store(0, std::memory_order_relaxed);
+                _tail.store(0, std::memory_order_relaxed);
+            }
+
+            BoundedQueue (const BoundedQueue &) = delete;
+            BoundedQueue & operator= (const BoundedQueue &) = delete;
+
+            /**
+             * @brief Add an item to the back of the queue, unless it is full
+             *
+             * @param item The item, which is only moved from if there was room
+             * @return bool Whether there was room
+             */
+            bool push (T & item) {
+                size_t position = _tail.load(std::memory_order_relaxed);
+                while (true) {
+                    Slot & slot = _slots[position & _mask];
+                    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                    auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+                    if (difference == 0) {
+                        if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                            slot.value.emplace(std::move(item));
+                            slot.sequence.store(position + 1, std::memory_order_release);
+                            return true;
+                        }
+                    } else if (difference < 0) {
+                        // the slot still holds the item from a lap ago
+                        return false;
+                    } else {
+                        position = _tail.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            /**
+             * @brief Take the item at the front of the queue, unless it is empty
+             *
+             * @return std::optional<T> The item, or nothing if the queue was empty
+             */
+            std::optional<T> pop () {
+                size_t position = _head.load(std::memory_order_relaxed);
+                while (true) {
+                    Slot & slot = _slots[position & _mask];
+                    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                    auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+                    if (difference == 0) {
+                        if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                            std::optional<T> item = std::move(slot.value);
+                            slot.value.reset();
+                            slot.sequence.store(position + _mask + 1, std::memory_order_release);
+                            return item;
+                        }
+                    } else if (difference < 0) {
+                        return std::nullopt;
+                    } else {
+                        position = _head.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            /**
+             * @brief Roughly how many items are in the queue. It may be out of date by the
+             * time it is returned if other threads are using the queue.
+             */
+            size_t size () const {
+                size_t tail = _tail.load(std::memory_order_relaxed);
+                size_t head = _head.load(std::memory_order_relaxed);
+                return tail > head ? tail - head : 0;
+            }
+
+            /**
+             * @brief The most items the queue holds
+             */
+            size_t capacity () const {
+                return _mask + 1;
+            }
+
+        private:
+            struct Slot {
+                std::atomic<size_t> sequence;
+                std::optional<T> value;
+            };
+
+            std::unique_ptr<Slot []> _slots;
+            size_t _mask;
+
+            // kept on separate cache lines so that pushing and popping don't slow each other down
+            alignas(64) std::atomic<size_t> _head;
+            alignas(64) std::atomic<size_t> _tail;
+    };
+}
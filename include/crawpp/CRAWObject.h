@@ -2,6 +2,7 @@
 
 namespace CRAW {
     class Reddit;
+    class RedditPool;
 
     /**
      * @brief A base class that all CRAW models inherit from.
@@ -12,5 +13,8 @@ namespace CRAW {
         protected:
             /// The Reddit session associated with the object
             Reddit * _redditinstance;
+
+            // so that objects can be handed from one account to another
+            friend class RedditPool;
     };
 }
\ No newline at end of file
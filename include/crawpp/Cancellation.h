@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace CRAW {
+
+    /**
+     * @brief A token that lets a long-running call be cancelled from another thread, or
+     * given a deadline by which it must finish.
+     *
+     * Copies of a token share its state, so cancelling one cancels them all. Pass a token
+     * to a high-level call such as Subreddit::posts() and call cancel() (from any thread)
+     * to stop it: requests in flight are aborted, waits between retries and polls are cut
+     * short, and the call throws errors::CancelledError, or errors::DeadlineExceededError
+     * if the deadline passed.
+     */
+    class CancellationToken {
+        private:
+            struct State;
+
+            /// The shared state, or nullptr for a token that can never be cancelled
+            std::shared_ptr<State> _state;
+
+            CancellationToken (std::shared_ptr<State> state);
+
+        public:
+            /**
+             * @brief Construct a new CancellationToken with no deadline, which is only
+             * cancelled by calling cancel()
+             */
+            CancellationToken ();
+
+            /**
+             * @brief Construct a new CancellationToken that is cancelled at a deadline
+             *
+             * @param deadline When to give up
+             */
+            CancellationToken (std::chrono::steady_clock::time_point deadline);
+
+            /**
+             * @brief Make a token that is cancelled once some time has passed
+             *
+             * @param timeout How long from now to give up
+             * @return CancellationToken The token
+             */
+            static CancellationToken after (std::chrono::milliseconds timeout);
+
+            /**
+             * @brief A token that is never cancelled. This is the default for calls that
+             * take a token, and costs nothing to check.
+             */
+            static const CancellationToken & none ();
+
+            /**
+             * @brief Make a token that is cancelled along with this one, but can also be
+             * cancelled on its own without affecting this one. It has the same deadline.
+             *
+             * @return CancellationToken The new token
+             */
+            CancellationToken child () const;
+
+            /**
+             * @brief Cancel every call that this token was passed to. This is safe to call
+             * from any thread, and more than once.
+             */
+            void cancel ();
+
+            /**
+             * @brief Whether this token can ever be cancelled (false only for none())
+             */
+            bool cancellable () const {
+                return _state != nullptr;
+            }
+
+            /**
+             * @brief Whether cancel() was called or the deadline has passed
+             */
+            bool cancelled () const;
+
+            /**
+             * @brief Whether the deadline has passed (as opposed to cancel() being called)
+             */
+            bool expired () const;
+
+            /**
+             * @brief How long is left until the deadline
+             *
+             * @return std::chrono::milliseconds The time left (0 if it has passed), or
+             * std::chrono::milliseconds::max() if there is no deadline
+             */
+            std::chrono::milliseconds remaining () const;
+
+            /**
+             * @brief Throw if the token has been cancelled
+             *
+             * @throws errors::DeadlineExceededError if the deadline has passed
+             * @throws errors::CancelledError if cancel() was called
+             */
+            void check () const;
+
+            /**
+             * @brief Sleep for a while, waking up early if the token is cancelled
+             *
+             * @param duration How long to sleep for
+             * @return true if the whole duration passed, false if the token was cancelled
+             */
+            bool sleep (std::chrono::milliseconds duration) const;
+
+            /**
+             * @brief Call a function when cancel() is called on this token or one of the
+             * tokens it is a child of. The function is called once, on the thread that
+             * cancels the token, so it should be quick and must not throw. It is not called
+             * when the deadline passes; use remaining() to wait no longer than that.
+             *
+             * @param callback The function to call
+             * @return uint64_t An id to pass to unsubscribe(), or 0 if the token was already
+             * cancelled (in which case the function has already been called) or can never
+             * be cancelled
+             */
+            uint64_t subscribe (std::function<void ()> callback) const;
+
+            /**
+             * @brief Stop a function passed to subscribe() from being called. It might still
+             * be called if the token is being cancelled on another thread at the same time.
+             *
+             * @param id The id that subscribe() returned
+             */
+            void unsubscribe (uint64_t id) const;
+    };
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace CRAW {
+
+    /**
+     * @brief Replace a file's contents so that it is never seen half-written, even if the
+     * process or machine dies part of the way through: the contents are written to a
+     * temporary file next to it, flushed to disk, and then moved over it.
+     *
+     * @param path The file to write
+     * @param contents What to write to it
+     * @throws errors::FileOperationError if the file can't be written
+     */
+    void writeatomically (const std::string & path, const std::string & contents);
+
+    /**
+     * @brief Read a whole file
+     *
+     * @param path The file to read
+     * @return std::optional<std::string> The file's contents, or nothing if it doesn't exist
+     * @throws errors::FileOperationError if the file exists but can't be read
+     */
+    std::optional<std::string> readfile (const std::string & path);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "crawpp/Transport.h"
+
+namespace CRAW {
+
+    /**
+     * @brief The state of one endpoint's circuit breaker.
+     */
+    enum class CircuitState {
+        /// Requests are sent as normal
+        closed,
+
+        /// The endpoint keeps failing, so requests to it fail straight away
+        open,
+
+        /// The endpoint has been left alone for a while, and one request is being let
+        /// through to see whether it has recovered
+        halfopen
+    };
+
+    /**
+     * @brief When an endpoint's circuit breaker opens and how long it stays open.
+     */
+    struct CircuitBreakerPolicy {
+        /// How many requests in a row must fail to open the circuit (default: 5)
+        int threshold;
+
+        /// How long the circuit stays open before a request is let through to probe the
+        /// endpoint (default: 30 s)
+        std::chrono::milliseconds cooldown;
+
+        CircuitBreakerPolicy (int threshold = 5, std::chrono::milliseconds cooldown = std::chrono::seconds(30)) {
+            this->threshold = threshold;
+            this->cooldown = cooldown;
+        }
+    };
+
+    /**
+     * @brief A Transport that passes requests on to another Transport, and stops sending
+     * requests to endpoints that keep failing.
+     *
+     * Each endpoint template (see endpointtemplate()) has its own circuit breaker. A
+     * request fails if it gets no response or a server error (HTTP 5xx); rate limiting
+     * (HTTP 429) is not a failure of the endpoint, and neither is a cancelled request.
+     * Once threshold requests to an endpoint have failed in a row, its circuit opens and
+     * requests to it throw errors::CircuitOpenError without being sent, so that they
+     * don't use up the rate limit. After the cooldown, the next request is sent as a
+     * probe: if it succeeds the circuit closes again, and if it fails the circuit stays
+     * open for another cooldown.
+     *
+     * A Reddit instance doesn't retry requests that were stopped by an open circuit.
+     */
+    class CircuitBreakerTransport : public Transport {
+        private:
+            struct Circuit {
+                CircuitState state;
+
+                /// The number of requests in a row that have failed
+                int failures;
+
+                /// When the circuit can be probed, while it is open
+                std::chrono::steady_clock::time_point reopens;
+
+                Circuit () {
+                    state = CircuitState::closed;
+                    failures = 0;
+                }
+            };
+
+            /// The Transport that actually sends the requests
+            std::shared_ptr<Transport> _inner;
+
+            std::mutex _lock;
+
+            /// The circuit of each endpoint template that has been used
+            std::map<std::string, Circuit> _circuits;
+
+            /**
+             * The policy of an endpoint template
+             */
+            const CircuitBreakerPolicy & _policy (const std::string & endpoint) const;
+
+            /**
+             * Check that a request to an endpoint can be sent
+             *
+             * @return bool Whether the request is the probe of a circuit that was open
+             * @throws errors::CircuitOpenError if the endpoint's circuit is open
+             */
+            bool _admit (const std::string & endpoint);
+
+            /**
+             * Open the circuit again after its probe threw rather than being answered
+             */
+            void _abandon (const std::string & endpoint, bool probe);
+
+            /**
+             * Update an endpoint's circuit according to how a request to it went
+             */
+            void _record (const std::string & endpoint,
+                          bool probe,
+                          const HTTPResponse & response,
+                          const CancellationToken & cancellation);
+
+        public:
+            /// The policy of endpoints that are not in endpoints
+            CircuitBreakerPolicy defaults;
+
+            /**
+             * Policies for particular endpoints, keyed by endpoint template, e.g.
+             * breaker.endpoints["/api/submit"] = CircuitBreakerPolicy(3, std::chrono::minutes(2))
+             */
+            std::map<std::string, CircuitBreakerPolicy> endpoints;
+
+            /**
+             * @brief Construct a new CircuitBreakerTransport
+             *
+             * @param inner The Transport to send requests with (default: a new CPRTransport)
+             */
+            CircuitBreakerTransport (std::shared_ptr<Transport> inner = nullptr);
+
+            /**
+             * @brief The state of an endpoint's circuit breaker
+             *
+             * @param path The path of a request to the endpoint, or its endpoint template
+             * @return CircuitState The state of the circuit
+             */
+            CircuitState state (const std::string & path);
+
+            /**
+             * @brief Send a request, unless the circuit of its endpoint is open
+             *
+             * @throws errors::CircuitOpenError if the endpoint's circuit is open
+             */
+            HTTPResponse send (const HTTPRequest & request) override;
+
+            /**
+             * @brief Send a request with the inner Transport's sendasync(), unless the circuit
+             * of its endpoint is open. The outcome is recorded when the response arrives.
+             *
+             * @throws errors::CircuitOpenError if the endpoint's circuit is open
+             */
+            void sendasync (const HTTPRequest & request, Callback done) override;
+
+            /**
+             * @brief Call a function after a while, the same way the inner Transport does
+             */
+            bool after (std::chrono::milliseconds delay, std::function<void ()> task) override;
+    };
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/Scheduler.h"
+
+namespace CRAW {
+
+    /**
+     * @brief A structure representing how many requests a Reddit instance lets into flight at once.
+     *
+     * The limit adapts like TCP's congestion window (additive increase, multiplicative
+     * decrease): it grows by about one request for each limit's worth of healthy responses,
+     * and is cut whenever a response is rate-limited (HTTP 429), a server error, missing
+     * altogether, or much slower than the endpoint usually is. This lets many threads share
+     * a Reddit instance for bulk work without flooding Reddit or leaving its rate budget
+     * unused.
+     *
+     * Adaptive concurrency is off by default, in which case any number of requests may be in
+     * flight.
+     */
+    struct ConcurrencyPolicy {
+        /// Whether to limit how many requests are in flight (default: false)
+        bool enabled;
+
+        /// The limit to start at (default: 4)
+        double initial;
+
+        /// The lowest the limit can be cut to (default: 1)
+        double minimum;
+
+        /// The highest the limit can grow to (default: 64)
+        double maximum;
+
+        /// What the limit is multiplied by when it is cut (default: 0.5)
+        double backoff;
+
+        /// How many times slower than an endpoint's usual latency a response can be before it
+        /// counts as a sign of overload (default: 3)
+        double latencytolerance;
+
+        ConcurrencyPolicy () {
+            enabled = false;
+            initial = 4;
+            minimum = 1;
+            maximum = 64;
+            backoff = 0.5;
+            latencytolerance = 3;
+        }
+    };
+
+    /**
+     * @brief Limits how many requests a Reddit instance has in flight, according to a ConcurrencyPolicy.
+     *
+     * Every request takes a slot with acquire() before it is sent and gives it back with
+     * release() once it is answered, which is when the limit is adjusted. The limit is cut at
+     * most once per round trip, so a burst of 429s in answer to requests that were already in
+     * flight only cuts it once. Free slots go to waiting requests of the highest priority first.
+     */
+    class ConcurrencyLimiter {
+        public:
+            ConcurrencyLimiter ();
+            ConcurrencyLimiter (const ConcurrencyLimiter &) = delete;
+            ConcurrencyLimiter & operator= (const ConcurrencyLimiter &) = delete;
+
+            /**
+             * @brief Wait for a slot to send a request in.
+             *
+             * @param policy The limits to apply
+             * @param priority The priority of the request
+             * @param cancellation Stops waiting when cancelled
+             * @return std::chrono::steady_clock::time_point When the slot was taken, which must
+             * be passed to release()
+             * @throws errors::CancelledError if the token was cancelled while waiting
+             */
+            std::chrono::steady_clock::time_point acquire (const ConcurrencyPolicy & policy,
+                                                           Priority priority,
+                                                           const CancellationToken & cancellation);
+
+            /**
+             * @brief Take a slot without waiting, for a request that can be skipped (such as
+             * a hedge). It is only taken if no other request is waiting for one.
+             *
+             * @param policy The limits to apply
+             * @param start Set to when the slot was taken, which must be passed to release()
+             * @return bool Whether a slot was taken
+             */
+            bool tryacquire (const ConcurrencyPolicy & policy, std::chrono::steady_clock::time_point & start);
+
+            /**
+             * @brief Wait for a slot without blocking, for a caller that waits some other way
+             * (such as a coroutine). If there is no slot free, ready is called once there is
+             * one, on the thread that gave it back, so it should hand the request off rather
+             * than send it there.
+             *
+             * @param policy The limits to apply
+             * @param priority The priority of the request
+             * @param start Set to when the slot was taken, if it was taken straight away
+             * @param ready Called with when the slot was taken, if it wasn't taken straight away
+             * @return uint64_t 0 if the slot was taken straight away, otherwise an id to pass
+             * to cancel()
+             */
+            uint64_t acquireasync (const ConcurrencyPolicy & policy,
+                                   Priority priority,
+                                   std::chrono::steady_clock::time_point & start,
+                                   std::function<void (std::chrono::steady_clock::time_point)> ready);
+
+            /**
+             * @brief Stop waiting for a slot that acquireasync() is waiting for
+             *
+             * @param id What acquireasync() returned
+             * @return bool true if it was still waiting, false if it has been given a slot (in
+             * which case its function has been or is being called, and the slot must still
+             * be released)
+             */
+            bool cancel (uint64_t id);
+
+            /**
+             * @brief Give back a slot, adjusting the limit according to how the request went.
+             *
+             * @param policy The limits to apply
+             * @param start What acquire() returned
+             * @param status The status code of the response (0 if there was no response, or -1
+             * if the request was cancelled, which leaves the limit alone)
+             * @param endpoint The template of the request's endpoint (see endpointtemplate()),
+             * whose usual latency the request's is compared against
+             */
+            void release (const ConcurrencyPolicy & policy,
+                          std::chrono::steady_clock::time_point start,
+                          long status,
+                          const std::string & endpoint);
+
+            /**
+             * @brief The current limit on requests in flight
+             */
+            double limit ();
+
+            /**
+             * @brief How many requests are in flight
+             */
+            long inflight ();
+
+        private:
+            std::mutex _lock;
+            std::condition_variable _released;
+
+            /// The limit, or 0 until the first request sets it from the policy
+            double _limit;
+            long _inflight;
+
+            /// The number of requests of each priority waiting for a slot, whether with
+            /// acquire() or acquireasync()
+            long _waiting [3];
+
+            /// A request waiting with acquireasync()
+            struct Waiter {
+                uint64_t id;
+                std::function<void (std::chrono::steady_clock::time_point)> ready;
+            };
+
+            /// The requests of each priority waiting with acquireasync(), oldest first
+            std::deque<Waiter> _waiters [3];
+
+            /// The id of the next request to wait with acquireasync()
+            uint64_t _nextid;
+
+            /// When the limit was last cut. Requests sent before then can't cut it again.
+            std::chrono::steady_clock::time_point _lastcut;
+
+            /// The usual latency of each endpoint, in seconds: a minimum that slowly drifts
+            /// up, so that it follows the endpoint if it gets slower for good
+            std::map<std::string, double> _baselines;
+
+            /**
+             * Whether the limit leaves room for another request. Must be called with the lock held.
+             */
+            bool _free () const;
+
+            /**
+             * Give free slots to requests waiting with acquireasync(), then call their functions
+             * once the lock is released
+             */
+            void _dispatch (std::unique_lock<std::mutex> & guard);
+    };
+}
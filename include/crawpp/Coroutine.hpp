@@ -0,0 +1,573 @@
+#pragma once
+
+// Coroutines need C++20. Everything in this file (and every *_co method) is left out of
+// C++17 builds; build the library with "make STANDARD=c++20" to use them.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define CRAW_COROUTINES 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/Concurrency.h"
+#include "crawpp/Executor.h"
+#include "crawpp/Transport.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /**
+     * @brief Where a Task keeps its result. Used by Task; not meant to be used directly.
+     */
+    template <typename T>
+    struct TaskResult {
+        std::optional<T> value;
+
+        void return_value (T result) {
+            value.emplace(std::move(result));
+        }
+
+        T take () {
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskResult<void> {
+        void return_void () {}
+
+        void take () {}
+    };
+
+    /**
+     * @brief A coroutine that produces a T, such as the *_co methods of the models.
+     *
+     * A Task doesn't start until it is awaited (with co_await, from another coroutine),
+     * waited for with get(), or set off with start(). It carries on from wherever it last
+     * waited: usually the transport's thread once a response arrives, or one of the Reddit
+     * instance's executor workers after a delay.
+     *
+     * @code
+     * CRAW::Task<void> greet (CRAW::Reddit & reddit) {
+     *     CRAW::Subreddit subreddit = co_await reddit.subreddit_co("cpp");
+     *     std::vector<CRAW::Post> posts = co_await subreddit.posts_co("new");
+     *     co_await posts[0].reply_co("Hello");
+     * }
+     *
+     * greet(reddit).get();
+     * @endcode
+     *
+     * @tparam T The type of the result (default: void)
+     */
+    template <typename T = void>
+    class Task {
+        public:
+            struct promise_type;
+            using Handle = std::coroutine_handle<promise_type>;
+
+            /// Lets get() know when the task has finished
+            struct Finished {
+                std::mutex lock;
+                std::condition_variable wakeup;
+                bool finished = false;
+            };
+
+            struct promise_type : TaskResult<T> {
+                std::exception_ptr error;
+
+                /// The coroutine that is awaiting this one, if any
+                std::coroutine_handle<> continuation;
+
+                /// Set by get()
+                Finished * finished = nullptr;
+
+                /// Whether nothing owns the task, so it must free itself once it has finished
+                bool detached = false;
+
+                Task get_return_object () {
+                    return Task(Handle::from_promise(*this));
+                }
+
+                std::suspend_always initial_suspend () noexcept {
+                    return {};
+                }
+
+                struct FinalAwaiter {
+                    bool await_ready () noexcept {
+                        return false;
+                    }
+
+                    std::coroutine_handle<> await_suspend (Handle handle) noexcept {
+                        promise_type & promise = handle.promise();
+                        if (promise.continuation) {
+                            return promise.continuation;
+                        }
+                        if (promise.finished != nullptr) {
+                            // get() may destroy the task as soon as it sees this, so it must be the last thing done here
+                            std::lock_guard<std::mutex> guard(promise.finished->lock);
+                            promise.finished->finished = true;
+                            promise.finished->wakeup.notify_all();
+                        } else if (promise.detached) {
+                            handle.destroy();
+                        }
+                        return std::noop_coroutine();
+                    }
+
+                    void await_resume () noexcept {}
+                };
+
+                FinalAwaiter final_suspend () noexcept {
+                    return {};
+                }
+
+                void unhandled_exception () {
+                    error = std::current_exception();
+                }
+            };
+
+            Task (Task && other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+            Task & operator= (Task && other) noexcept {
+                if (this != &other) {
+                    if (_handle) {
+                        _handle.destroy();
+                    }
+                    _handle = std::exchange(other._handle, nullptr);
+                }
+                return *this;
+            }
+
+            Task (const Task &) = delete;
+            Task & operator= (const Task &) = delete;
+
+            ~Task () {
+                if (_handle) {
+                    _handle.destroy();
+                }
+            }
+
+            struct Awaiter {
+                Handle handle;
+
+                bool await_ready () {
+                    return handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+
+                T await_resume () {
+                    if (handle.promise().error != nullptr) {
+                        std::rethrow_exception(handle.promise().error);
+                    }
+                    return handle.promise().take();
+                }
+            };
+
+            /**
+             * @brief Start the task, and carry on once it has finished
+             */
+            Awaiter operator co_await () && {
+                return Awaiter{_handle};
+            }
+
+            /**
+             * @brief Start the task and block the calling thread until it has finished.
+             *
+             * @return T The task's result
+             * @throws Whatever the task threw
+             */
+            T get () {
+                Finished finished;
+                _handle.promise().finished = &finished;
+                _handle.resume();
+                std::unique_lock<std::mutex> guard(finished.lock);
+                finished.wakeup.wait(guard, [&finished] { return finished.finished; });
+                guard.unlock();
+                return Awaiter{_handle}.await_resume();
+            }
+
+            /**
+             * @brief Start the task without waiting for it. The task frees itself once it
+             * has finished, and anything it throws is dropped, so catch exceptions inside it.
+             */
+            void start () && {
+                Handle handle = std::exchange(_handle, nullptr);
+                handle.promise().detached = true;
+                handle.resume();
+            }
+
+        private:
+            Handle _handle;
+
+            explicit Task (Handle handle) : _handle(handle) {}
+    };
+
+    /**
+     * @brief A coroutine that produces a sequence of T one at a time, such as a listing
+     * that is fetched page by page.
+     *
+     * Items are taken with co_await next(), which gives nothing once the sequence has ended.
+     * Like a Task, the generator doesn't start until the first item is asked for.
+     *
+     * @code
+     * CRAW::AsyncGenerator<CRAW::Post> posts = subreddit.posts_all_co("new");
+     * while (std::optional<CRAW::Post> post = co_await posts.next()) {
+     *     std::cout << post->title << std::endl;
+     * }
+     * @endcode
+     *
+     * @tparam T The type of item
+     */
+    template <typename T>
+    class AsyncGenerator {
+        public:
+            struct promise_type;
+            using Handle = std::coroutine_handle<promise_type>;
+
+            struct promise_type {
+                std::optional<T> current;
+                std::exception_ptr error;
+
+                /// The coroutine waiting for the next item
+                std::coroutine_handle<> consumer;
+
+                AsyncGenerator get_return_object () {
+                    return AsyncGenerator(Handle::from_promise(*this));
+                }
+
+                std::suspend_always initial_suspend () noexcept {
+                    return {};
+                }
+
+                /// Hands control back to the consumer, at a co_yield or at the end
+                struct Handback {
+                    bool await_ready () noexcept {
+                        return false;
+                    }
+
+                    std::coroutine_handle<> await_suspend (Handle handle) noexcept {
+                        return handle.promise().consumer;
+                    }
+
+                    void await_resume () noexcept {}
+                };
+
+                Handback yield_value (T item) {
+                    current.emplace(std::move(item));
+                    return {};
+                }
+
+                Handback final_suspend () noexcept {
+                    return {};
+                }
+
+                void return_void () {}
+
+                void unhandled_exception () {
+                    error = std::current_exception();
+                }
+            };
+
+            AsyncGenerator (AsyncGenerator && other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+            AsyncGenerator & operator= (AsyncGenerator && other) noexcept {
+                if (this != &other) {
+                    if (_handle) {
+                        _handle.destroy();
+                    }
+                    _handle = std::exchange(other._handle, nullptr);
+                }
+                return *this;
+            }
+
+            AsyncGenerator (const AsyncGenerator &) = delete;
+            AsyncGenerator & operator= (const AsyncGenerator &) = delete;
+
+            ~AsyncGenerator () {
+                if (_handle) {
+                    _handle.destroy();
+                }
+            }
+
+            struct NextAwaiter {
+                Handle handle;
+
+                bool await_ready () {
+                    return handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) {
+                    handle.promise().consumer = awaiting;
+                    handle.promise().current.reset();
+                    return handle;
+                }
+
+                std::optional<T> await_resume () {
+                    promise_type & promise = handle.promise();
+                    if (promise.error != nullptr) {
+                        std::rethrow_exception(std::exchange(promise.error, nullptr));
+                    }
+                    if (handle.done()) {
+                        return std::nullopt;
+                    }
+                    return std::move(promise.current);
+                }
+            };
+
+            /**
+             * @brief Wait for the next item
+             *
+             * @return An awaitable that gives std::optional<T>: the item, or nothing if the
+             * sequence has ended
+             * @throws Whatever the generator threw while producing the item
+             */
+            NextAwaiter next () {
+                return NextAwaiter{_handle};
+            }
+
+        private:
+            Handle _handle;
+
+            explicit AsyncGenerator (Handle handle) : _handle(handle) {}
+    };
+
+    /**
+     * @brief Run a function after a while, on the transport's thread if it has one (see
+     * Transport::after()) and on one of the executor's workers otherwise. Used by the
+     * awaitables below to carry on a coroutine; not meant to be used directly.
+     */
+    inline void carryon (Transport & transport,
+                         Executor & executor,
+                         const ExecutorPolicy & policy,
+                         std::chrono::milliseconds delay,
+                         std::function<void ()> task) {
+        if (!transport.after(delay, task)) {
+            executor.start(policy);
+            executor.post(std::move(task), delay);
+        }
+    }
+
+    /**
+     * @brief Awaitable that sends a request with Transport::sendasync() and gives the
+     * response. The coroutine carries on on whichever thread the transport answers on.
+     */
+    class SendAwaiter {
+        public:
+            SendAwaiter (Transport & transport, const HTTPRequest & request) : _transport(transport), _request(request) {
+                _arrived = false;
+            }
+
+            bool await_ready () {
+                return false;
+            }
+
+            bool await_suspend (std::coroutine_handle<> awaiting) {
+                _transport.sendasync(_request, [this, awaiting] (HTTPResponse response) {
+                    _response = std::move(response);
+                    // whichever of this and await_suspend gets here second carries on
+                    if (_arrived.exchange(true)) {
+                        awaiting.resume();
+                    }
+                });
+                // a transport that answered straight away has already called back
+                return !_arrived.exchange(true);
+            }
+
+            HTTPResponse await_resume () {
+                return std::move(_response);
+            }
+
+        private:
+            Transport & _transport;
+            const HTTPRequest & _request;
+            HTTPResponse _response;
+            std::atomic<bool> _arrived;
+    };
+
+    /**
+     * @brief Awaitable that waits for a while, then carries on on one of an Executor's
+     * workers. Nothing is blocked while it waits, and it carries on early if the token
+     * passed to it is cancelled or its deadline passes, so check the token afterwards.
+     *
+     * Transports that keep everything on one thread (see Transport::after()) do the waiting
+     * themselves instead, and the executor isn't started.
+     */
+    class DelayAwaiter {
+        public:
+            DelayAwaiter (Transport & transport,
+                          Executor & executor,
+                          const ExecutorPolicy & policy,
+                          std::chrono::milliseconds delay,
+                          const CancellationToken & cancellation = CancellationToken::none())
+                : _transport(transport), _executor(executor), _policy(policy), _cancellation(cancellation) {
+                _delay = std::min(delay, cancellation.remaining());
+                _waiting = std::make_shared<Waiting>();
+            }
+
+            bool await_ready () {
+                return _delay.count() <= 0 || _cancellation.cancelled();
+            }
+
+            void await_suspend (std::coroutine_handle<> awaiting) {
+                // the timer and the token race to carry on, and only the first one does. This
+                // uses nothing but copies from here on, since the coroutine (and this awaiter
+                // with it) can be gone as soon as either one fires.
+                std::shared_ptr<Waiting> waiting = _waiting;
+                waiting->awaiting = awaiting;
+                Transport & transport = _transport;
+                Executor & executor = _executor;
+                const ExecutorPolicy & policy = _policy;
+                waiting->subscription.store(_cancellation.subscribe([waiting, &transport, &executor, &policy] {
+                    if (!waiting->resumed.exchange(true)) {
+                        // not on the cancelling thread, which might be holding locks
+                        carryon(transport, executor, policy, std::chrono::milliseconds(0), [waiting] {
+                            waiting->awaiting.resume();
+                        });
+                    }
+                }));
+                carryon(transport, executor, policy, _delay, [waiting] {
+                    if (!waiting->resumed.exchange(true)) {
+                        waiting->awaiting.resume();
+                    }
+                });
+            }
+
+            void await_resume () {
+                _cancellation.unsubscribe(_waiting->subscription.load());
+            }
+
+        private:
+            /// What the timer and the token's callback share
+            struct Waiting {
+                std::coroutine_handle<> awaiting;
+                std::atomic<bool> resumed{false};
+                std::atomic<uint64_t> subscription{0};
+            };
+
+            Transport & _transport;
+            Executor & _executor;
+            const ExecutorPolicy & _policy;
+            CancellationToken _cancellation;
+            std::chrono::milliseconds _delay;
+            std::shared_ptr<Waiting> _waiting;
+    };
+
+    /**
+     * @brief Awaitable that waits for a slot from a ConcurrencyLimiter and gives when it was
+     * taken, to be passed to ConcurrencyLimiter::release(). Nothing is blocked while it
+     * waits, and the coroutine carries on the same way as after a DelayAwaiter.
+     *
+     * @throws errors::CancelledError if the token is cancelled before there is a slot
+     * @throws errors::DeadlineExceededError if the token's deadline passes first
+     */
+    class SlotAwaiter {
+        public:
+            SlotAwaiter (Transport & transport,
+                         Executor & executor,
+                         const ExecutorPolicy & executorpolicy,
+                         ConcurrencyLimiter & limiter,
+                         const ConcurrencyPolicy & policy,
+                         Priority priority,
+                         const CancellationToken & cancellation)
+                : _transport(transport), _executor(executor), _executorpolicy(executorpolicy),
+                  _limiter(limiter), _policy(policy), _priority(priority), _cancellation(cancellation) {
+                _waiting = std::make_shared<Waiting>();
+            }
+
+            bool await_ready () {
+                return false;
+            }
+
+            bool await_suspend (std::coroutine_handle<> awaiting) {
+                // once the limiter has the function, the coroutine can be carried on (and this
+                // awaiter destroyed) from another thread, so only copies are used from then on
+                std::shared_ptr<Waiting> waiting = _waiting;
+                waiting->awaiting = awaiting;
+                Transport & transport = _transport;
+                Executor & executor = _executor;
+                const ExecutorPolicy & executorpolicy = _executorpolicy;
+                ConcurrencyLimiter & limiter = _limiter;
+                CancellationToken cancellation = _cancellation;
+                auto arrive = [waiting, &transport, &executor, &executorpolicy] {
+                    // whichever of this and the end of await_suspend gets here second carries on
+                    if (waiting->arrivals.fetch_sub(1) == 1) {
+                        carryon(transport, executor, executorpolicy, std::chrono::milliseconds(0), [waiting] {
+                            waiting->awaiting.resume();
+                        });
+                    }
+                };
+                uint64_t id = limiter.acquireasync(_policy, _priority, waiting->start, [waiting, arrive] (std::chrono::steady_clock::time_point start) {
+                    waiting->start = start;
+                    waiting->granted = true;
+                    waiting->resolved = true;
+                    arrive();
+                });
+                if (id == 0) {
+                    waiting->granted = true;
+                    return false;
+                }
+
+                // the limiter only gives the request up once, so a slot and a cancellation
+                // can't both carry the coroutine on
+                auto giveup = [waiting, &limiter, arrive, id] {
+                    if (!waiting->resolved.load() && limiter.cancel(id)) {
+                        waiting->resolved = true;
+                        arrive();
+                    }
+                };
+                waiting->subscription = cancellation.subscribe(giveup);
+                if (cancellation.remaining() != std::chrono::milliseconds::max()) {
+                    carryon(transport, executor, executorpolicy, cancellation.remaining(), giveup);
+                }
+                return waiting->arrivals.fetch_sub(1) != 1;
+            }
+
+            std::chrono::steady_clock::time_point await_resume () {
+                _cancellation.unsubscribe(_waiting->subscription);
+                if (!_waiting->granted) {
+                    _cancellation.check();
+                    throw errors::DeadlineExceededError("The deadline passed while waiting to send a request.");
+                }
+                return _waiting->start;
+            }
+
+        private:
+            /// What the limiter, the token's callback and the deadline share
+            struct Waiting {
+                std::coroutine_handle<> awaiting;
+                std::chrono::steady_clock::time_point start;
+                bool granted = false;
+
+                /// Whether the request has been given a slot or given up on
+                std::atomic<bool> resolved{false};
+
+                /// The end of await_suspend and whichever of those happens first
+                std::atomic<int> arrivals{2};
+
+                uint64_t subscription = 0;
+            };
+
+            Transport & _transport;
+            Executor & _executor;
+            const ExecutorPolicy & _executorpolicy;
+            ConcurrencyLimiter & _limiter;
+            const ConcurrencyPolicy & _policy;
+            Priority _priority;
+            CancellationToken _cancellation;
+            std::shared_ptr<Waiting> _waiting;
+    };
+}
+
+#endif
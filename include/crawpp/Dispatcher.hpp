@@ -0,0 +1,472 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "crawpp/BoundedQueue.hpp"
+#include "crawpp/Cancellation.h"
+#include "crawpp/Metrics.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /**
+     * @brief What a Dispatcher does with a new item when its queue is full.
+     */
+    enum class Overflow {
+        /// Wait for a handler to take an item, which holds up whoever is publishing (e.g. polling)
+        block,
+
+        /// Throw away the oldest item in the queue to make room
+        dropoldest,
+
+        /// Write the item to a file, and queue it again once there is room
+        spill
+    };
+
+    /**
+     * @brief A structure representing how a Dispatcher queues items and how many threads
+     * handle them.
+     */
+    struct DispatchPolicy {
+        /// How many items can wait for a handler before the queue is full (default: 1024)
+        size_t capacity;
+
+        /// How many threads call the handler at once (default: 4)
+        unsigned workers;
+
+        /// What to do with a new item when the queue is full (default: Overflow::block)
+        Overflow overflow;
+
+        /// The file that Overflow::spill writes to (default: empty, which uses a new file
+        /// in the system's temporary directory). It is overwritten, and deleted when the
+        /// dispatcher is destroyed.
+        std::string spillfile;
+
+        /// The prefix of the names of the dispatcher's gauges (default: "stream")
+        std::string name;
+
+        DispatchPolicy () {
+            capacity = 1024;
+            workers = 4;
+            overflow = Overflow::block;
+            name = "stream";
+        }
+    };
+
+    /**
+     * @brief Hands items to a pool of threads that each call a handler, through a bounded
+     * lock-free queue.
+     *
+     * This decouples whatever produces the items (such as a Stream's polling) from slow
+     * handlers (such as ones that reply to every post), without letting the backlog grow
+     * without bound: once the queue is full, the DispatchPolicy's overflow decides what
+     * happens. Items are handed to the handlers in the order they were published, but
+     * with several workers they may finish in any order.
+     *
+     * @tparam T The type of item
+     */
+    template <typename T>
+    class Dispatcher {
+        public:
+            using Handler = std::function<void (T &)>;
+
+            /// Turns an item into a line of text, for Overflow::spill
+            using Encode = std::function<std::string (const T &)>;
+
+            /// Turns a line written by Encode back into an item, for Overflow::spill
+            using Decode = std::function<T (const std::string &)>;
+
+            /// Told the sequence number of each item (the order it was published in, from 0)
+            /// once a handler has finished with it or it has been thrown away
+            using Finished = std::function<void (uint64_t)>;
+
+            /**
+             * @brief Construct a new Dispatcher and start its workers
+             *
+             * @param policy The size of the queue, the number of workers and what to do when
+             * the queue is full
+             * @param handler Called with each item on one of the workers
+             * @param encode Saves an item that is spilled to disk (only needed for Overflow::spill)
+             * @param decode Loads an item that was spilled to disk (only needed for Overflow::spill)
+             * @param finished If not null, called on the worker once the handler has returned for
+             * an item, or wherever the item was thrown away. It isn't called for items whose
+             * handler threw, or that were never handled because the dispatcher was destroyed
+             * or publishing was cancelled.
+             * @throws std::invalid_argument if the policy spills but encode or decode is missing
+             * @throws errors::FileOperationError if the spill file can't be opened
+             */
+            Dispatcher (const DispatchPolicy & policy, Handler handler, Encode encode = nullptr, Decode decode = nullptr,
+                        Finished finished = nullptr)
+                : _queue(policy.capacity) {
+                if (policy.overflow == Overflow::spill && (encode == nullptr || decode == nullptr)) {
+                    throw std::invalid_argument("Spilling to disk needs a way to encode and decode items");
+                }
+                _policy = policy;
+                _handler = std::move(handler);
+                _encode = std::move(encode);
+                _decode = std::move(decode);
+                _finished = std::move(finished);
+                _sequence = 0;
+                _closing = false;
+                _stopping = false;
+                _failed = false;
+                _idle = 0;
+                _blocked = 0;
+                _lag = 0;
+                _dropped = 0;
+                _spilled = 0;
+                _spillcount = 0;
+                _readoffset = 0;
+                _metrics = nullptr;
+                if (_policy.overflow == Overflow::spill) {
+                    if (_policy.spillfile == "") {
+                        std::ostringstream name;
+                        name << "crawpp-" << _policy.name << "-" << static_cast<const void *>(this) << ".spill";
+                        _policy.spillfile = (std::filesystem::temp_directory_path() / name.str()).string();
+                    }
+                    _spill.open(_policy.spillfile, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+                    if (!_spill.is_open()) {
+                        throw errors::FileOperationError("Could not open \"" + _policy.spillfile + "\" to spill items to.");
+                    }
+                }
+                for (unsigned i = 0; i < std::max(_policy.workers, 1u); i++) {
+                    _workers.emplace_back(&Dispatcher::_run, this);
+                }
+            }
+
+            /**
+             * @brief Stop the workers once they have finished the items they are handling.
+             * Items still queued are dropped; call close() first to handle them.
+             */
+            ~Dispatcher () {
+                _stopping = true;
+                _join();
+                for (const std::string & gauge : _gauges) {
+                    _metrics->removegauge(gauge);
+                }
+                if (_spill.is_open()) {
+                    _spill.close();
+                    std::remove(_policy.spillfile.c_str());
+                }
+            }
+
+            Dispatcher (const Dispatcher &) = delete;
+            Dispatcher & operator= (const Dispatcher &) = delete;
+
+            /**
+             * @brief Queue an item to be handled. Must not be called after close().
+             *
+             * @param item The item
+             * @param cancellation Stops waiting for room in the queue with Overflow::block
+             * (default: none)
+             * @return bool Whether the item was queued (or spilled), rather than dropped
+             * because waiting for room was cancelled
+             */
+            bool publish (T item, const CancellationToken & cancellation = CancellationToken::none()) {
+                Entry entry{std::move(item), "", std::chrono::steady_clock::now(), _sequence++};
+                if (_policy.overflow == Overflow::spill) {
+                    // once anything has been spilled, the rest has to go after it to stay in order
+                    if (_spillcount > 0 || !_queue.push(entry)) {
+                        _write(entry);
+                    }
+                } else if (_policy.overflow == Overflow::dropoldest) {
+                    while (!_queue.push(entry)) {
+                        if (std::optional<Entry> oldest = _queue.pop()) {
+                            _dropped++;
+                            _finish(oldest->sequence);
+                        }
+                    }
+                } else {
+                    while (!_queue.push(entry)) {
+                        if (cancellation.cancelled() || _stopping) {
+                            return false;
+                        }
+                        std::unique_lock<std::mutex> guard(_lock);
+                        _blocked++;
+                        // the workers only signal this when they see someone waiting, so check every so often
+                        _space.wait_for(guard, std::chrono::milliseconds(10));
+                        _blocked--;
+                    }
+                }
+                if (_idle > 0) {
+                    _ready.notify_one();
+                }
+                return true;
+            }
+
+            /**
+             * @brief Wait for every item that has been published to be handled, then stop the
+             * workers.
+             *
+             * @throws The first exception thrown by the handler, if any
+             */
+            void close () {
+                _closing = true;
+                _ready.notify_all();
+                _join();
+                if (_error != nullptr) {
+                    std::rethrow_exception(_error);
+                }
+            }
+
+            /**
+             * @brief Whether the handler has thrown. The workers carry on regardless, and the
+             * exception is rethrown by close().
+             */
+            bool failed () const {
+                return _failed;
+            }
+
+            /**
+             * @brief How many items are waiting for a handler, including spilled items
+             */
+            size_t depth () const {
+                return _queue.size() + _spillcount;
+            }
+
+            /**
+             * @brief How long, in seconds, the item that was most recently handed to a handler
+             * had waited since it was published
+             */
+            double lag () const {
+                return std::chrono::duration<double>(std::chrono::nanoseconds(_lag.load())).count();
+            }
+
+            /**
+             * @brief How many items have been thrown away with Overflow::dropoldest, or because
+             * a spilled item couldn't be written, read back or decoded
+             */
+            uint64_t dropped () const {
+                return _dropped;
+            }
+
+            /**
+             * @brief How many items have been spilled to disk in all
+             */
+            uint64_t spilled () const {
+                return _spilled;
+            }
+
+            /**
+             * @brief Export the dispatcher's depth, lag and counts as gauges, named after
+             * DispatchPolicy::name, until the dispatcher is destroyed.
+             *
+             * @param metrics The metrics to add the gauges to, e.g. a Reddit instance's
+             */
+            void exportto (Metrics & metrics) {
+                _metrics = &metrics;
+                _gauges = {_policy.name + "_queue_depth", _policy.name + "_queue_lag_seconds",
+                           _policy.name + "_dropped", _policy.name + "_spilled"};
+                metrics.gauge(_gauges[0], "Items waiting for a handler", [this] { return static_cast<double>(depth()); });
+                metrics.gauge(_gauges[1], "How long the latest item waited for a handler", [this] { return lag(); });
+                metrics.gauge(_gauges[2], "Items thrown away because the queue was full or they couldn't be spilled", [this] { return static_cast<double>(dropped()); });
+                metrics.gauge(_gauges[3], "Items spilled to disk because the queue was full", [this] { return static_cast<double>(spilled()); });
+            }
+
+        private:
+            /// An item, or a spilled item that hasn't been decoded yet
+            struct Entry {
+                std::optional<T> item;
+                std::string encoded;
+                std::chrono::steady_clock::time_point published;
+                uint64_t sequence;
+            };
+
+            DispatchPolicy _policy;
+            Handler _handler;
+            Encode _encode;
+            Decode _decode;
+            Finished _finished;
+
+            /// The sequence number of the next item to be published
+            std::atomic<uint64_t> _sequence;
+
+            BoundedQueue<Entry> _queue;
+            std::vector<std::thread> _workers;
+
+            /// Whether the workers should stop once everything has been handled
+            std::atomic<bool> _closing;
+
+            /// Whether the workers should stop straight away
+            std::atomic<bool> _stopping;
+
+            /// Guards the error, and lets workers and publishers wait
+            std::mutex _lock;
+            std::condition_variable _ready;
+            std::condition_variable _space;
+            std::exception_ptr _error;
+            std::atomic<bool> _failed;
+
+            /// The number of workers waiting for an item, and of publishers waiting for room
+            std::atomic<int> _idle;
+            std::atomic<int> _blocked;
+
+            std::atomic<int64_t> _lag;
+            std::atomic<uint64_t> _dropped;
+            std::atomic<uint64_t> _spilled;
+
+            /// The spill file, the number of items in it that haven't been queued again,
+            /// where the first of those starts, and their sequence numbers. Guarded by _spilllock.
+            std::mutex _spilllock;
+            std::fstream _spill;
+            std::atomic<size_t> _spillcount;
+            std::streamoff _readoffset;
+            std::deque<uint64_t> _spillsequences;
+
+            Metrics * _metrics;
+            std::vector<std::string> _gauges;
+
+            void _join () {
+                _ready.notify_all();
+                for (std::thread & worker : _workers) {
+                    if (worker.joinable()) {
+                        worker.join();
+                    }
+                }
+            }
+
+            void _run () {
+                while (!_stopping) {
+                    std::optional<Entry> entry = _queue.pop();
+                    if (!entry.has_value()) {
+                        if (_unspill()) {
+                            continue;
+                        }
+                        if (_closing && _queue.size() == 0 && _spillcount == 0) {
+                            return;
+                        }
+                        std::unique_lock<std::mutex> guard(_lock);
+                        _idle++;
+                        // publishers only signal this when they see someone waiting, so check every so often
+                        _ready.wait_for(guard, std::chrono::milliseconds(10));
+                        _idle--;
+                        continue;
+                    }
+                    if (_blocked > 0) {
+                        _space.notify_one();
+                    }
+                    _lag = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - entry->published).count();
+                    try {
+                        if (!entry->item.has_value()) {
+                            try {
+                                entry->item.emplace(_decode(entry->encoded));
+                            } catch (const std::exception &) {
+                                _dropped++;
+                                _finish(entry->sequence);
+                                continue;
+                            }
+                        }
+                        _handler(*entry->item);
+                        _finish(entry->sequence);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> guard(_lock);
+                        if (_error == nullptr) {
+                            _error = std::current_exception();
+                        }
+                        _failed = true;
+                    }
+                }
+            }
+
+            /// Tell the finished callback (if any) that an item has been handled or thrown away
+            void _finish (uint64_t sequence) {
+                if (_finished != nullptr) {
+                    _finished(sequence);
+                }
+            }
+
+            /// Append an item to the spill file, dropping it if it can't be written
+            void _write (const Entry & entry) {
+                auto published = std::chrono::duration_cast<std::chrono::nanoseconds>(entry.published.time_since_epoch()).count();
+                std::string line = nlohmann::json::array({published, _encode(*entry.item)}).dump();
+                std::lock_guard<std::mutex> guard(_spilllock);
+                _spill.clear();
+                _spill.seekp(0, std::ios::end);
+                std::streamoff end = _spill.tellp();
+                _spill << line << '\n';
+                _spill.flush();
+                if (!_spill || end < 0) {
+                    // e.g. the disk is full. Cut off whatever part of the line was written, so
+                    // that the items after it can still be read
+                    _spill.clear();
+                    if (end >= 0) {
+                        std::error_code error;
+                        std::filesystem::resize_file(_policy.spillfile, end, error);
+                    }
+                    _dropped++;
+                    _finish(entry.sequence);
+                    return;
+                }
+                _spillsequences.push_back(entry.sequence);
+                _spillcount++;
+                _spilled++;
+            }
+
+            /// Move spilled items back into the queue while there is room, returning whether any were
+            bool _unspill () {
+                if (_spillcount == 0) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> guard(_spilllock);
+                bool moved = false;
+                std::string line;
+                while (_spillcount > 0) {
+                    _spill.clear();
+                    _spill.seekg(_readoffset);
+                    if (!std::getline(_spill, line)) {
+                        break;
+                    }
+                    // tellg() fails on a last line without a newline, so work out where the next one starts
+                    std::streamoff next = _readoffset + static_cast<std::streamoff>(line.size()) + 1;
+                    uint64_t sequence = _spillsequences.front();
+                    std::optional<Entry> entry;
+                    try {
+                        nlohmann::json saved = nlohmann::json::parse(line);
+                        entry.emplace(Entry{std::nullopt, saved.at(1).get<std::string>(),
+                                            std::chrono::steady_clock::time_point(std::chrono::nanoseconds(saved.at(0).get<int64_t>())),
+                                            sequence});
+                    } catch (const nlohmann::json::exception &) {
+                        // a truncated or corrupt line: skip it rather than bringing the worker down
+                        _readoffset = next;
+                        _spillcount--;
+                        _spillsequences.pop_front();
+                        _dropped++;
+                        _finish(sequence);
+                        continue;
+                    }
+                    if (!_queue.push(*entry)) {
+                        break;
+                    }
+                    _readoffset = next;
+                    _spillcount--;
+                    _spillsequences.pop_front();
+                    moved = true;
+                }
+                if (_spillcount == 0) {
+                    // start the file again, so that it only grows as big as the longest backlog
+                    _spill.close();
+                    _spill.open(_policy.spillfile, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+                    _readoffset = 0;
+                }
+                return moved;
+            }
+    };
+}
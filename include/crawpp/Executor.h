@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace CRAW {
+
+    /**
+     * @brief A structure representing how many threads a Reddit instance's Executor has and
+     * what the library uses it for.
+     */
+    struct ExecutorPolicy {
+        /// Whether the library hands work to the executor (default: false). The executor can
+        /// be used for callbacks with Reddit::executor() either way.
+        bool enabled;
+
+        /// How many worker threads to start (default: 0, which starts one per CPU)
+        unsigned threads;
+
+        /// The CPUs to pin the workers to, in turn (default: empty, which leaves them to the
+        /// operating system). Only supported on Linux.
+        std::vector<int> cpus;
+
+        /// Lists with at least this many items are turned into objects on several workers
+        /// at once (default: 32)
+        size_t splitsize;
+
+        ExecutorPolicy () {
+            enabled = false;
+            threads = 0;
+            splitsize = 32;
+        }
+    };
+
+    /**
+     * @brief A pool of worker threads that share out tasks by work stealing.
+     *
+     * Each worker has its own queue of tasks. Tasks submitted from a worker go on that
+     * worker's queue and are run newest first, so related work stays on one core; tasks
+     * submitted from other threads are shared between the workers. A worker that runs out
+     * of tasks takes the oldest task from another worker's queue.
+     *
+     * Tasks should not block for long (e.g. by sending requests), because that keeps a
+     * worker from running anything else. A task that waits on another task should do so
+     * with wait(), which runs other tasks in the meantime.
+     */
+    class Executor {
+        public:
+            using Task = std::function<void ()>;
+
+            Executor ();
+
+            /**
+             * @brief Stop the workers. Tasks that haven't started yet are dropped.
+             */
+            ~Executor ();
+
+            Executor (const Executor &) = delete;
+            Executor & operator= (const Executor &) = delete;
+
+            /**
+             * @brief Start the workers, if they haven't been started already
+             *
+             * @param policy How many workers to start, and which CPUs to pin them to
+             */
+            void start (const ExecutorPolicy & policy);
+
+            /**
+             * @brief The number of workers (0 before start())
+             */
+            size_t size () const;
+
+            /**
+             * @brief Whether the calling thread is one of this executor's workers
+             */
+            bool onworker () const;
+
+            /**
+             * @brief Run a task on a worker, and forget about it.
+             *
+             * @param task The task, which should not throw
+             * @param delay How long to wait before running it (default: 0)
+             */
+            void post (Task task, std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+            /**
+             * @brief Run a function on a worker.
+             *
+             * @param function The function to run
+             * @return std::future The function's result, or the exception that it threw
+             */
+            template <typename F>
+            std::future<std::invoke_result_t<F>> submit (F function) {
+                auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F> ()>>(std::move(function));
+                std::future<std::invoke_result_t<F>> result = task->get_future();
+                post([task] { (*task)(); });
+                return result;
+            }
+
+            /**
+             * @brief Wait for a future, running other tasks in the meantime if called from a
+             * worker.
+             *
+             * @param future A future, e.g. from submit()
+             * @return The future's result
+             * @throws Whatever the task that produced the future threw
+             */
+            template <typename T>
+            T wait (std::future<T> & future) {
+                while (onworker() && future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    if (!_runone()) {
+                        future.wait_for(std::chrono::milliseconds(1));
+                    }
+                }
+                return future.get();
+            }
+
+            /**
+             * @brief Call a function for each of count indices, spread across the workers,
+             * and collect the results in order.
+             *
+             * The calling thread does its share of the work. If the executor hasn't been
+             * started, everything is run on the calling thread.
+             *
+             * @param count The number of indices
+             * @param function Called with each index from 0 to count - 1
+             * @return std::vector The results, in order of index
+             * @throws The first exception thrown by function, once every call has finished
+             */
+            template <typename F>
+            auto map (size_t count, F function) -> std::vector<std::invoke_result_t<F, size_t>> {
+                using R = std::invoke_result_t<F, size_t>;
+                std::vector<std::optional<R>> slots(count);
+                size_t chunks = std::min(count, size() + 1);
+                auto run = [&] (size_t chunk) {
+                    for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; i++) {
+                        slots[i].emplace(function(i));
+                    }
+                };
+                std::vector<std::future<void>> pending;
+                for (size_t chunk = 1; chunk < chunks; chunk++) {
+                    pending.push_back(submit([&run, chunk] { run(chunk); }));
+                }
+                std::exception_ptr error;
+                try {
+                    if (chunks > 0) {
+                        run(0);
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                // every chunk has to finish before slots goes out of scope
+                for (auto & future : pending) {
+                    try {
+                        wait(future);
+                    } catch (...) {
+                        if (error == nullptr) {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+                if (error != nullptr) {
+                    std::rethrow_exception(error);
+                }
+                std::vector<R> results;
+                results.reserve(count);
+                for (auto & slot : slots) {
+                    results.push_back(std::move(*slot));
+                }
+                return results;
+            }
+
+        private:
+            struct Worker {
+                /// Tasks posted from this worker, oldest first
+                std::deque<Task> tasks;
+                std::mutex lock;
+                std::thread thread;
+            };
+
+            std::vector<std::unique_ptr<Worker>> _workers;
+
+            /// The number of workers, once they have all been started
+            std::atomic<size_t> _size;
+
+            /// Guards everything below, and starting the workers
+            std::mutex _lock;
+            std::condition_variable _wakeup;
+
+            /// Tasks posted from other threads, oldest first
+            std::deque<Task> _injected;
+
+            /// Tasks posted with a delay, by when they are due
+            std::multimap<std::chrono::steady_clock::time_point, Task> _timed;
+
+            /// The number of tasks in all the queues, not counting delayed tasks
+            std::atomic<long> _queued;
+
+            std::atomic<bool> _stopping;
+
+            /// Run one queued task on the calling worker, if there is one
+            bool _runone ();
+
+            /// Run a worker until the executor is destroyed
+            void _run (size_t index);
+    };
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /**
+     * @brief Why a lookup that doesn't throw came back empty. Each code stands for the
+     * exception that the throwing version would have thrown.
+     */
+    enum class ErrorCode {
+        /// There was no error
+        none = 0,
+
+        /// The item doesn't exist, or was deleted or banned (errors::NotFoundError)
+        notfound,
+
+        /// The item is private, quarantined or otherwise hidden (errors::UnauthorisedError)
+        unauthorised,
+
+        /// The request failed, or the response couldn't be understood (errors::CommunicationError)
+        communication,
+
+        /// The CancellationToken was cancelled or its deadline passed (errors::CancelledError)
+        cancelled
+    };
+
+    /**
+     * @brief Either an item or the ErrorCode saying why there isn't one, for calls that
+     * report misses without throwing.
+     *
+     * Misses are cheap: no exception is thrown and no message is built unless value() is
+     * called on an Expected that doesn't have one.
+     *
+     * @code
+     * CRAW::Expected<CRAW::Subreddit> subreddit = reddit.trysubreddit("cpp");
+     * if (subreddit) {
+     *     std::cout << subreddit->subscribers << std::endl;
+     * } else if (subreddit.error() == CRAW::ErrorCode::notfound) {
+     *     // ...
+     * }
+     * @endcode
+     *
+     * @tparam T The type of item
+     */
+    template <typename T>
+    class Expected {
+        public:
+            /**
+             * @brief Construct an Expected that has an item
+             */
+            Expected (T value) : _value(std::move(value)), _error(ErrorCode::none) {}
+
+            /**
+             * @brief Construct an Expected that has no item, because of an error
+             *
+             * @param error Why there is no item (not ErrorCode::none)
+             */
+            Expected (ErrorCode error) : _error(error) {}
+
+            /**
+             * @brief Whether there is an item
+             */
+            bool has_value () const {
+                return _value.has_value();
+            }
+
+            explicit operator bool () const {
+                return _value.has_value();
+            }
+
+            /**
+             * @brief Why there is no item, or ErrorCode::none if there is one
+             */
+            ErrorCode error () const {
+                return _error;
+            }
+
+            /**
+             * @brief The item
+             *
+             * @throws The exception that the ErrorCode stands for, if there is no item
+             */
+            T & value () {
+                _check();
+                return *_value;
+            }
+
+            const T & value () const {
+                _check();
+                return *_value;
+            }
+
+            /**
+             * @brief The item, which must be there (check first with has_value())
+             */
+            T & operator* () {
+                return *_value;
+            }
+
+            const T & operator* () const {
+                return *_value;
+            }
+
+            T * operator-> () {
+                return &*_value;
+            }
+
+            const T * operator-> () const {
+                return &*_value;
+            }
+
+        private:
+            std::optional<T> _value;
+            ErrorCode _error;
+
+            void _check () const {
+                switch (_error) {
+                    case ErrorCode::none:
+                        return;
+                    case ErrorCode::notfound:
+                        throw errors::NotFoundError("The item could not be found.");
+                    case ErrorCode::unauthorised:
+                        throw errors::UnauthorisedError("You aren't allowed to access the item.");
+                    case ErrorCode::cancelled:
+                        throw errors::CancelledError("The lookup was cancelled.");
+                    default:
+                        throw errors::CommunicationError("The item could not be fetched.");
+                }
+            }
+    };
+}
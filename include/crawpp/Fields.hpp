@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+namespace CRAW {
+
+    /**
+     * @brief Fields of Subreddits and Redditors that can be read with Subreddit::get() and
+     * Redditor::get().
+     *
+     * Each field is a type, which names the key in the object's information, the C++ type
+     * it is read as, and which objects have it. Reading a field is a single lookup of a
+     * key that is fixed at compile time, with no string conversions, so it is much faster
+     * than operator[]. Misspelling a field, or reading a Subreddit's field from a Redditor,
+     * fails to compile.
+     *
+     * @code
+     * if (!subreddit.get<CRAW::fields::over18>() && subreddit.has<CRAW::fields::subscribers>()) {
+     *     int64_t subscribers = subreddit.get<CRAW::fields::subscribers>();
+     *     const std::string & title = subreddit.get<CRAW::fields::title>();  // not copied
+     * }
+     * @endcode
+     */
+    namespace fields {
+
+        /**
+         * @brief The base of every field
+         *
+         * @tparam T The C++ type the field is read as
+         * @tparam OnSubreddit Whether subreddits have the field
+         * @tparam OnRedditor Whether Redditors have the field
+         */
+        template <typename T, bool OnSubreddit, bool OnRedditor>
+        struct Field {
+            using type = T;
+            static constexpr bool subreddit = OnSubreddit;
+            static constexpr bool redditor = OnRedditor;
+        };
+
+        /// What reading a field gives: a reference for strings, so they aren't copied, and a value otherwise
+        template <typename F>
+        using result = std::conditional_t<std::is_same_v<typename F::type, std::string>, const std::string &, typename F::type>;
+
+        /**
+         * @brief Whether an object's information has a field that isn't null
+         */
+        template <typename F>
+        bool present (const nlohmann::json & information) {
+            auto found = information.find(F::key);
+            return found != information.end() && !found->is_null();
+        }
+
+        /**
+         * @brief Read a field from an object's information
+         *
+         * @throws std::invalid_argument if the field is missing or null
+         * @throws nlohmann::json::type_error if Reddit sent the field as a different type
+         */
+        template <typename F>
+        result<F> read (const nlohmann::json & information) {
+            auto found = information.find(F::key);
+            if (found == information.end() || found->is_null()) {
+                throw std::invalid_argument("Attribute " + std::string(F::key) + " doesn't exist.");
+            }
+            if constexpr (std::is_same_v<typename F::type, std::string>) {
+                return found->template get_ref<const std::string &>();
+            } else if constexpr (std::is_same_v<typename F::type, bool>) {
+                return found->template get_ref<const bool &>();
+            } else {
+                return found->template get<typename F::type>();
+            }
+        }
+
+        // both
+
+        /// A subreddit's fullname (e.g. "t5_2qh1i"), or a Redditor's username
+        struct name : Field<std::string, true, true> { static constexpr std::string_view key = "name"; };
+
+        /// The id, without the type prefix of the fullname
+        struct id : Field<std::string, true, true> { static constexpr std::string_view key = "id"; };
+
+        /// When the subreddit or account was created (UTC)
+        struct created_utc : Field<time_t, true, true> { static constexpr std::string_view key = "created_utc"; };
+
+        /// The URL of the icon or avatar
+        struct icon_img : Field<std::string, true, true> { static constexpr std::string_view key = "icon_img"; };
+
+        // subreddits
+
+        /// The subreddit's name, not including the r/
+        struct display_name : Field<std::string, true, false> { static constexpr std::string_view key = "display_name"; };
+
+        /// The subreddit's title
+        struct title : Field<std::string, true, false> { static constexpr std::string_view key = "title"; };
+
+        /// The short description shown in search results and the sidebar
+        struct public_description : Field<std::string, true, false> { static constexpr std::string_view key = "public_description"; };
+
+        /// The sidebar, in Markdown
+        struct description : Field<std::string, true, false> { static constexpr std::string_view key = "description"; };
+
+        /// The number of subscribers (null in some listings, such as /api/info)
+        struct subscribers : Field<int64_t, true, false> { static constexpr std::string_view key = "subscribers"; };
+
+        /// How many people on the subreddit are here now (null in some listings)
+        struct active_user_count : Field<int64_t, true, false> { static constexpr std::string_view key = "active_user_count"; };
+
+        /// Whether the subreddit is marked not safe for work
+        struct over18 : Field<bool, true, false> { static constexpr std::string_view key = "over18"; };
+
+        /// Whether the subreddit is quarantined
+        struct quarantine : Field<bool, true, false> { static constexpr std::string_view key = "quarantine"; };
+
+        /// Whether there are posting restrictions
+        struct restrict_posting : Field<bool, true, false> { static constexpr std::string_view key = "restrict_posting"; };
+
+        /// "public", "private", "restricted", "archived", "user" and so on
+        struct subreddit_type : Field<std::string, true, false> { static constexpr std::string_view key = "subreddit_type"; };
+
+        /// "any", "link" or "self"
+        struct submission_type : Field<std::string, true, false> { static constexpr std::string_view key = "submission_type"; };
+
+        /// The subreddit's language
+        struct lang : Field<std::string, true, false> { static constexpr std::string_view key = "lang"; };
+
+        /// The subreddit's path, e.g. "/r/cpp/"
+        struct url : Field<std::string, true, false> { static constexpr std::string_view key = "url"; };
+
+        /// Whether posts can be marked as spoilers
+        struct spoilers_enabled : Field<bool, true, false> { static constexpr std::string_view key = "spoilers_enabled"; };
+
+        /// Whether the current user is subscribed (null if not authenticated)
+        struct user_is_subscriber : Field<bool, true, false> { static constexpr std::string_view key = "user_is_subscriber"; };
+
+        /// Whether the current user is a moderator (null if not authenticated)
+        struct user_is_moderator : Field<bool, true, false> { static constexpr std::string_view key = "user_is_moderator"; };
+
+        /// Whether the current user is banned (null if not authenticated)
+        struct user_is_banned : Field<bool, true, false> { static constexpr std::string_view key = "user_is_banned"; };
+
+        // Redditors
+
+        /// The total number of karma points
+        struct total_karma : Field<int64_t, false, true> { static constexpr std::string_view key = "total_karma"; };
+
+        /// The number of karma points earned from posts
+        struct link_karma : Field<int64_t, false, true> { static constexpr std::string_view key = "link_karma"; };
+
+        /// The number of karma points earned from comments
+        struct comment_karma : Field<int64_t, false, true> { static constexpr std::string_view key = "comment_karma"; };
+
+        /// The number of karma points earned from getting awards
+        struct awardee_karma : Field<int64_t, false, true> { static constexpr std::string_view key = "awardee_karma"; };
+
+        /// The number of karma points earned from giving out awards
+        struct awarder_karma : Field<int64_t, false, true> { static constexpr std::string_view key = "awarder_karma"; };
+
+        /// Whether the account has Reddit Premium
+        struct is_gold : Field<bool, false, true> { static constexpr std::string_view key = "is_gold"; };
+
+        /// Whether the Redditor moderates any subreddit
+        struct is_mod : Field<bool, false, true> { static constexpr std::string_view key = "is_mod"; };
+
+        /// Whether the Redditor is a Reddit employee
+        struct is_employee : Field<bool, false, true> { static constexpr std::string_view key = "is_employee"; };
+
+        /// Whether the account is verified
+        struct verified : Field<bool, false, true> { static constexpr std::string_view key = "verified"; };
+
+        /// Whether the account has a verified email address
+        struct has_verified_email : Field<bool, false, true> { static constexpr std::string_view key = "has_verified_email"; };
+
+        /// Whether the account is suspended
+        struct is_suspended : Field<bool, false, true> { static constexpr std::string_view key = "is_suspended"; };
+
+        /// Whether the Redditor can be followed
+        struct accept_followers : Field<bool, false, true> { static constexpr std::string_view key = "accept_followers"; };
+    }
+}
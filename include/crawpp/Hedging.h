@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crawpp/Executor.h"
+#include "crawpp/Metrics.h"
+#include "crawpp/Transport.h"
+
+namespace CRAW {
+
+    /**
+     * @brief A structure representing when a Reddit instance hedges its GET requests.
+     *
+     * A hedged request is sent again if it hasn't been answered within a high percentile
+     * of the endpoint's recent latency, and whichever copy is answered first is used. This
+     * cuts the tail latency caused by the occasional slow backend, at the cost of some
+     * extra requests. Only GETs are hedged, since they are safe to send twice.
+     *
+     * Hedging is off by default. The hedger measures each endpoint's latency itself, so it
+     * works whether or not Reddit::metrics is enabled.
+     */
+    struct HedgePolicy {
+        /// Whether to hedge GET requests (default: false)
+        bool enabled;
+
+        /// The percentile of an endpoint's recent latency to wait for before hedging (default: 0.95)
+        double percentile;
+
+        /// The shortest to wait before hedging, however fast the endpoint usually is (default: 20 ms)
+        std::chrono::milliseconds mindelay;
+
+        /// How many of an endpoint's requests its latency is measured over, and so how many
+        /// must have been made before it is hedged at all (default: 200)
+        uint64_t window;
+
+        /// The most hedges that can be sent, as a fraction of the requests made (default: 0.05)
+        double budget;
+
+        /// Don't hedge while Reddit's rate limit has fewer requests than this left (default: 100)
+        long ratelimitreserve;
+
+        /// The most copies of hedgeable requests that can be in flight at once, which is also
+        /// how many threads the hedger sends them from. Requests made while this many are in
+        /// flight are sent without hedging (default: 32). The number of threads is fixed the
+        /// first time a request is hedged.
+        long maxinflight;
+
+        HedgePolicy () {
+            enabled = false;
+            percentile = 0.95;
+            mindelay = std::chrono::milliseconds(20);
+            window = 200;
+            budget = 0.05;
+            ratelimitreserve = 100;
+            maxinflight = 32;
+        }
+    };
+
+    /**
+     * @brief What a hedge has to get past before it is sent, besides the Hedger's own budget,
+     * such as the Scheduler and the ConcurrencyLimiter of the Reddit instance sending it.
+     */
+    struct HedgeGate {
+        /// Take what a hedge needs to be sent without waiting for it, returning false if
+        /// the hedge should be skipped (default: none, which lets every hedge through)
+        std::function<bool ()> admit;
+
+        /// Called once a hedge that was let through has been answered, with whether it was
+        /// aborted (because the original was answered first, or because it was never sent),
+        /// and whether it was sent at all: it isn't when the transport throws, e.g. because
+        /// a CircuitBreakerTransport's circuit is open (default: none)
+        std::function<void (const HTTPResponse &, bool, bool)> answered;
+    };
+
+    /**
+     * @brief Sends hedged requests for a Reddit instance.
+     *
+     * A request that may be hedged, and its hedge if one is sent, are each handed to the
+     * transport's sendasync() from a pool of HedgePolicy::maxinflight threads, so that
+     * whichever is answered first can be returned without waiting for the other to be
+     * aborted. A transport that doesn't block in sendasync() (such as a MultiplexTransport)
+     * frees the thread straight away. Hedges are scheduled on a timer thread. Both are
+     * started the first time a request is hedged, and stopped with the hedger.
+     *
+     * Every hedge is charged against a budget that grows with the number of requests,
+     * against Reddit's rate limit as reported in the X-Ratelimit-Remaining header, and
+     * against the HedgeGate it is sent with.
+     */
+    class Hedger {
+        public:
+            Hedger ();
+            ~Hedger ();
+            Hedger (const Hedger &) = delete;
+            Hedger & operator= (const Hedger &) = delete;
+
+            /**
+             * @brief Send a request, hedging it if it is slow and the policy allows.
+             *
+             * @param transport The transport to send the request and any hedge with
+             * @param request The request to send
+             * @param policy When to hedge
+             * @param endpoint The template of the request's endpoint (see endpointtemplate()),
+             * whose recent latency decides how long to wait before hedging
+             * @param gate What a hedge has to get past before it is sent
+             * @param metrics The metrics of the request's endpoint, where hedges are counted
+             * (nullptr if metrics are disabled)
+             * @return HTTPResponse The first usable response to either copy of the request
+             */
+            HTTPResponse send (const std::shared_ptr<Transport> & transport,
+                               const HTTPRequest & request,
+                               const HedgePolicy & policy,
+                               const std::string & endpoint,
+                               const HedgeGate & gate,
+                               EndpointMetrics * metrics);
+
+            /**
+             * @brief Update the remaining rate limit from a response's headers.
+             *
+             * @param response A response from the Reddit API
+             */
+            void observe (const HTTPResponse & response);
+
+        private:
+            struct Race;
+
+            /// The latency of an endpoint, as the hedger has seen it
+            struct Endpoint {
+                /// How long requests to the endpoint took to be answered, by either copy
+                Histogram latency;
+
+                /// The number of requests sent to the endpoint through the hedger
+                uint64_t requests;
+
+                /// The histogram at the start of the current window
+                HistogramSnapshot start;
+
+                /// The number of requests when the current window started
+                uint64_t windowstart;
+
+                /// How long to wait before hedging, or 0 until the first window is complete
+                std::chrono::nanoseconds delay;
+
+                Endpoint () {
+                    requests = 0;
+                    windowstart = 0;
+                    delay = std::chrono::nanoseconds(0);
+                }
+            };
+
+            /// A hedge waiting to be sent
+            struct Timer {
+                std::chrono::steady_clock::time_point when;
+                std::weak_ptr<Race> race;
+
+                bool operator> (const Timer & other) const {
+                    return when > other.when;
+                }
+            };
+
+            std::mutex _lock;
+            std::condition_variable _wakeup;
+            std::map<std::string, std::unique_ptr<Endpoint>> _endpoints;
+            std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> _timers;
+            std::thread _timerthread;
+            bool _stopping;
+
+            /// The number of copies that have been handed to the senders and not yet answered
+            long _outstanding;
+
+            /// The number of copies that have been sent from the senders or are waiting to be
+            std::atomic<long> _inflight;
+
+            /// Hedges that may still be sent, in thousandths of a hedge
+            std::atomic<int64_t> _budget;
+
+            /// The requests left in Reddit's rate limit, or -1 if it isn't known
+            std::atomic<long> _ratelimit;
+
+            /**
+             * Count a request to an endpoint, and return how long to wait before hedging it,
+             * or 0 to not hedge it
+             */
+            std::chrono::nanoseconds _delay (Endpoint & endpoint, const HedgePolicy & policy);
+
+            /**
+             * Reserve one of the senders for a copy, if fewer than the policy allows are in flight
+             */
+            bool _reserve (const HedgePolicy & policy);
+
+            /**
+             * Take a hedge out of the budget and the rate limit, if the policy allows one
+             */
+            bool _charge (const HedgePolicy & policy);
+
+            /**
+             * Put back a hedge that was charged for but not sent
+             */
+            void _refund ();
+
+            /**
+             * Send the hedges whose time has come
+             */
+            void _runtimers ();
+
+            /**
+             * Send one copy of a request, from one of the senders
+             */
+            void _sendcopy (const std::shared_ptr<Race> & race, bool hedge);
+
+            /**
+             * Handle the response to a copy, deciding the race if it is still undecided
+             */
+            void _answered (const std::shared_ptr<Race> & race, HTTPResponse response, std::exception_ptr error, bool hedge);
+
+            /**
+             * The threads that copies are sent from. This is declared last so that they are
+             * stopped before anything they use is destroyed.
+             */
+            Executor _senders;
+    };
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/Executor.h"
+#include "crawpp/ListingPage.hpp"
+
+namespace CRAW {
+
+    class Post;
+    class Comment;
+
+    /// An item of a Redditor's overview, which is either a post or a comment
+    using Activity = std::variant<Post, Comment>;
+
+    /**
+     * @brief A structure representing which part of a Redditor's history to fetch, and how much of it.
+     */
+    struct HistoryOptions {
+        /// "new", "hot", "top" or "controversial" (default: "new")
+        std::string sort;
+
+        /// "hour", "day", "week", "month", "year" or "all". Used when sorting by top or
+        /// controversial (default: "all")
+        std::string period;
+
+        /// The most pages of 100 items to fetch for each Redditor, or 0 for as many as there
+        /// are (default: 0). Reddit stops after about 1000 items.
+        size_t maxpages;
+
+        /// How many Redditors' pages may be fetched at once by Redditor::histories(), which
+        /// is also limited by the number of threads in the executor (default: 8)
+        size_t concurrency;
+
+        HistoryOptions () {
+            sort = "new";
+            period = "all";
+            maxpages = 0;
+            concurrency = 8;
+        }
+    };
+
+    /**
+     * @brief Goes through a paginated listing one item at a time, such as a Redditor's posts
+     * (see Redditor::submitted()).
+     *
+     * If the History has an executor, the next page is fetched on it while the items of
+     * the current one are being handled, so going through a long listing takes about as
+     * long as fetching it.
+     *
+     * @tparam T The type of item (e.g. Post)
+     */
+    template <typename T>
+    class History {
+        public:
+            /// Fetches the page after the one given, moving the page on
+            using FetchPage = std::function<std::vector<T> (ListingPage &, const CancellationToken &)>;
+
+            /**
+             * @brief Construct a new History. Use a method such as Redditor::submitted() rather
+             * than constructing a History directly.
+             *
+             * @param fetch Fetches a page of the listing
+             * @param maxpages The most pages to fetch, or 0 for all of them
+             * @param executor If not null, where to fetch the next page ahead of time
+             * @param cancellation Cancels the requests for the pages
+             */
+            History (FetchPage fetch, size_t maxpages, Executor * executor, const CancellationToken & cancellation) {
+                _fetch = fetch;
+                _maxpages = maxpages;
+                _executor = executor;
+                _cancellation = cancellation;
+                _stopping = cancellation.child();
+                _pages = 0;
+                _finished = false;
+            }
+
+            /**
+             * @brief Stop fetching the page that is being fetched ahead, if there is one
+             */
+            ~History () {
+                _stopping.cancel();
+            }
+
+            History (const History &) = delete;
+            History & operator= (const History &) = delete;
+            History (History &&) = default;
+            History & operator= (History &&) = default;
+
+            /**
+             * @brief The next item, fetching the next page if needed
+             *
+             * @return std::optional<T> The item, or nothing once the listing has run out
+             * @throws errors::CommunicationError (or a subclass) if a page couldn't be fetched
+             * @throws errors::CancelledError if the History's token was cancelled
+             */
+            std::optional<T> next () {
+                while (_items.empty()) {
+                    if (_ahead.has_value()) {
+                        _collect();
+                    } else if (_finished) {
+                        return std::nullopt;
+                    } else {
+                        _take(_fetch(_page, _cancellation));
+                    }
+                    if (!_finished && _executor != nullptr) {
+                        _startprefetch();
+                    }
+                }
+                T item = std::move(_items.front());
+                _items.pop_front();
+                return item;
+            }
+
+            /**
+             * @brief Fetch every remaining item
+             *
+             * @return std::vector<T> The items, in the listing's order
+             */
+            std::vector<T> all () {
+                std::vector<T> items;
+                while (std::optional<T> item = next()) {
+                    items.push_back(std::move(*item));
+                }
+                return items;
+            }
+
+            /**
+             * @brief How many pages have been fetched so far
+             */
+            size_t pages () const {
+                return _pages;
+            }
+
+        private:
+            FetchPage _fetch;
+            size_t _maxpages;
+            Executor * _executor;
+            CancellationToken _cancellation;
+
+            /// Cancels the page being fetched ahead when the History is destroyed
+            CancellationToken _stopping;
+
+            /// The last page that was fetched
+            ListingPage _page;
+            size_t _pages;
+
+            /// Whether there are no more pages to fetch
+            bool _finished;
+
+            /// Items that haven't been returned yet
+            std::deque<T> _items;
+
+            /// The page being fetched on the executor, and the page after it
+            std::optional<std::future<std::pair<std::vector<T>, ListingPage>>> _ahead;
+
+            /// Take the items of a page that was just fetched
+            void _take (std::vector<T> items) {
+                _pages++;
+                // an empty page can have an after if everything on it was removed, so don't stop on it
+                _finished = _page.after == "" || (_maxpages != 0 && _pages >= _maxpages);
+                for (T & item : items) {
+                    _items.push_back(std::move(item));
+                }
+            }
+
+            /// Start fetching the next page on the executor
+            void _startprefetch () {
+                // the task may outlive the History, so it mustn't touch it
+                _ahead = _executor->submit([page = _page, fetch = _fetch, stopping = _stopping] () mutable {
+                    std::vector<T> items = fetch(page, stopping);
+                    return std::make_pair(std::move(items), page);
+                });
+            }
+
+            /// Wait for the page being fetched ahead and take its items
+            void _collect () {
+                std::future<std::pair<std::vector<T>, ListingPage>> ahead = std::move(*_ahead);
+                _ahead.reset();
+                std::pair<std::vector<T>, ListingPage> result;
+                try {
+                    result = _executor->wait(ahead);
+                } catch (...) {
+                    _finished = true;
+                    throw;
+                }
+                _page = result.second;
+                _take(std::move(result.first));
+            }
+    };
+}
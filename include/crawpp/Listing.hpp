@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace CRAW {
+
+    /**
+     * @brief How to sort a listing of posts
+     */
+    enum class Sort {
+        hot,
+
+        /// Newest first ("new")
+        newest,
+
+        rising,
+
+        /// Highest scoring first, over a Period
+        top,
+
+        /// Most controversial first, over a Period
+        controversial
+    };
+
+    /**
+     * @brief The period that a listing sorted by Sort::top or Sort::controversial covers
+     */
+    enum class Period {
+        hour,
+        day,
+        week,
+        month,
+        year,
+        all
+    };
+
+    /**
+     * @brief Which way to flip through the pages of a listing from a ListingPage
+     */
+    enum class Direction {
+        after,
+        before
+    };
+
+    /**
+     * @brief The part of a listing's path for a sort, e.g. "new"
+     */
+    constexpr std::string_view fragment (Sort sort) {
+        switch (sort) {
+            case Sort::hot: return "hot";
+            case Sort::newest: return "new";
+            case Sort::rising: return "rising";
+            case Sort::top: return "top";
+            case Sort::controversial: return "controversial";
+        }
+        return "hot";
+    }
+
+    /**
+     * @brief The value of a listing's t parameter for a period, e.g. "week"
+     */
+    constexpr std::string_view fragment (Period period) {
+        switch (period) {
+            case Period::hour: return "hour";
+            case Period::day: return "day";
+            case Period::week: return "week";
+            case Period::month: return "month";
+            case Period::year: return "year";
+            case Period::all: return "all";
+        }
+        return "all";
+    }
+
+    /**
+     * @brief The name of a listing's parameter for a direction, "after" or "before"
+     */
+    constexpr std::string_view fragment (Direction direction) {
+        return direction == Direction::before ? "before" : "after";
+    }
+
+    /**
+     * @brief Whether a sort is over a Period, and so takes the t parameter
+     */
+    constexpr bool periodic (Sort sort) {
+        return sort == Sort::top || sort == Sort::controversial;
+    }
+
+    /**
+     * @brief A request for a listing of a subreddit's posts, built once by Subreddit::listing()
+     * and then sent as many times as needed with Subreddit::posts().
+     *
+     * The path and the parameters that don't change from page to page are put together
+     * when the ListingRequest is made, so polling with one doesn't build or check anything
+     * again.
+     */
+    struct ListingRequest {
+        /// How the posts are sorted
+        Sort sort;
+
+        /// The period they are sorted over (only sent for Sort::top and Sort::controversial)
+        Period period;
+
+        /// How many posts to fetch per page, or 0 for Reddit's default (25). The limit is
+        /// only sent when it isn't the default.
+        int limit;
+
+        /// The URL of the first page, with its parameters, e.g. "/r/cpp/top?limit=100&t=week"
+        /// or "/r/cpp/hot"
+        std::string url;
+
+        ListingRequest () {
+            sort = Sort::hot;
+            period = Period::all;
+            limit = 0;
+            url = "";
+        }
+    };
+}
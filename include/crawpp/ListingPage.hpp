@@ -1,7 +1,13 @@
 #pragma once
 
+#include <optional>
 #include <string>
 
+#include <nlohmann/json.hpp>
+
+#include "crawpp/Checkpoint.h"
+#include "crawpp/crawexceptions.hpp"
+
 namespace CRAW {
     /**
      * @brief A structure used to flip forward/backwards through
@@ -22,5 +28,38 @@ namespace CRAW {
             after = "";
             before = "";
         }
+
+        /**
+         * @brief Save the page to a file, e.g. after each page of a long crawl, so that the
+         * crawl can carry on from it after a restart. The file is replaced atomically.
+         *
+         * @param path The file to write
+         * @throws errors::FileOperationError if the file can't be written
+         */
+        void save (const std::string & path) const {
+            writeatomically(path, nlohmann::json{{"after", after}, {"before", before}}.dump());
+        }
+
+        /**
+         * @brief Load a page saved by save()
+         *
+         * @param path The file to read
+         * @return ListingPage The saved page, or the first page if the file doesn't exist
+         * @throws errors::FileOperationError if the file can't be read or isn't a saved page
+         */
+        static ListingPage load (const std::string & path) {
+            ListingPage page;
+            std::optional<std::string> contents = readfile(path);
+            if (!contents.has_value()) {
+                return page;
+            }
+            nlohmann::json saved = nlohmann::json::parse(*contents, nullptr, false);
+            if (!saved.is_object() || !saved["after"].is_string() || !saved["before"].is_string()) {
+                throw errors::FileOperationError("\"" + path + "\" is not a saved listing page.");
+            }
+            page.after = saved["after"].get<std::string>();
+            page.before = saved["before"].get<std::string>();
+            return page;
+        }
     };
 }
\ No newline at end of file
@@ -31,6 +31,11 @@ namespace CRAW {
              * The username of the author (sender) of the message, without the u/
              */
             std::string authorname;
+            /**
+             * The fullname of the author, e.g. "t2_abc123" (empty for messages from a subreddit).
+             * Authors can be fetched in bulk with Reddit::redditors().
+             */
+            std::string authorfullname;
             /**
              * Returns a Redditor instance of the author of the message
              * @return Redditor instance representing the author of the message
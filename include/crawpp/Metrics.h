@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CRAW {
+
+    /**
+     * @brief Turn the path of a request into the template of its endpoint, so that
+     * requests to the same endpoint can be grouped together.
+     *
+     * The query string is removed and the names and IDs in the path are replaced by
+     * placeholders, e.g. "/r/cpp/new?after=t3_abc" becomes "/r/{sub}/new" and
+     * "/comments/abc123" becomes "/comments/{id}".
+     *
+     * @param path The path of a request
+     * @return std::string The endpoint template
+     */
+    std::string endpointtemplate (const std::string & path);
+
+    /**
+     * @brief A snapshot of a Histogram.
+     */
+    struct HistogramSnapshot {
+        /// The upper bound of each bucket, in seconds. The last bucket has no upper bound.
+        std::vector<double> bounds;
+
+        /// The number of observations in each bucket (not cumulative)
+        std::vector<uint64_t> counts;
+
+        /// The number of observations
+        uint64_t count;
+
+        /// The sum of all observations, in seconds
+        double sum;
+
+        HistogramSnapshot () {
+            count = 0;
+            sum = 0;
+        }
+
+        /**
+         * @brief Estimate a percentile by interpolating within the bucket it falls in.
+         *
+         * @param p The percentile to estimate, from 0 to 1 (e.g. 0.99)
+         * @return double The estimated percentile in seconds, or 0 if there are no observations
+         */
+        double percentile (double p) const;
+    };
+
+    /**
+     * @brief A lock-free histogram of durations.
+     *
+     * The buckets are exponential: the first holds durations up to 10 microseconds and each
+     * one after that is twice as wide as the one before, up to about 21 seconds.
+     */
+    class Histogram {
+        public:
+            /// The number of buckets, including the last one which has no upper bound
+            static constexpr int buckets = 23;
+
+            Histogram ();
+
+            /**
+             * @brief Record one observation. This is safe to call from any thread.
+             *
+             * @param duration The duration to record
+             */
+            void record (std::chrono::nanoseconds duration);
+
+            /**
+             * @brief Take a snapshot of the histogram. Observations recorded while the
+             * snapshot is being taken may or may not be included.
+             */
+            HistogramSnapshot snapshot () const;
+
+        private:
+            std::atomic<uint64_t> _counts [buckets];
+            std::atomic<uint64_t> _sum;
+    };
+
+    /**
+     * @brief A snapshot of the metrics of a single endpoint.
+     */
+    struct EndpointSnapshot {
+        /// The endpoint template, e.g. "/r/{sub}/new"
+        std::string endpoint;
+
+        /// The number of requests sent, including retries
+        uint64_t requests;
+
+        /// The number of requests that were retries of an earlier request
+        uint64_t retries;
+
+        /// The number of bytes sent in request bodies
+        uint64_t requestbytes;
+
+        /// The number of bytes received in response bodies, after decompression
+        uint64_t responsebytes;
+
+        /// The number of bytes received in response bodies as they came over the network, before decompression
+        uint64_t wirebytes;
+
+        /// The number of hedges sent (see HedgePolicy), which are not counted in requests
+        uint64_t hedges;
+
+        /// The number of hedges that were answered before the request they were a copy of
+        uint64_t hedgewins;
+
+        /// The number of responses with each status code. Status code 0 means no response was received.
+        std::map<int, uint64_t> statuses;
+
+        /// How long requests took to be answered
+        HistogramSnapshot latency;
+
+        /// How long responses took to parse
+        HistogramSnapshot parsetime;
+    };
+
+    /**
+     * @brief The metrics of a single endpoint. All members can be updated from any thread.
+     */
+    class EndpointMetrics {
+        public:
+            /// The endpoint template, e.g. "/r/{sub}/new"
+            const std::string endpoint;
+
+            std::atomic<uint64_t> requests;
+            std::atomic<uint64_t> retries;
+            std::atomic<uint64_t> requestbytes;
+            std::atomic<uint64_t> responsebytes;
+            std::atomic<uint64_t> wirebytes;
+            std::atomic<uint64_t> hedges;
+            std::atomic<uint64_t> hedgewins;
+
+            /// The number of responses with each status code, where index 0 is for no response
+            std::atomic<uint64_t> statuses [600];
+
+            Histogram latency;
+            Histogram parsetime;
+
+            EndpointMetrics (const std::string & endpoint);
+
+            /**
+             * @brief Record one request and its response.
+             *
+             * @param status The status code of the response (0 if there was no response)
+             * @param latency How long the request took
+             * @param requestbytes The size of the request's body
+             * @param responsebytes The size of the response's body
+             * @param wirebytes The size of the response's body before it was decompressed
+             * @param retry Whether the request was a retry
+             */
+            void record (long status, std::chrono::nanoseconds latency, size_t requestbytes, size_t responsebytes,
+                         size_t wirebytes, bool retry);
+
+            EndpointSnapshot snapshot () const;
+    };
+
+    /**
+     * @brief Per-endpoint metrics of the requests made by a Reddit instance.
+     *
+     * Recording is lock-free and cheap enough to leave on all the time. Endpoints are
+     * looked up in a fixed-size table; if there are ever more than 255 distinct endpoint
+     * templates, the rest are counted under "{other}".
+     *
+     * The metrics can be read with snapshot(), or exported in the Prometheus text format
+     * with prometheus().
+     */
+    class Metrics {
+        public:
+            /// The number of endpoint templates that can be tracked separately
+            static constexpr int capacity = 256;
+
+            /// Whether metrics are recorded (default: true)
+            std::atomic<bool> enabled;
+
+            Metrics ();
+            ~Metrics ();
+            Metrics (const Metrics &) = delete;
+            Metrics & operator= (const Metrics &) = delete;
+
+            /**
+             * @brief Get the metrics for the endpoint that a request path belongs to,
+             * creating them if this is the endpoint's first request.
+             *
+             * @param path The path of a request (which is passed through endpointtemplate())
+             * @return EndpointMetrics& The metrics of the endpoint
+             */
+            EndpointMetrics & endpoint (const std::string & path);
+
+            /**
+             * @brief Take a snapshot of the metrics of every endpoint that has been used.
+             *
+             * @return std::vector<EndpointSnapshot> The snapshots, sorted by endpoint template
+             */
+            std::vector<EndpointSnapshot> snapshot () const;
+
+            /**
+             * @brief Export the metrics in the Prometheus text exposition format, e.g. to serve
+             * from a /metrics endpoint.
+             *
+             * @param prefix The prefix of every metric's name (default: "crawpp")
+             * @return std::string The metrics, in the Prometheus text format
+             */
+            std::string prometheus (const std::string & prefix = "crawpp") const;
+
+            /**
+             * @brief Add a gauge: a value that goes up and down, such as the number of requests
+             * in flight, which is read whenever the metrics are exported.
+             *
+             * @param name The name of the gauge, e.g. "concurrency_limit" (the prefix is added
+             * by prometheus())
+             * @param help What the gauge measures
+             * @param read Reads the gauge. It is called from whichever thread exports the metrics.
+             */
+            void gauge (const std::string & name, const std::string & help, std::function<double ()> read);
+
+            /**
+             * @brief Remove a gauge, e.g. because whatever it reads is about to be destroyed.
+             * Once this returns, the gauge won't be read again.
+             *
+             * @param name The name that the gauge was added with
+             */
+            void removegauge (const std::string & name);
+
+            /**
+             * @brief Read every gauge.
+             *
+             * @return std::map<std::string, double> The value of each gauge, by name
+             */
+            std::map<std::string, double> gauges () const;
+
+        private:
+            struct Gauge {
+                std::string name;
+                std::string help;
+                std::function<double ()> read;
+            };
+
+            mutable std::mutex _gaugelock;
+            std::vector<Gauge> _gauges;
+
+            /// An open-addressing hash table of endpoints. Entries are only ever added.
+            std::atomic<EndpointMetrics *> _endpoints [capacity];
+
+            /// Where endpoints go when the table is full
+            EndpointMetrics _other;
+    };
+}
@@ -23,10 +23,40 @@ namespace CRAW {
              */
             void _init (const nlohmann::json & data, const nlohmann::json & comments = nlohmann::json());
 
+            /**
+             * Initialise this Post instance with the response to a request for its comments page
+             * 
+             * @param id The ID of the post
+             * @param listing The response to GET /comments/{id}
+             */
+            void _initlisting (const std::string & id, nlohmann::json & listing);
+
             /**
              * Stores the comments data from the post, which is the "children" field of a comment listing
              */
             nlohmann::json _comments;
+
+            /**
+             * Construct a Post from the response to a request for its comments page
+             * 
+             * @param id The ID of the post
+             * @param listing The response to GET /comments/{id}
+             * @param redditinstance The Reddit instance to associate with the post
+             */
+            Post (const std::string & id, nlohmann::json & listing, Reddit * redditinstance);
+
+            /**
+             * Turn the comments data into Comment objects, skipping "load more comments" placeholders
+             */
+            std::vector<Comment> _commentobjects ();
+
+            /**
+             * The URL of the post's comments page, sorted and limited as comments() was asked
+             */
+            std::string _commentsurl (const std::string & sort, unsigned int limit) const;
+
+            // so that posts can be fetched without blocking
+            friend class Reddit;
         public:
 
             /**
@@ -63,8 +93,18 @@ namespace CRAW {
 
             @param sort: How to sort the comments (default: hot)
             @param limit: How many comments to fetch (default: 50)
+            @param cancellation: Cancels the request (default: none)
             @return An std::vector of Comment objects, sorted in the specified way
             */
-            std::vector<Comment> comments (const std::string & sort, const unsigned int limit = 25);
+            std::vector<Comment> comments (const std::string & sort, const unsigned int limit = 25,
+                                           const CancellationToken & cancellation = CancellationToken::none());
+
+#ifdef CRAW_COROUTINES
+            /**
+             * @brief Fetch the top-level comments of the post without blocking (see comments())
+             */
+            Task<std::vector<Comment>> comments_co (std::string sort, unsigned int limit = 25,
+                                                    CancellationToken cancellation = CancellationToken::none());
+#endif
     };
 }
\ No newline at end of file
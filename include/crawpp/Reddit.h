@@ -1,6 +1,10 @@
 #pragma once
 
 #include <set>
+#include <mutex>
+#include <chrono>
+#include <map>
+#include <vector>
 
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
@@ -9,6 +13,17 @@
 
 #include "crawpp/CRAWObject.h"
 #include "crawpp/ListingPage.hpp"
+#include "crawpp/Stream.hpp"
+#include "crawpp/Transport.h"
+#include "crawpp/Metrics.h"
+#include "crawpp/Tracing.h"
+#include "crawpp/Cancellation.h"
+#include "crawpp/Hedging.h"
+#include "crawpp/Concurrency.h"
+#include "crawpp/Scheduler.h"
+#include "crawpp/Executor.h"
+#include "crawpp/Expected.hpp"
+#include "crawpp/Coroutine.hpp"
 
 namespace CRAW {
     // Forward-declarations of classes to avoid having header files #include each other
@@ -18,6 +33,87 @@ namespace CRAW {
     class Post;
     class Comment;
     class Message;
+    class RedditPool;
+
+    /**
+     * @brief A structure representing how a Reddit instance retries failed requests.
+     * 
+     * Requests that are rate-limited (HTTP 429) are always safe to retry. Server errors 
+     * (HTTP 5xx) and requests that received no response at all are only retried if the
+     * request is not a POST, because a POST might have taken effect anyway. The default
+     * values are sane.
+     */
+    struct RetryPolicy {
+        /// How many times to retry a request before giving up (default: 2, 0 disables retrying)
+        int maxretries;
+
+        /// How long to wait before the first retry. Each retry after that waits twice as long
+        /// as the one before (default: 200 ms)
+        std::chrono::milliseconds backoff;
+
+        /// The longest that a server-sent Retry-After header is allowed to make a retry wait (default: 30 s)
+        std::chrono::milliseconds maxwait;
+
+        RetryPolicy () {
+            maxretries = 2;
+            backoff = std::chrono::milliseconds(200);
+            maxwait = std::chrono::seconds(30);
+        }
+    };
+
+    /**
+     * @brief How long a request may take before it is abandoned.
+     */
+    struct Timeout {
+        /// How long to wait for a connection to be made (0 to wait forever)
+        std::chrono::milliseconds connect;
+
+        /// How long the whole request may take, including connecting (0 to wait forever)
+        std::chrono::milliseconds total;
+
+        Timeout (std::chrono::milliseconds connect = std::chrono::seconds(10),
+                 std::chrono::milliseconds total = std::chrono::seconds(60)) {
+            this->connect = connect;
+            this->total = total;
+        }
+    };
+
+    /**
+     * @brief A structure representing how long a Reddit instance waits for each endpoint.
+     *
+     * A request that times out is treated like any other request that got no response, so
+     * it may be retried according to the RetryPolicy. A deadline given through a
+     * CancellationToken always applies as well.
+     */
+    struct TimeoutPolicy {
+        /// The timeouts of endpoints that are not in endpoints (default: 10 s to connect, 60 s in total)
+        Timeout defaults;
+
+        /// The timeouts of media uploads made by Subreddit::postmedia() (default: 10 s to connect, 10 min in total)
+        Timeout upload;
+
+        /**
+         * Timeouts for particular endpoints, keyed by endpoint template (see endpointtemplate()),
+         * e.g. timeouts.endpoints["/r/{sub}/new"] = Timeout(std::chrono::seconds(2), std::chrono::seconds(5))
+         */
+        std::map<std::string, Timeout> endpoints;
+
+        TimeoutPolicy () : upload(std::chrono::seconds(10), std::chrono::minutes(10)) {}
+
+        /**
+         * @brief The timeouts that apply to a request
+         *
+         * @param path The path of the request
+         * @return const Timeout& The timeouts of the request's endpoint
+         */
+        const Timeout & get (const std::string & path) const {
+            if (endpoints.empty()) {
+                return defaults;
+            }
+            auto timeout = endpoints.find(endpointtemplate(path));
+            return timeout == endpoints.end() ? defaults : timeout->second;
+        }
+    };
 
     /**
     @brief Represents the user's session with Reddit.
@@ -36,22 +132,84 @@ namespace CRAW {
 			*/
             time_t _expiration;
 
+            /**
+             * The Transport used to send requests
+             */
+            std::shared_ptr<Transport> _transport;
+
+            /**
+             * Guards the token so that it can be refreshed while other threads are sending requests
+             */
+            std::mutex _tokenlock;
+
             /**
              * Get a new API token using the authentication data
              */
             void _gettoken ();
 
+            /**
+             * Build a request to the Reddit API, refreshing the token first if needed
+             * 
+             * @param method The HTTP method to use (e.g. "POST", "GET")
+             * @param targeturl The target URL, including the query string (e.g. "/api/v1/me")
+             * @param body The already-encoded body of the request
+             * @param contenttype The value of the Content-Type header, or "" to send none
+             * @param cancellation Cancels the request
+             * @return HTTPRequest The request, ready for its first attempt
+             */
+            HTTPRequest _makerequest (const std::string & method,
+                                      const std::string & targeturl,
+                                      const std::string & body,
+                                      const std::string & contenttype,
+                                      const CancellationToken & cancellation);
+
+            /**
+             * How long to wait before retrying a request, according to the RetryPolicy and
+             * the response's Retry-After header
+             */
+            std::chrono::milliseconds _retrywait (const HTTPResponse & response, int attempt) const;
+
+            /**
+             * What a hedge has to get past before it is sent: a token from the scheduler and
+             * a slot from the concurrency limiter, if they are enabled, taken without waiting
+             *
+             * @param endpoint The template of the request's endpoint (see endpointtemplate())
+             */
+            HedgeGate _hedgegate (const std::string & endpoint);
+
+            /**
+             * Send a request to the Reddit API through the Transport, refreshing the token
+             * first if needed and retrying it according to the RetryPolicy.
+             * 
+             * @param method The HTTP method to use (e.g. "POST", "GET")
+             * @param targeturl The target URL, including the query string (e.g. "/api/v1/me")
+             * @param body The already-encoded body of the request
+             * @param contenttype The value of the Content-Type header (default: "", which sends none)
+             * @param cancellation Cancels the request, including any retries
+             * @param route Whether an instance in a RedditPool can hand the request to the
+             * pool's reader (default: true)
+             * @return HTTPResponse The server's response
+             */
+            HTTPResponse _send (const std::string & method,
+                                const std::string & targeturl,
+                                const std::string & body,
+                                const std::string & contenttype = "",
+                                const CancellationToken & cancellation = CancellationToken::none(),
+                                bool route = true);
+
             /**
              * Send a request to the Reddit API
              * 
              * @param method The HTTP method to use (e.g. "POST", "GET")
              * @param targeturl The target URL (e.g. "/api/v1/me")
              * @param body The data to be sent in the body of the request
+             * @param cancellation Cancels the request
              * @return JSON object representing the server's response
              */
             nlohmann::json _sendrequest (const std::string & method, 
                                          const std::string & targeturl, 
-                                         const std::string & body = "");
+                                         const std::string & body = "",
+                                         const CancellationToken & cancellation = CancellationToken::none());
 
             /**
              * Send a request to the Reddit API
@@ -60,12 +218,122 @@ namespace CRAW {
              * @param targeturl The target URL (e.g. "/api/v1/me")
              * @param body The data to be sent in the body of the request
              * @param parameters The parameters of the request
+             * @param cancellation Cancels the request
              * @return JSON object representing the server's response
              */
             nlohmann::json _sendrequest (const std::string & method, 
                                          const std::string & targeturl, 
                                          const cpr::Payload & body,
-                                         const cpr::Parameters & parameters = {});
+                                         const cpr::Parameters & parameters = {},
+                                         const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * Throw the error that a response's status code stands for, or parse its body
+             * 
+             * @param targeturl The target URL of the request that was answered
+             * @param response The response
+             * @return JSON object representing the server's response
+             */
+            nlohmann::json _check (const std::string & targeturl, const HTTPResponse & response);
+
+            /**
+             * Send a GET request for a lookup that often misses, returning 404 and 403
+             * responses as ErrorCodes rather than throwing (see Expected)
+             *
+             * @param targeturl The target URL (e.g. "/r/cpp/about")
+             * @param parameters The parameters of the request
+             * @param cancellation Cancels the request
+             * @return Expected<nlohmann::json> The server's response, or ErrorCode::notfound or
+             * ErrorCode::unauthorised
+             * @throws The same as _sendrequest() for any other failure
+             */
+            Expected<nlohmann::json> _tryrequest (const std::string & targeturl,
+                                                  const cpr::Parameters & parameters,
+                                                  const CancellationToken & cancellation);
+
+            /**
+             * Look up Redditors by fullname for redditors() and tryredditors()
+             *
+             * @param throwing Whether to throw when a batch can't be fetched, rather than
+             * returning the ErrorCode for each Redditor in it
+             */
+            std::map<std::string, Expected<Redditor>> _lookupredditors (const std::vector<std::string> & fullnames,
+                                                                        const CancellationToken & cancellation,
+                                                                        bool throwing);
+
+#ifdef CRAW_COROUTINES
+            /**
+             * Send a request to the Reddit API without blocking, retrying it according to the
+             * RetryPolicy. The other arguments are the same as _send()'s.
+             * 
+             * Requests sent this way are scheduled and limited by the ConcurrencyPolicy like
+             * any other, but wait for their turn by suspending rather than by blocking the
+             * thread. They are not hedged, since the hedger waits for the race on the thread
+             * that sent the request.
+             *
+             * @param priority The priority of the request. Since a coroutine can carry on on
+             * another thread, this is read from the PriorityScope when the call is made
+             * rather than when the request is sent.
+             */
+            Task<HTTPResponse> _sendco (std::string method,
+                                        std::string targeturl,
+                                        std::string body,
+                                        std::string contenttype,
+                                        CancellationToken cancellation,
+                                        Priority priority,
+                                        bool route = true);
+
+            /**
+             * Send a request to the Reddit API without blocking (see _sendrequest() and _sendco())
+             */
+            Task<nlohmann::json> _sendrequestco (std::string method,
+                                                 std::string targeturl,
+                                                 std::string body = "",
+                                                 CancellationToken cancellation = CancellationToken::none(),
+                                                 Priority priority = PriorityScope::current());
+#endif
+
+            /**
+             * Parse the body of a response, recording how long it took in the endpoint's metrics
+             * 
+             * @param targeturl The target URL of the request that was answered
+             * @param text The body of the response
+             * @return JSON object representing the server's response
+             */
+            nlohmann::json _parse (const std::string & targeturl, const std::string & text);
+
+            /**
+             * Turn a page of the inbox into Message objects
+             */
+            std::vector<Message> _inboxobjects (nlohmann::json & response);
+
+            /**
+             * Add the gauges of the concurrency limiter and the scheduler to the metrics
+             */
+            void _registergauges ();
+
+            /**
+             * Turn the items of a listing into objects, on the executor if the ExecutorPolicy
+             * is enabled and there are at least splitsize of them
+             *
+             * @tparam T The type of object (e.g. Post), which can be constructed from an item's data
+             * @param items The data of each item
+             * @return std::vector<T> The objects, in the same order as the items
+             */
+            template <typename T>
+            std::vector<T> _objects (const std::vector<nlohmann::json *> & items) {
+                if (!execution.enabled || items.size() < execution.splitsize) {
+                    std::vector<T> objects;
+                    objects.reserve(items.size());
+                    for (nlohmann::json * item : items) {
+                        objects.emplace_back(T(*item, this));
+                    }
+                    return objects;
+                }
+                return executor().map(items.size(), [&] (size_t i) {
+                    return T(*items[i], this);
+                });
+            }
 
             // All classes that can post to the API are friends
             // All classes that teach mathematics are enemies
@@ -74,6 +342,7 @@ namespace CRAW {
             friend class Subreddit;
             friend class Post;
             friend class Message;
+            friend class RedditPool;
         public:
             /**
 			Whether the session is authenticated
@@ -95,6 +364,57 @@ namespace CRAW {
 			*/
             std::string clientid;
 
+            /**
+             * How failed requests are retried. This may be changed at any time, but not while
+             * requests are being made from other threads.
+             */
+            RetryPolicy retrypolicy;
+
+            /**
+             * How long requests may take, by endpoint. Like the RetryPolicy, this should not be
+             * changed while requests are being made from other threads.
+             */
+            TimeoutPolicy timeouts;
+
+            /**
+             * When GET requests are hedged (off by default). Like the RetryPolicy, this should
+             * not be changed while requests are being made from other threads.
+             */
+            HedgePolicy hedging;
+
+            /**
+             * How many requests may be in flight at once (unlimited by default). Like the
+             * RetryPolicy, this should not be changed while requests are being made from other
+             * threads.
+             */
+            ConcurrencyPolicy concurrency;
+
+            /**
+             * How the rate limit is shared between requests of different priorities (see
+             * PriorityScope). Scheduling is off by default. Like the RetryPolicy, this should
+             * not be changed while requests are being made from other threads.
+             */
+            SchedulerPolicy scheduling;
+
+            /**
+             * How many threads the executor has, and whether the library uses it to build
+             * long listings and to poll streams ahead (off by default). This must be set
+             * before executor() is first called.
+             */
+            ExecutorPolicy execution;
+
+            /**
+             * Latency, size, status code and retry counts of the requests made by this
+             * instance, by endpoint. See Metrics::snapshot() and Metrics::prometheus().
+             */
+            Metrics metrics;
+
+            /**
+             * Where spans are reported for each request and each high-level operation (such as
+             * Subreddit::postmedia()). Set its callbacks to start tracing.
+             */
+            Tracer tracer;
+
             /**
             @brief Initialise an authenticated Reddit instance
             
@@ -103,19 +423,24 @@ namespace CRAW {
             @param client_id: The user id of the API key to log in with
             @param api_secret: The API secret of the key to log in with
             @param user_agent: Any string except empty. It will be used as the user agent and associated with the current session.
+            @param transport: The Transport to send requests with (default: nullptr, which sends them over the network
+            with a CPRTransport)
             */
             Reddit (const std::string & user_name, 
                     const std::string & password, 
                     const std::string & client_id, 
                     const std::string & api_secret, 
-                    const std::string & user_agent);
+                    const std::string & user_agent,
+                    std::shared_ptr<Transport> transport = nullptr);
 
             /**
 			@brief Initialise an unauthenticated (anonymous) Reddit instance
 
             @param user_agent Any string except empty. It will be used as the user agent and associated with the current session.
+            @param transport The Transport to send requests with (default: nullptr, which sends them over the network
+            with a CPRTransport)
 			*/
-            Reddit (const std::string & user_agent);
+            Reddit (const std::string & user_agent, std::shared_ptr<Transport> transport = nullptr);
 
             /**
             Returns a Redditor instance of the current user.
@@ -130,6 +455,49 @@ namespace CRAW {
             */
             Redditor redditor (const std::string & name);
 
+            /**
+             * @brief Fetch many Redditors by fullname at once, such as the authors of a page of
+             * comments (see Submission::authorfullname). They are fetched 100 at a time from
+             * /api/user_data_by_account_ids, so fetching the authors of 100 comments takes one
+             * request rather than 100.
+             *
+             * Redditors that are suspended or deleted are left out of the results rather than
+             * throwing. Their data is smaller than that of redditor(): the award karma is 0
+             * and information only has what the bulk endpoint returns.
+             *
+             * @param fullnames The Redditors' fullnames, e.g. "t2_abc123". Duplicates and empty
+             * fullnames are ignored.
+             * @param cancellation Cancels the requests (default: none)
+             * @return std::map<std::string, Redditor> The Redditors that were found, by fullname
+             */
+            std::map<std::string, Redditor> redditors (const std::vector<std::string> & fullnames,
+                                                       const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch a Redditor without throwing if they don't exist (see redditor()).
+             * Suspended Redditors count as not found.
+             *
+             * @param name The name of the Redditor without the u/
+             * @param cancellation Cancels the request (default: none)
+             * @return Expected<Redditor> The Redditor, or why they couldn't be fetched
+             */
+            Expected<Redditor> tryredditor (const std::string & name,
+                                            const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch many Redditors by fullname without throwing (see redditors()). Every
+             * fullname asked for is in the results: Redditors that are suspended or deleted
+             * are ErrorCode::notfound, and those in a batch that couldn't be fetched have the
+             * batch's ErrorCode.
+             *
+             * @param fullnames The Redditors' fullnames, e.g. "t2_abc123"
+             * @param cancellation Cancels the requests (default: none)
+             * @return std::map<std::string, Expected<Redditor>> Each Redditor, or why they
+             * couldn't be fetched, by fullname
+             */
+            std::map<std::string, Expected<Redditor>> tryredditors (const std::vector<std::string> & fullnames,
+                                                                    const CancellationToken & cancellation = CancellationToken::none());
+
             /**
             Fetches a Subreddit instance for the subreddit with the given name (without the r/)
             
@@ -138,6 +506,36 @@ namespace CRAW {
             */
             Subreddit subreddit (const std::string & name);
 
+            /**
+             * @brief Fetch a subreddit without throwing if it doesn't exist (see subreddit())
+             *
+             * @param name The name of the subreddit without the r/
+             * @param cancellation Cancels the request (default: none)
+             * @return Expected<Subreddit> The subreddit, or why it couldn't be fetched
+             */
+            Expected<Subreddit> trysubreddit (const std::string & name,
+                                              const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch many subreddits at once, by name or by fullname (e.g. "t5_2qh1i"). They
+             * are looked up 100 at a time through /api/info, and the lookups are spread across
+             * the executor, so refreshing thousands of subreddits takes a few requests per
+             * hundred rather than one each. The requests have the caller's priority (background
+             * if none is set).
+             *
+             * Subreddits that can't be fetched don't throw; instead, their Expected holds the
+             * reason, such as ErrorCode::notfound for subreddits that don't exist or are banned.
+             * Subreddits fetched this way have no active user count.
+             *
+             * @param names The subreddits' names (without the r/) or fullnames. Duplicates and
+             * empty names are ignored.
+             * @param cancellation Cancels the requests (default: none)
+             * @return std::map<std::string, Expected<Subreddit>> Each subreddit, or why it
+             * couldn't be fetched, by the name or fullname it was asked for by
+             */
+            std::map<std::string, Expected<Subreddit>> subreddits (const std::vector<std::string> & names,
+                                                                   const CancellationToken & cancellation = CancellationToken::none());
+
             /**
             Fetches a Post instance for the Reddit post with the given ID
 
@@ -146,6 +544,18 @@ namespace CRAW {
             */
             Post post (const std::string & id);
 
+            /**
+             * @brief Fetch a post without throwing if it doesn't exist (see post()). This is
+             * meant for checking whether many posts still exist: a missing post costs no
+             * exception and no error message.
+             *
+             * @param id The ID of the post
+             * @param cancellation Cancels the request (default: none)
+             * @return Expected<Post> The post, or why it couldn't be fetched
+             */
+            Expected<Post> trypost (const std::string & id,
+                                    const CancellationToken & cancellation = CancellationToken::none());
+
             /**
              * @brief Search for subreddits that begin with a given string.
              * 
@@ -178,8 +588,85 @@ namespace CRAW {
              * this function will always return the first page.
              * @param direction Whether to return the page after the page provided in listingpage, or the page before
              * (either "after" or "before", default: "after"). Ignored if listingpage is not provided (or blank).
+             * @param cancellation Cancels the request (default: none)
              * @return std::vector of Message objects in the inbox
             */
-            std::vector<Message> inbox (const std::string & filter = "inbox", ListingPage listingpage = ListingPage(), const std::string & direction = "after");
+            std::vector<Message> inbox (const std::string & filter = "inbox", ListingPage listingpage = ListingPage(), const std::string & direction = "after",
+                                        const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Stream new items in the current user's inbox as they arrive, oldest first.
+             * 
+             * @param filter Which items to stream (see inbox()) (default: "inbox")
+             * @param skipexisting Whether to skip the items that are already in the inbox when the stream
+             * starts (default: false)
+             * @return Stream<Message> The stream
+             */
+            Stream<Message> inboxstream (const std::string & filter = "inbox", bool skipexisting = false);
+
+#ifdef CRAW_COROUTINES
+            /**
+             * @brief Fetch a subreddit without blocking (see subreddit())
+             */
+            Task<Subreddit> subreddit_co (std::string name);
+
+            /**
+             * @brief Fetch a post without blocking (see post())
+             */
+            Task<Post> post_co (std::string id);
+
+            /**
+             * @brief Fetch a page of the current user's inbox without blocking (see inbox())
+             */
+            Task<std::vector<Message>> inbox_co (std::string filter = "inbox",
+                                                 CancellationToken cancellation = CancellationToken::none());
+#endif
+
+            /**
+             * @brief How much of Reddit's rate limit this session has left, as of the last
+             * response that reported it.
+             *
+             * @return RateLimit The rate limit, whose remaining is -1 if no response has
+             * reported it since it last reset
+             */
+            RateLimit ratelimit ();
+
+            /**
+             * @brief The session's pool of worker threads, which is started the first time
+             * this is called. Callbacks can be run on it with Executor::submit().
+             *
+             * @return Executor& The executor
+             */
+            Executor & executor ();
+
+        private:
+            /**
+             * The pool this instance is an account of, which chooses the account that sends
+             * each read (nullptr if it isn't in one)
+             */
+            RedditPool * _pool;
+
+            /**
+             * Limits how many requests are in flight according to the ConcurrencyPolicy
+             */
+            ConcurrencyLimiter _limiter;
+
+            /**
+             * Decides when requests are sent according to the SchedulerPolicy
+             */
+            Scheduler _scheduler;
+
+            /**
+             * Sends hedged requests. This is declared after metrics, the limiter and the
+             * scheduler so that it is destroyed first, because hedges that are still in flight
+             * record into metrics and give back their slot in the limiter.
+             */
+            Hedger _hedger;
+
+            /**
+             * Runs work for the library and for callbacks. This is declared last so that its
+             * workers are stopped before anything they might be using is destroyed.
+             */
+            Executor _executor;
     };
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "crawpp/Reddit.h"
+#include "crawpp/Transport.h"
+
+namespace CRAW {
+
+    /**
+     * @brief The authentication data of one account in a RedditPool.
+     */
+    struct Credentials {
+        /// The username of the account
+        std::string username;
+
+        /// The password of the account
+        std::string password;
+
+        /// The user id of the API key to log in with
+        std::string clientid;
+
+        /// The API secret of the key to log in with
+        std::string apisecret;
+    };
+
+    /**
+     * @brief How much one account of a RedditPool has been used.
+     */
+    struct AccountUsage {
+        /// The username of the account
+        std::string username;
+
+        /// How many times the account was chosen to read with. Every read that an object
+        /// fetched through the pool makes counts, as well as every call to reader().
+        uint64_t reads;
+
+        /// How many times the account was chosen to write with
+        uint64_t writes;
+
+        /// How many requests the account has sent, including retries (0 if its metrics are
+        /// disabled)
+        uint64_t requests;
+
+        /// The account's rate limit as Reddit last reported it
+        RateLimit ratelimit;
+    };
+
+    /**
+     * @brief Several authenticated Reddit sessions, one per account, that share out reads
+     * between them.
+     *
+     * Reddit's rate limit is per account, so reading through several accounts gets through
+     * listings and about pages faster than one account can. Each account has its own
+     * Reddit instance, and so its own token, Scheduler and metrics. Every read that looks the
+     * same to every account (listings, stream polls, comment pages, about pages and bulk
+     * lookups) goes to whichever account has the most of its rate limit left when it is
+     * sent, whichever account the object making it was fetched with. Writes, and reads of
+     * an account's own things such as its inbox, always go through the account of the
+     * object making them.
+     *
+     * Writes should all go through one chosen account (the writer), so that everything the
+     * pool posts comes from the same identity. An object that is fetched by a read and then
+     * written to (e.g. with Submission::reply()) should be handed to towriter() first.
+     *
+     * Every account's scheduling is turned on, so that no account goes over its own rate
+     * limit while the others have some left. It can be turned off again through
+     * operator[].
+     *
+     * @code
+     * CRAW::RedditPool pool({{"bot1", "pass1", "id1", "secret1"}, {"bot2", "pass2", "id2", "secret2"}}, "mybot/1.0");
+     * for (CRAW::Post & post : pool.subreddit("cpp").posts()) {
+     *     pool.towriter(post).reply("Hello");  // replies as bot1
+     * }
+     * @endcode
+     */
+    class RedditPool {
+        private:
+            /// A Reddit instance and the number of times it has been chosen
+            struct Account {
+                std::unique_ptr<Reddit> reddit;
+                uint64_t reads;
+                uint64_t writes;
+            };
+
+            std::vector<Account> _accounts;
+
+            /// The index of the account that writes
+            size_t _writer;
+
+            /// Guards the counts and the writer
+            std::mutex _lock;
+
+            /**
+             * The index of the account with the most of its rate limit left, without counting
+             * it as chosen
+             */
+            size_t _choose ();
+
+            /**
+             * The account that should send a request that an account in the pool is about to
+             * send: the reader if the request reads something that looks the same to every
+             * account, and the account itself otherwise
+             *
+             * @param from The account about to send the request
+             * @param method The HTTP method of the request
+             * @param path The path of the request
+             */
+            Reddit & _sender (Reddit & from, const std::string & method, const std::string & path);
+
+            // so that accounts can hand their reads to the reader
+            friend class Reddit;
+
+        public:
+            /**
+             * @brief Log in to every account
+             *
+             * @param credentials The accounts to log in to. The first one is the writer.
+             * @param useragent The user agent of every account's session
+             * @param transport The Transport that every account sends requests with (default:
+             * nullptr, which gives each account its own CPRTransport)
+             * @throws std::invalid_argument if no credentials are given
+             * @throws errors::LoginError if an account can't log in
+             */
+            RedditPool (const std::vector<Credentials> & credentials,
+                        const std::string & useragent,
+                        std::shared_ptr<Transport> transport = nullptr);
+
+            RedditPool (const RedditPool &) = delete;
+            RedditPool & operator= (const RedditPool &) = delete;
+
+            /**
+             * @brief The account with the most of its rate limit left. Accounts whose rate
+             * limit hasn't been reported yet count as having all of it left, and ties go to
+             * the account that has been chosen to read with the fewest times.
+             *
+             * @return Reddit& The account to read with
+             */
+            Reddit & reader ();
+
+            /**
+             * @brief The account that writes
+             */
+            Reddit & writer ();
+
+            /**
+             * @brief Choose the account that writes
+             *
+             * @param username The username of the account
+             * @throws std::invalid_argument if no account in the pool has that username
+             */
+            void pin (const std::string & username);
+
+            /**
+             * @brief The account with a given username
+             *
+             * @throws std::invalid_argument if no account in the pool has that username
+             */
+            Reddit & account (const std::string & username);
+
+            /**
+             * @brief The number of accounts in the pool
+             */
+            size_t size () const;
+
+            /**
+             * @brief The account at a position in the pool, in the order they were given to
+             * the constructor. Use this to set each account's policies.
+             */
+            Reddit & operator[] (size_t index);
+
+            /**
+             * @brief Fetch a subreddit with the reader (see Reddit::subreddit())
+             */
+            Subreddit subreddit (const std::string & name);
+
+            /**
+             * @brief Fetch a Redditor with the reader (see Reddit::redditor())
+             */
+            Redditor redditor (const std::string & name);
+
+            /**
+             * @brief Fetch a post with the reader (see Reddit::post())
+             */
+            Post post (const std::string & id);
+
+            /**
+             * @brief Fetch many subreddits at once (see Reddit::subreddits()). Each batch of
+             * 100 is sent by whichever account is the reader at the time.
+             */
+            std::map<std::string, Expected<Subreddit>> subreddits (const std::vector<std::string> & names,
+                                                                   const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch many Redditors by fullname at once (see Reddit::redditors()). Each
+             * batch of 100 is sent by whichever account is the reader at the time.
+             */
+            std::map<std::string, Redditor> redditors (const std::vector<std::string> & fullnames,
+                                                       const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Make a copy of an object that uses the writer.
+             *
+             * @tparam T Any CRAW model, e.g. Post or Subreddit
+             * @param object An object fetched by any account in the pool
+             * @return T The same object, whose requests go through the writer
+             */
+            template <typename T>
+            T towriter (T object) {
+                static_cast<CRAWObject &>(object)._redditinstance = &writer();
+                return object;
+            }
+
+            /**
+             * @brief How much each account has been used, in the order they were given to the
+             * constructor
+             */
+            std::vector<AccountUsage> usage ();
+    };
+}
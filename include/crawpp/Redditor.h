@@ -1,16 +1,77 @@
 #pragma once
 #include <string>
 #include <ctime>
+#include <map>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 #include "crawpp/Reddit.h"
 #include "crawpp/CRAWObject.h"
+#include "crawpp/Fields.hpp"
+#include "crawpp/History.hpp"
 
 namespace CRAW {
     /**
     @brief Represents a Reddit user.
     */
     class Redditor : public CRAWObject {
+        private:
+            /**
+             * Construct a Redditor from the "data" field of their about page, without making
+             * a request
+             */
+            Redditor (Reddit * redditinstance, const nlohmann::json & about);
+
+            /**
+             * Initialise this Redditor with the "data" field of their about page
+             */
+            void _init (const nlohmann::json & about);
+
+            /**
+             * Fetch a page of a Redditor's history
+             *
+             * @tparam T Post for their posts, Comment for their comments, or Activity for both
+             */
+            template <typename T>
+            static std::vector<T> _historypage (const std::string & name,
+                                                Reddit * redditinstance,
+                                                const HistoryOptions & options,
+                                                ListingPage & page,
+                                                const CancellationToken & cancellation);
+
+            /**
+             * Fetch a page of a Redditor's history, returning ErrorCode::notfound or
+             * ErrorCode::unauthorised rather than throwing if it's missing or hidden
+             */
+            template <typename T>
+            static Expected<std::vector<T>> _tryhistorypage (const std::string & name,
+                                                             Reddit * redditinstance,
+                                                             const HistoryOptions & options,
+                                                             ListingPage & page,
+                                                             const CancellationToken & cancellation);
+
+            /**
+             * Fetch many Redditors' histories for histories() and tryhistories()
+             *
+             * @param throwing Whether to stop and throw when a page can't be fetched for a
+             * reason other than the Redditor being missing or hidden
+             */
+            template <typename T>
+            static std::map<std::string, Expected<std::vector<T>>> _histories (const std::vector<std::string> & usernames,
+                                                                               Reddit * redditinstance,
+                                                                               const HistoryOptions & options,
+                                                                               const CancellationToken & cancellation,
+                                                                               bool throwing);
+
+            /**
+             * Go through a Redditor's history, fetching ahead if the executor is enabled
+             */
+            template <typename T>
+            History<T> _history (const HistoryOptions & options, const CancellationToken & cancellation);
+
+            // so that Redditors can be looked up without throwing
+            friend class Reddit;
+
         public:
             /**
 			Stores information about the user
@@ -61,6 +122,17 @@ namespace CRAW {
             */
             Redditor (const std::string & name, Reddit * redditinstance);
 
+            /**
+             * Construct a Redditor from the data that /api/user_data_by_account_ids returns
+             * for them, without making a request. Use Reddit::redditors() rather than calling
+             * this directly.
+             *
+             * @param fullname The Redditor's fullname, which the data is keyed by
+             * @param data The data for the Redditor
+             * @param redditinstance The Reddit instance to associate with the Redditor
+             */
+            Redditor (const std::string & fullname, const nlohmann::json & data, Reddit * redditinstance);
+
             /**
             The [] operator is used to fetch information about a user. All information is returned as a std::string.
             Some commonly-used attributes can be fetched using the dot operator (.), but all information can be fetched using this.
@@ -68,6 +140,31 @@ namespace CRAW {
             */
             std::string operator[] (const std::string & attribute);
 
+            /**
+             * @brief Read a field of the Redditor's information, without the string
+             * conversions of operator[]
+             *
+             * @tparam Field The field, e.g. fields::total_karma
+             * @return The value, or a reference to it for strings
+             * @throws std::invalid_argument if the field is missing or null (see has())
+             */
+            template <typename Field>
+            fields::result<Field> get () const {
+                static_assert(Field::redditor, "Redditors don't have this field");
+                return fields::read<Field>(information);
+            }
+
+            /**
+             * @brief Whether the Redditor's information has a field that isn't null
+             *
+             * @tparam Field The field
+             */
+            template <typename Field>
+            bool has () const {
+                static_assert(Field::redditor, "Redditors don't have this field");
+                return fields::present<Field>(information);
+            }
+
             /** 
              * Follow this Redditor, which is the same as subscribing to their user subreddit
             */
@@ -88,5 +185,75 @@ namespace CRAW {
              * does not work.
              */
             void block ();
+
+            /**
+             * @brief Go through this Redditor's posts, newest first by default. The pages are
+             * fetched as they are needed, and if the Reddit instance's ExecutorPolicy is
+             * enabled, each page is fetched while the one before it is being gone through.
+             *
+             * @param options How to sort the posts, and how many pages to fetch
+             * @param cancellation Cancels the requests for the pages (default: none)
+             * @return History<Post> The posts
+             */
+            History<Post> submitted (const HistoryOptions & options = HistoryOptions(),
+                                     const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Go through this Redditor's comments (see submitted())
+             */
+            History<Comment> comments (const HistoryOptions & options = HistoryOptions(),
+                                       const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Go through this Redditor's posts and comments together, in one listing
+             * (see submitted())
+             */
+            History<Activity> overview (const HistoryOptions & options = HistoryOptions(),
+                                        const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch the histories of many Redditors at once, e.g. for spam analysis.
+             *
+             * Up to options.concurrency pages are fetched at a time on the Reddit instance's
+             * executor, taking the Redditors in turn: the first page of each, then the second
+             * page of each, and so on, so that one long history doesn't hold up the rest.
+             * The requests have the caller's priority (background if none is set), so the
+             * Scheduler can fit them around more urgent requests.
+             *
+             * Redditors that don't exist, are suspended or have hidden their history are left
+             * out of the results.
+             *
+             * @tparam T Post for their posts, Comment for their comments, or Activity for both
+             * @param usernames The Redditors' usernames, without the u/
+             * @param redditinstance The Reddit instance to fetch them with
+             * @param options How to sort each history, how many pages to fetch of each, and
+             * how many to fetch at once
+             * @param cancellation Cancels every request (default: none)
+             * @return std::map<std::string, std::vector<T>> Each Redditor's history, by username
+             * @throws errors::CommunicationError (or a subclass) if a page couldn't be fetched
+             * for any other reason
+             */
+            template <typename T>
+            static std::map<std::string, std::vector<T>> histories (const std::vector<std::string> & usernames,
+                                                                    Reddit * redditinstance,
+                                                                    const HistoryOptions & options = HistoryOptions(),
+                                                                    const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch the histories of many Redditors at once without throwing (see
+             * histories()). Every Redditor asked for is in the results: those that don't
+             * exist, are suspended or hide their history have ErrorCode::notfound or
+             * ErrorCode::unauthorised, and those whose history couldn't be fetched in full
+             * have the ErrorCode of the page that failed. A failure for one Redditor doesn't
+             * stop the rest.
+             *
+             * @return std::map<std::string, Expected<std::vector<T>>> Each Redditor's history,
+             * or why it couldn't be fetched, by username
+             */
+            template <typename T>
+            static std::map<std::string, Expected<std::vector<T>>> tryhistories (const std::vector<std::string> & usernames,
+                                                                                 Reddit * redditinstance,
+                                                                                 const HistoryOptions & options = HistoryOptions(),
+                                                                                 const CancellationToken & cancellation = CancellationToken::none());
     };
 }
\ No newline at end of file
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/Transport.h"
+
+namespace CRAW {
+
+    /**
+     * @brief How urgent a request is, for the Scheduler.
+     */
+    enum class Priority {
+        /// Actions that a person is waiting for, such as replies and bans
+        interactive = 0,
+
+        /// Everything that isn't tagged with a priority
+        normal = 1,
+
+        /// Bulk work that can wait, such as crawling listings
+        background = 2
+    };
+
+    /**
+     * @brief Tags every request made on the calling thread with a priority, for as long as it exists.
+     *
+     * Scopes can be nested, and the innermost one wins. Methods that a person is usually
+     * waiting on, such as Submission::reply() and Subreddit::ban(), are interactive unless
+     * the caller has tagged them otherwise.
+     *
+     * @code
+     * {
+     *     CRAW::PriorityScope scope(CRAW::Priority::background);
+     *     subreddit.posts("new", "all", 100, &page);  // background
+     * }
+     * @endcode
+     */
+    class PriorityScope {
+        private:
+            /// The priority that was in force before this scope
+            int _previous;
+
+        public:
+            /**
+             * @brief Tag the calling thread's requests with a priority
+             *
+             * @param priority The priority to tag them with
+             */
+            PriorityScope (Priority priority);
+
+            ~PriorityScope ();
+
+            PriorityScope (const PriorityScope &) = delete;
+            PriorityScope & operator= (const PriorityScope &) = delete;
+
+            /**
+             * @brief The priority of the calling thread's requests
+             *
+             * @param fallback The priority to use if no scope is open (default: Priority::normal)
+             * @return Priority The priority of the innermost open scope, or the fallback
+             */
+            static Priority current (Priority fallback = Priority::normal);
+    };
+
+    /**
+     * @brief A structure representing how a Reddit instance spends its rate limit.
+     *
+     * Requests are let through at no more than the rate, with short bursts of up to burst
+     * requests. While requests are waiting, each priority gets a share of the rate in
+     * proportion to its weight (weighted fair queuing), so an interactive request is sent
+     * within about one request interval of being made however much background work is
+     * queued, and background work is never starved entirely.
+     *
+     * Scheduling is off by default, in which case requests are sent as soon as they are made.
+     */
+    struct SchedulerPolicy {
+        /// Whether to schedule requests (default: false)
+        bool enabled;
+
+        /// How many requests can be sent per second (default: 100 per minute, Reddit's
+        /// limit for OAuth clients)
+        double rate;
+
+        /// How many requests can be sent at once after a quiet spell (default: 10)
+        double burst;
+
+        /// The share of the rate that each priority gets while others are waiting, indexed
+        /// by Priority (default: 16 for interactive, 4 for normal, 1 for background)
+        double weights [3];
+
+        SchedulerPolicy () {
+            enabled = false;
+            rate = 100.0 / 60;
+            burst = 10;
+            weights[static_cast<int>(Priority::interactive)] = 16;
+            weights[static_cast<int>(Priority::normal)] = 4;
+            weights[static_cast<int>(Priority::background)] = 1;
+        }
+    };
+
+    /**
+     * @brief Reddit's rate limit, as it was last reported in the X-Ratelimit-Remaining and
+     * X-Ratelimit-Reset headers.
+     */
+    struct RateLimit {
+        /// How many more requests can be sent before the limit resets, counting the requests
+        /// sent since it was reported, or -1 if Reddit hasn't reported it since it last reset
+        double remaining;
+
+        /// When the limit resets, if remaining isn't -1
+        std::chrono::steady_clock::time_point reset;
+    };
+
+    /**
+     * @brief Decides when each of a Reddit instance's requests can be sent, according to a
+     * SchedulerPolicy.
+     *
+     * Besides its own rate, the scheduler follows the X-Ratelimit-Remaining and
+     * X-Ratelimit-Reset headers that Reddit sends: once the limit is used up, nothing is sent
+     * until it resets.
+     */
+    class Scheduler {
+        public:
+            /**
+             * @brief A request's place in the queue while it waits to be sent
+             */
+            struct Ticket {
+                /// When the request would finish being sent if each priority were sent at the
+                /// share of the rate given by its weight. The ticket with the lowest tag goes next.
+                double tag;
+
+                /// The priority of the request
+                Priority priority;
+
+                /// Whether the ticket is in the queue
+                bool queued;
+
+                Ticket () {
+                    tag = 0;
+                    priority = Priority::normal;
+                    queued = false;
+                }
+            };
+
+            Scheduler ();
+            Scheduler (const Scheduler &) = delete;
+            Scheduler & operator= (const Scheduler &) = delete;
+
+            /**
+             * @brief Wait until a request can be sent.
+             *
+             * @param policy The rate and weights to apply
+             * @param priority The priority of the request
+             * @param cancellation Stops waiting when cancelled
+             * @throws errors::CancelledError if the token was cancelled while waiting
+             */
+            void acquire (const SchedulerPolicy & policy, Priority priority, const CancellationToken & cancellation);
+
+            /**
+             * @brief Take a token without waiting, for a request that can be skipped (such as
+             * a hedge). It is only taken if no other request is waiting for one.
+             *
+             * @param policy The rate to apply
+             * @return bool Whether a token was taken
+             */
+            bool tryacquire (const SchedulerPolicy & policy);
+
+            /**
+             * @brief Take a token if it is the request's turn, without waiting, for a caller
+             * that waits some other way (such as a coroutine). The first call puts the ticket
+             * in the queue, and it keeps its place until a token is taken or leave() is called.
+             *
+             * @param policy The rate and weights to apply
+             * @param priority The priority of the request
+             * @param ticket The request's place in the queue
+             * @return std::chrono::milliseconds 0 if a token was taken, otherwise how long to
+             * wait before calling this again
+             */
+            std::chrono::milliseconds poll (const SchedulerPolicy & policy, Priority priority, Ticket & ticket);
+
+            /**
+             * @brief Take a ticket out of the queue, e.g. because the request was cancelled
+             * while waiting with poll()
+             *
+             * @param ticket The request's place in the queue
+             */
+            void leave (Ticket & ticket);
+
+            /**
+             * @brief Follow the rate limit headers of a response.
+             *
+             * @param response A response from the Reddit API
+             */
+            void observe (const HTTPResponse & response);
+
+            /**
+             * @brief Count a request that is about to be sent against the reported rate limit.
+             */
+            void sending ();
+
+            /**
+             * @brief Give back what a request took that turned out not to be sent after all,
+             * e.g. because a CircuitBreakerTransport stopped it: its count against the
+             * reported rate limit, and its token if it was scheduled.
+             *
+             * @param policy The rate to apply
+             * @param scheduled Whether the request took a token with acquire()
+             */
+            void refund (const SchedulerPolicy & policy, bool scheduled);
+
+            /**
+             * @brief The rate limit as Reddit last reported it, less the requests sent since.
+             */
+            RateLimit ratelimit ();
+
+            /**
+             * @brief How many requests of a priority are waiting to be sent
+             */
+            size_t queued (Priority priority);
+
+        private:
+            std::mutex _lock;
+            std::condition_variable _wakeup;
+
+            /// The waiting requests of each priority, oldest first
+            std::deque<Ticket *> _queues [3];
+
+            /// The tag of the last request of each priority to be queued
+            double _lastfinish [3];
+
+            /// The tag of the last request to be sent
+            double _virtualtime;
+
+            /// Requests that can be sent straight away
+            double _tokens;
+            std::chrono::steady_clock::time_point _refilled;
+
+            /// When Reddit's rate limit resets, if it has been used up
+            std::chrono::steady_clock::time_point _blockeduntil;
+
+            /// The remaining requests that Reddit last reported, or -1 if it hasn't
+            double _reported;
+
+            /// Requests sent since the rate limit was last reported
+            long _unreported;
+
+            /// When the reported rate limit resets
+            std::chrono::steady_clock::time_point _resets;
+
+            /**
+             * The ticket that goes next, or nullptr if none are waiting
+             */
+            Ticket * _next ();
+
+            /**
+             * Add the tokens earned since the last refill. Must be called with the lock held.
+             */
+            void _refill (const SchedulerPolicy & policy, std::chrono::steady_clock::time_point now);
+
+            /**
+             * Put a ticket at the back of its priority's queue. Must be called with the lock held.
+             */
+            void _enqueue (const SchedulerPolicy & policy, Priority priority, Ticket & ticket);
+
+            /**
+             * Take a token for a ticket if it goes next and one is free, taking it out of the
+             * queue. Must be called with the lock held.
+             */
+            bool _take (Ticket & ticket, std::chrono::steady_clock::time_point now);
+
+            /**
+             * Take a ticket out of the queue. Must be called with the lock held.
+             */
+            void _remove (Ticket & ticket);
+    };
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+
+namespace CRAW {
+
+    /**
+     * @brief A structure representing how big a SeenFilter is and how long it remembers items.
+     */
+    struct SeenFilterPolicy {
+        /// How many items each window holds before the filter starts a new one (default: 1,000,000)
+        size_t capacity;
+
+        /// The chance that an item that hasn't been seen is taken for one that has, while
+        /// the filter holds no more than capacity items per window (default: 0.0001)
+        double falsepositive;
+
+        /// How long each window lasts. Items are remembered for between one and two windows
+        /// (default: 7 days).
+        std::chrono::seconds window;
+
+        SeenFilterPolicy () {
+            capacity = 1000000;
+            falsepositive = 0.0001;
+            window = std::chrono::hours(24 * 7);
+        }
+    };
+
+    /**
+     * @brief A compact, approximate set of the fullnames of items that have been seen, for
+     * streams and crawlers that run for a long time over many listings.
+     *
+     * The filter is a blocked Bloom filter: each fullname is packed into a 64-bit id, and
+     * the bits that record it all lie in the same 64-byte block, so looking an item up
+     * touches one cache line. At the default false positive rate an item takes about 3.5
+     * bytes, where a std::set of fullnames takes about 80.
+     *
+     * An item that is remembered is never reported as new again, but an item that is new
+     * is occasionally reported as seen, at about the policy's false positive rate. To keep
+     * that rate from growing, the filter keeps two windows: items go into the current
+     * window, and once it is full or older than the policy's window, the older one is
+     * forgotten and a new one started.
+     *
+     * All methods are safe to call from several threads at once, so one filter can be shared
+     * by many streams.
+     */
+    class SeenFilter {
+        public:
+            /**
+             * @brief Construct a new, empty SeenFilter
+             *
+             * @param policy How many items to hold, how accurately, and for how long
+             * @throws std::invalid_argument if the capacity is 0 or the false positive rate is
+             * not between 0 and 1
+             */
+            SeenFilter (const SeenFilterPolicy & policy = SeenFilterPolicy());
+
+            SeenFilter (const SeenFilter &) = delete;
+            SeenFilter & operator= (const SeenFilter &) = delete;
+
+            /**
+             * @brief Remember an item
+             *
+             * @param fullname The item's fullname, e.g. "t3_abc123"
+             * @return bool Whether the item hadn't been seen before
+             */
+            bool insert (const std::string & fullname);
+
+            /**
+             * @brief Whether an item has been seen (or, rarely, one that packs into the same bits)
+             *
+             * @param fullname The item's fullname
+             */
+            bool contains (const std::string & fullname) const;
+
+            /**
+             * @brief How many items are in the current window
+             */
+            size_t size () const;
+
+            /**
+             * @brief How much memory the filter's bits take, in bytes
+             */
+            size_t bytes () const;
+
+            /**
+             * @brief Write the filter to a file, so that it can be loaded after a restart. The
+             * file is replaced atomically, so it is never left half-written.
+             *
+             * @param path The file to write
+             * @throws errors::FileOperationError if the file can't be written
+             */
+            void save (const std::string & path) const;
+
+            /**
+             * @brief Load a filter that was written by save()
+             *
+             * @param path The file to read
+             * @return std::shared_ptr<SeenFilter> The filter, with the policy and windows it was saved with
+             * @throws errors::FileOperationError if the file can't be read or isn't a saved filter
+             */
+            static std::shared_ptr<SeenFilter> load (const std::string & path);
+
+            /**
+             * @brief Pack a fullname into a 64-bit id. Reddit's base-36 ids are packed exactly,
+             * along with their type; anything else is hashed.
+             *
+             * @param fullname The fullname, e.g. "t3_abc123"
+             * @return uint64_t The id
+             */
+            static uint64_t pack (const std::string & fullname);
+
+        private:
+            /// The bits of one window
+            struct Window {
+                std::unique_ptr<std::atomic<uint64_t> []> words;
+                std::atomic<size_t> count;
+                std::chrono::system_clock::time_point started;
+            };
+
+            SeenFilterPolicy _policy;
+
+            /// The number of 512-bit blocks in each window
+            size_t _blocks;
+
+            /// The number of bits set for each item
+            unsigned _hashes;
+
+            /// The current window and the one before it
+            Window _windows [2];
+            int _current;
+
+            /// Held exclusively while starting a new window
+            mutable std::shared_mutex _lock;
+
+            /// Set up both windows for a policy, without any items
+            void _allocate ();
+
+            /// Start a new window if the current one is full or too old
+            void _rotate ();
+
+            /// Whether all of an id's bits are set in a window
+            bool _test (const Window & window, uint64_t hash) const;
+    };
+}
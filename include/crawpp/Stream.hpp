@@ -0,0 +1,509 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "crawpp/Cancellation.h"
+#include "crawpp/Checkpoint.h"
+#include "crawpp/Dispatcher.hpp"
+#include "crawpp/Executor.h"
+#include "crawpp/ListingPage.hpp"
+#include "crawpp/Metrics.h"
+#include "crawpp/SeenFilter.h"
+#include "crawpp/crawexceptions.hpp"
+
+namespace CRAW {
+
+    /**
+     * @brief Remembers the fullnames of the items that a stream has seen, so that it
+     * doesn't return them twice.
+     *
+     * By default the most recent items are remembered exactly. Streams that run for a long
+     * time over many listings can share a SeenFilter instead, which remembers far more
+     * items in far less memory.
+     */
+    class SeenSet {
+        public:
+            /// If not null, the filter to remember items in instead (default: nullptr)
+            std::shared_ptr<SeenFilter> filter;
+
+            /**
+             * @brief Remember an item, forgetting the oldest one if there are too many
+             *
+             * @param fullname The item's fullname
+             * @param memory How many items to remember (unless there is a filter)
+             * @return bool Whether the item hadn't been seen before
+             */
+            bool insert (const std::string & fullname, size_t memory) {
+                if (filter != nullptr) {
+                    return filter->insert(fullname);
+                }
+                if (!_seen.insert(fullname).second) {
+                    return false;
+                }
+                _order.push_back(fullname);
+                while (_order.size() > memory) {
+                    _seen.erase(_order.front());
+                    _order.pop_front();
+                }
+                return true;
+            }
+
+            /**
+             * @brief The items that are remembered exactly, oldest first (none if there is
+             * a filter)
+             */
+            const std::deque<std::string> & recent () const {
+                return _order;
+            }
+
+        private:
+            /// The fullnames of recently seen items, and the order they were seen in
+            std::set<std::string> _seen;
+            std::deque<std::string> _order;
+    };
+
+    /**
+     * @brief A stream of new items from a listing, such as the new posts on a subreddit.
+     *
+     * The listing is polled for items that haven't been seen before, which are then
+     * returned oldest first. While nothing new turns up, the stream polls less and less
+     * often, up to maxinterval. Streams are not thread-safe; use one per thread.
+     *
+     * If the stream has an executor, each poll is started on it as soon as the one before
+     * has finished (after waiting the interval), so that handling the items doesn't hold
+     * up the next poll.
+     *
+     * With checkpoint(), the stream saves where it is to a file every so often, and picks
+     * up from there when it is started again: it first pages back through the listing to
+     * catch up on the items that were posted while it wasn't running.
+     *
+     * @tparam T The type of item (Post or Message), which must have a fullname
+     */
+    template <typename T>
+    class Stream {
+        public:
+            /// Fetches the newest items of the listing, newest first
+            using Fetch = std::function<std::vector<T> (const CancellationToken &)>;
+
+            /// Fetches a page of the listing, newest first, and moves the page on to the next (older) one
+            using FetchPage = std::function<std::vector<T> (ListingPage &, const CancellationToken &)>;
+
+            /// How long to wait between polls that find new items (default: 1 s)
+            std::chrono::milliseconds interval;
+
+            /// The longest to wait between polls when nothing new is found (default: 16 s)
+            std::chrono::milliseconds maxinterval;
+
+            /// How many of the most recently seen items to remember, to avoid returning them twice (default: 1000)
+            size_t memory;
+
+            /// If not null, the filter to remember seen items in instead of the last memory
+            /// items, e.g. one shared by many streams (default: nullptr)
+            std::shared_ptr<SeenFilter> seenfilter;
+
+            /// Where to poll ahead of the consumer, or nullptr to poll when the consumer asks
+            /// for an item (default: nullptr)
+            Executor * executor;
+
+            /// Where dispatch() exports its queue's gauges, or nullptr not to (default: the
+            /// Reddit instance's metrics)
+            Metrics * metrics;
+
+            /// How dispatch() saves and loads items that it spills to disk (default: set for
+            /// the streams that support Overflow::spill)
+            typename Dispatcher<T>::Encode encode;
+            typename Dispatcher<T>::Decode decode;
+
+            /// The most pages to go back through to catch up after resuming from a checkpoint
+            /// (default: 10, which is as far back as Reddit's listings go)
+            size_t backfillpages;
+
+            /**
+             * @brief Construct a new Stream. Use a method such as Subreddit::stream() rather
+             * than constructing a Stream directly.
+             *
+             * @param fetch Fetches the newest items of the listing
+             * @param skipexisting Whether to skip the items that are in the listing when the
+             * stream starts
+             * @param fetchpage Fetches older pages of the listing, to catch up after resuming
+             * from a checkpoint (default: nullptr, which only catches up on the newest items)
+             */
+            Stream (Fetch fetch, bool skipexisting = false, FetchPage fetchpage = nullptr) {
+                interval = std::chrono::seconds(1);
+                maxinterval = std::chrono::seconds(16);
+                memory = 1000;
+                executor = nullptr;
+                metrics = nullptr;
+                backfillpages = 10;
+                _fetch = fetch;
+                _fetchpage = fetchpage;
+                _skip = skipexisting;
+                _wait = std::chrono::milliseconds(0);
+                _backfill = false;
+            }
+
+            /**
+             * @brief Stop the poll that is running ahead, if there is one
+             */
+            ~Stream () {
+                _stopping.cancel();
+            }
+
+            Stream (const Stream &) = delete;
+            Stream & operator= (const Stream &) = delete;
+            Stream (Stream &&) = default;
+            Stream & operator= (Stream &&) = default;
+
+            /**
+             * @brief Wait for the next new item.
+             *
+             * @param cancellation Stops waiting when cancelled (default: none)
+             * @return std::optional<T> The item, or nothing if the stream was cancelled
+             */
+            std::optional<T> next (const CancellationToken & cancellation = CancellationToken::none()) {
+                while (_pending.empty()) {
+                    // everything returned so far has been handled (or, under dispatch(), handed
+                    // to the dispatcher, which keeps track of what has been handled), so this is
+                    // a good time to save
+                    if (_checkpointpath != "" && std::chrono::steady_clock::now() - _lastcheckpoint >= _checkpointinterval) {
+                        savecheckpoint();
+                    }
+                    try {
+                        if (_backfill) {
+                            _catchup(cancellation);
+                        } else if (_prefetch != nullptr) {
+                            if (!_collect(cancellation)) {
+                                return std::nullopt;
+                            }
+                        } else {
+                            if (!cancellation.sleep(_wait)) {
+                                return std::nullopt;
+                            }
+                            _queue(_fetch(cancellation));
+                        }
+                    } catch (const errors::CancelledError &) {
+                        return std::nullopt;
+                    }
+                    if (executor != nullptr) {
+                        _startprefetch();
+                    }
+                }
+                T item = std::move(_pending.front());
+                _pending.pop_front();
+                _cursor = item.fullname;
+                return item;
+            }
+
+            /**
+             * @brief Save the stream's position to a file every so often, and resume from the
+             * file if it already exists.
+             *
+             * The file holds the newest item that has been handled and the items the stream
+             * remembers. It is small, and is replaced atomically whenever the stream polls
+             * after the interval has passed. When resuming, the stream pages back through the
+             * listing until it reaches the saved item, and returns everything newer before it
+             * starts polling. A seenfilter is not saved with the checkpoint; save it with
+             * SeenFilter::save().
+             *
+             * With next() and run(), an item counts as handled once the next one is asked for.
+             * With dispatch(), the checkpoint only moves past an item once the handler has
+             * returned for it and for every item before it, so items that were queued or being
+             * handled when the process stopped are returned again after a restart. Delivery is
+             * at least once: a handler may see an item again, but never misses one.
+             *
+             * @param path The file to save to and resume from
+             * @param interval The least time between saves (default: 30 s)
+             * @throws errors::FileOperationError if the file exists but isn't a checkpoint
+             */
+            void checkpoint (const std::string & path, std::chrono::milliseconds interval = std::chrono::seconds(30)) {
+                _checkpointpath = path;
+                _checkpointinterval = interval;
+                _lastcheckpoint = std::chrono::steady_clock::now();
+                std::optional<std::string> contents = readfile(path);
+                if (!contents.has_value()) {
+                    return;
+                }
+                nlohmann::json saved = nlohmann::json::parse(*contents, nullptr, false);
+                if (!saved.is_object() || !saved["cursor"].is_string() || !saved["seen"].is_array()) {
+                    throw errors::FileOperationError("\"" + path + "\" is not a stream checkpoint.");
+                }
+                _seen.filter = seenfilter;
+                for (const nlohmann::json & fullname : saved["seen"]) {
+                    _seen.insert(fullname.get<std::string>(), memory);
+                }
+                _cursor = saved["cursor"].get<std::string>();
+                // the items posted since the checkpoint are new, even if the stream skips existing items
+                _skip = false;
+                _backfill = _cursor != "" && _fetchpage != nullptr;
+            }
+
+            /**
+             * @brief Save the stream's position now, e.g. before shutting down. Does nothing
+             * if checkpoint() hasn't been called.
+             *
+             * @throws errors::FileOperationError if the file can't be written
+             */
+            void savecheckpoint () {
+                if (_checkpointpath == "") {
+                    return;
+                }
+                // items that haven't been handled yet have to be returned after a restart
+                std::set<std::string> unhandled;
+                for (const T & item : _pending) {
+                    unhandled.insert(item.fullname);
+                }
+                std::string cursor = _cursor;
+                if (_commits != nullptr) {
+                    std::lock_guard<std::mutex> guard(_commits->lock);
+                    cursor = _commits->cursor;
+                    unhandled.insert(_commits->outstanding.begin(), _commits->outstanding.end());
+                }
+                nlohmann::json seen = nlohmann::json::array();
+                for (const std::string & fullname : _seen.recent()) {
+                    if (unhandled.count(fullname) == 0) {
+                        seen.push_back(fullname);
+                    }
+                }
+                writeatomically(_checkpointpath, nlohmann::json{{"cursor", cursor}, {"seen", seen}}.dump());
+                _lastcheckpoint = std::chrono::steady_clock::now();
+            }
+
+            /**
+             * @brief Pass every new item to a handler until the stream is cancelled.
+             *
+             * @param handler Called with each item, oldest first
+             * @param cancellation Stops the stream when cancelled
+             */
+            void run (const std::function<void (T &)> & handler, const CancellationToken & cancellation) {
+                while (std::optional<T> item = next(cancellation)) {
+                    handler(*item);
+                }
+            }
+
+            /**
+             * @brief Poll on the calling thread and pass every new item to a handler on a pool
+             * of workers (see Dispatcher), so that slow handlers don't hold up polling.
+             *
+             * Once the stream is cancelled, polling stops and the items that have already been
+             * queued are handled before this returns. If the handler throws, polling stops too.
+             * With checkpoint(), the checkpoint only moves past items once they have been
+             * handled, and is saved before this returns normally.
+             *
+             * @param handler Called with each item on one of the workers
+             * @param policy The size of the queue, the number of workers and what to do when
+             * the queue is full
+             * @param cancellation Stops the stream when cancelled
+             * @throws The first exception thrown by the handler, if any
+             * @throws std::invalid_argument if the policy spills to disk but this stream's
+             * items can't be encoded
+             */
+            void dispatch (const std::function<void (T &)> & handler,
+                           const DispatchPolicy & policy,
+                           const CancellationToken & cancellation) {
+                // everything returned before this was handled by the caller
+                auto commits = std::make_shared<Commits>();
+                commits->cursor = _cursor;
+                _commits = commits;
+                Dispatcher<T> dispatcher(policy, handler, encode, decode, [commits] (uint64_t sequence) {
+                    commits->finish(sequence);
+                });
+                if (metrics != nullptr) {
+                    dispatcher.exportto(*metrics);
+                }
+                while (!dispatcher.failed()) {
+                    std::optional<T> item = next(cancellation);
+                    if (!item.has_value()) {
+                        break;
+                    }
+                    commits->add(item->fullname);
+                    if (!dispatcher.publish(std::move(*item), cancellation)) {
+                        break;
+                    }
+                }
+                dispatcher.close();
+                savecheckpoint();
+            }
+
+        private:
+            Fetch _fetch;
+            FetchPage _fetchpage;
+            bool _skip;
+
+            /// The newest item that has been returned (or skipped)
+            std::string _cursor;
+
+            /// Whether to catch up on the items since the cursor before polling
+            bool _backfill;
+
+            /// Where to save checkpoints, and how often
+            std::string _checkpointpath;
+            std::chrono::milliseconds _checkpointinterval;
+            std::chrono::steady_clock::time_point _lastcheckpoint;
+
+            /// How long to wait before the next poll
+            std::chrono::milliseconds _wait;
+
+            /// Items that are new but haven't been returned yet, oldest first
+            std::deque<T> _pending;
+
+            SeenSet _seen;
+
+            /// Which of the items handed to dispatch() have been handled, so that checkpoints
+            /// don't move past items that haven't
+            struct Commits {
+                std::mutex lock;
+
+                /// The newest item that has been handled, along with everything before it
+                std::string cursor;
+
+                /// Items that have been published but not committed, in the order they were
+                /// published. The first one has sequence number committed.
+                std::deque<std::string> outstanding;
+                uint64_t committed = 0;
+
+                /// Sequence numbers of items after the first outstanding one that have been handled
+                std::set<uint64_t> finished;
+
+                /// Note an item that is about to be published
+                void add (const std::string & fullname) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    outstanding.push_back(fullname);
+                }
+
+                /// Note that an item has been handled (or thrown away), and move the cursor up
+                /// to the newest item that has been handled along with everything before it
+                void finish (uint64_t sequence) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    finished.insert(sequence);
+                    while (!finished.empty() && *finished.begin() == committed && !outstanding.empty()) {
+                        cursor = std::move(outstanding.front());
+                        outstanding.pop_front();
+                        finished.erase(finished.begin());
+                        committed++;
+                    }
+                }
+            };
+
+            /// The items handed to the latest dispatch(), or nullptr if dispatch() hasn't been called
+            std::shared_ptr<Commits> _commits;
+
+            /// A poll running on the executor
+            struct Prefetch {
+                std::mutex lock;
+                std::condition_variable done;
+                bool finished = false;
+                std::vector<T> items;
+                std::exception_ptr error;
+            };
+
+            std::shared_ptr<Prefetch> _prefetch;
+
+            /// Cancels the prefetch when the stream is destroyed
+            CancellationToken _stopping;
+
+            /// Start the next poll on the executor, after waiting the interval
+            void _startprefetch () {
+                auto prefetch = std::make_shared<Prefetch>();
+                _prefetch = prefetch;
+                // the task may outlive the stream, so it mustn't touch it
+                executor->post([prefetch, fetch = _fetch, stopping = _stopping] {
+                    std::vector<T> items;
+                    std::exception_ptr error;
+                    try {
+                        items = fetch(stopping);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    {
+                        std::lock_guard<std::mutex> guard(prefetch->lock);
+                        prefetch->items = std::move(items);
+                        prefetch->error = error;
+                        prefetch->finished = true;
+                    }
+                    prefetch->done.notify_all();
+                }, _wait);
+            }
+
+            /// Wait for the prefetch to finish and queue up anything new, returning false if
+            /// cancelled first
+            bool _collect (const CancellationToken & cancellation) {
+                std::unique_lock<std::mutex> guard(_prefetch->lock);
+                while (!_prefetch->finished) {
+                    if (cancellation.cancelled()) {
+                        return false;
+                    }
+                    // cancelling the token doesn't signal this condition variable, so check it every so often
+                    _prefetch->done.wait_for(guard, std::chrono::milliseconds(20));
+                }
+                std::shared_ptr<Prefetch> prefetch = std::move(_prefetch);
+                guard.unlock();
+                if (prefetch->error != nullptr) {
+                    std::rethrow_exception(prefetch->error);
+                }
+                _queue(std::move(prefetch->items));
+                return true;
+            }
+
+            /// Page back through the listing to the cursor, and queue up everything newer
+            void _catchup (const CancellationToken & cancellation) {
+                std::vector<T> newer;
+                ListingPage page;
+                bool reached = false;
+                for (size_t i = 0; i < backfillpages && !reached; i++) {
+                    for (T & item : _fetchpage(page, cancellation)) {
+                        if (_older(item.fullname)) {
+                            reached = true;
+                            break;
+                        }
+                        newer.push_back(std::move(item));
+                    }
+                    if (page.after == "") {
+                        break;
+                    }
+                }
+                _backfill = false;
+                _queue(std::move(newer));
+            }
+
+            /// Whether an item is the cursor or came before it. Ids of the same type are handed
+            /// out in order, so they can be compared once packed.
+            bool _older (const std::string & fullname) const {
+                return fullname == _cursor ||
+                       (fullname.compare(0, 3, _cursor, 0, 3) == 0 && SeenFilter::pack(fullname) < SeenFilter::pack(_cursor));
+            }
+
+            /// Queue up anything new in a fetched listing
+            void _queue (std::vector<T> items) {
+                bool found = false;
+                // the listing is newest first
+                for (auto item = items.rbegin(); item != items.rend(); item++) {
+                    _seen.filter = seenfilter;
+                    if (!_seen.insert(item->fullname, memory)) {
+                        continue;
+                    }
+                    found = true;
+                    if (!_skip) {
+                        _pending.push_back(std::move(*item));
+                    } else {
+                        _cursor = item->fullname;
+                    }
+                }
+                _skip = false;
+                _wait = found ? interval : std::min(std::max(_wait * 2, interval), maxinterval);
+            }
+    };
+}
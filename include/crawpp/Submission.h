@@ -23,6 +23,13 @@ namespace CRAW {
              * @param direction 1 for upvote, -1 for downvote, 0 for unvote
              */
             void _vote (int direction);
+
+            /**
+             * The body of a request to distinguish a reply as a moderator
+             *
+             * @param reply The reply to distinguish
+             */
+            static std::string _distinguishbody (const Submission & reply);
         public:
             /**
              *  Stores information about the submission.
@@ -39,6 +46,11 @@ namespace CRAW {
 			The username of the author of the submission
 			*/
             std::string authorname;
+            /**
+             * The fullname of the author, e.g. "t2_abc123" (empty if the author was deleted).
+             * Authors can be fetched in bulk with Reddit::redditors().
+             */
+            std::string authorfullname;
             /** Fetches a Redditor instance for the author of the submission */
             Redditor author ();
 
@@ -101,6 +113,13 @@ namespace CRAW {
             */
             Comment reply (const std::string & contents, bool distinguish = false); 
 
+#ifdef CRAW_COROUTINES
+            /**
+             * @brief Reply to the submission without blocking (see reply())
+             */
+            Task<Comment> reply_co (std::string contents, bool distinguish = false);
+#endif
+
             /**
             Returns the subreddit that the submission was made in
 
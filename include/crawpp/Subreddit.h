@@ -6,9 +6,11 @@
 #include <string>
 
 #include "crawpp/CRAWObject.h"
+#include "crawpp/Fields.hpp"
 #include "crawpp/Reddit.h"
 #include "crawpp/Rule.h"
 #include "crawpp/ListingPage.hpp"
+#include "crawpp/Listing.hpp"
 
 namespace CRAW {
 
@@ -80,6 +82,13 @@ namespace CRAW {
     */
     class Subreddit : public CRAWObject{
         private:
+            /**
+             * Initialise this Subreddit instance with the given data
+             * 
+             * @param data The "data" field of the API response for the subreddit's about page
+             */
+            void _init (const nlohmann::json & data);
+
             /**
              * @brief Upload media to Reddit.
              * 
@@ -95,7 +104,44 @@ namespace CRAW {
              * 
              * @return A string containing the uploaded image's URL
              */
-            std::string _upload (const std::string & mediapath, const std::string & caption = "");
+            std::string _upload (const std::string & mediapath, const std::string & caption = "",
+                                 const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * Check that a response from a subreddit's about page is for that subreddit,
+             * rather than a search for similar names
+             *
+             * @throws errors::NotFoundError if the subreddit doesn't exist
+             */
+            static void _checkabout (const std::string & subredditname, const nlohmann::json & about);
+
+            /**
+             * Check the string arguments of posts() and turn them into a ListingRequest and
+             * a Direction
+             */
+            ListingRequest _parselisting (const std::string & sort,
+                                          const std::string & period,
+                                          const int limit,
+                                          const ListingPage * listingpage,
+                                          const std::string & direction,
+                                          Direction & parseddirection) const;
+
+            /**
+             * The URL of the page of a listing to fetch: the request's own URL for the first
+             * page, or that URL with the page's cursor added, which is built in buffer
+             */
+            static const std::string & _listingurl (const ListingRequest & request,
+                                                    const ListingPage * listingpage,
+                                                    Direction direction,
+                                                    std::string & buffer);
+
+            /**
+             * Turn a listing of posts into Post objects, updating the ListingPage (if any)
+             */
+            std::vector<Post> _listingposts (nlohmann::json & responsejson, ListingPage * listingpage);
+
+            // so that subreddits can be fetched without blocking
+            friend class Reddit;
 
         public:
             /**
@@ -156,12 +202,48 @@ namespace CRAW {
             */
             Subreddit (const std::string & subredditname, Reddit * redditinstance);
 
+            /**
+             * Construct a new Subreddit object with the given information, in the
+             * form of a Reddit API call response. This constructor expects the "data"
+             * object within the response, such as that of the subreddit's about page. 
+             * Use this to avoid making a duplicate API call.
+             * 
+             * @param data The "data" field of the API response, as a JSON object
+             * @param redditinstance The Reddit instance to associate with the subreddit
+             */
+            Subreddit (nlohmann::json & data, Reddit * redditinstance);
+
             /**
             The [] operator is used to fetch information about a subreddit. All information is returned as a std::string.
             Some commonly-used attributes can be fetched using the dot operator (.), but all information can be fetched using this.
             */
             std::string operator[] (const std::string & attribute);
 
+            /**
+             * @brief Read a field of the subreddit's information, without the string
+             * conversions of operator[]
+             *
+             * @tparam Field The field, e.g. fields::over18
+             * @return The value, or a reference to it for strings
+             * @throws std::invalid_argument if the field is missing or null (see has())
+             */
+            template <typename Field>
+            fields::result<Field> get () const {
+                static_assert(Field::subreddit, "Subreddits don't have this field");
+                return fields::read<Field>(information);
+            }
+
+            /**
+             * @brief Whether the subreddit's information has a field that isn't null
+             *
+             * @tparam Field The field
+             */
+            template <typename Field>
+            bool has () const {
+                static_assert(Field::subreddit, "Subreddits don't have this field");
+                return fields::present<Field>(information);
+            }
+
             /**
             Fetches posts sorted in the specified way, up to the specified limit (default: 25 + pinned posts if sorting by hot).
 
@@ -179,12 +261,108 @@ namespace CRAW {
             retrieved by passing it to another posts() call.
             @param direction Whether to return the page after the page provided in listingpage, or the page before
             (either "after" or "before", default: "after"). Ignored if listingpage is nullptr.
+            @param cancellation Cancels the request (default: none)
             */
             std::vector<Post> posts (const std::string & sort = "hot",
                                      const std::string & period = "all",
                                      const int limit = 25,
                                      ListingPage * listingpage = nullptr,
-                                     const std::string & direction = "after");
+                                     const std::string & direction = "after",
+                                     const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Build a request for a listing of the subreddit's posts, to be fetched
+             * with posts(). Build it once and keep it when fetching the same listing over
+             * and over, e.g. when polling.
+             *
+             * @code
+             * CRAW::ListingRequest newest = subreddit.listing(CRAW::Sort::newest, CRAW::Period::all, 100);
+             * CRAW::ListingPage page;
+             * std::vector<CRAW::Post> posts = subreddit.posts(newest, &page);
+             * @endcode
+             *
+             * @param sort How to sort the posts (default: Sort::hot)
+             * @param period The period to sort over, for Sort::top and Sort::controversial
+             * (default: Period::all)
+             * @param limit How many posts to fetch per page (default: 25, max: 100)
+             * @return ListingRequest The request
+             * @throws std::invalid_argument if the limit isn't in [0, 100]
+             */
+            ListingRequest listing (Sort sort = Sort::hot, Period period = Period::all, int limit = 25) const;
+
+            /**
+             * @brief Fetch a page of posts from a listing built by listing()
+             *
+             * @param request The listing
+             * @param listingpage If not null, the page to flip from, which is updated to the
+             * page returned, as in the other posts() (default: nullptr, which means the first page)
+             * @param direction Whether to fetch the page after or before listingpage (default:
+             * Direction::after). Ignored if listingpage is nullptr.
+             * @param cancellation Cancels the request (default: none)
+             * @return std::vector<Post> The posts
+             */
+            std::vector<Post> posts (const ListingRequest & request,
+                                     ListingPage * listingpage = nullptr,
+                                     Direction direction = Direction::after,
+                                     const CancellationToken & cancellation = CancellationToken::none());
+
+            /**
+             * @brief Stream new posts on the subreddit as they are made, oldest first.
+             * 
+             * @param skipexisting Whether to skip the posts that already exist when the stream starts
+             * (default: false)
+             * @return Stream<Post> The stream
+             */
+            Stream<Post> stream (bool skipexisting = false);
+
+#ifdef CRAW_COROUTINES
+            /**
+             * @brief Fetch posts without blocking (see posts())
+             */
+            Task<std::vector<Post>> posts_co (std::string sort = "hot",
+                                              std::string period = "all",
+                                              int limit = 25,
+                                              ListingPage * listingpage = nullptr,
+                                              std::string direction = "after",
+                                              CancellationToken cancellation = CancellationToken::none());
+
+            /**
+             * @brief Fetch a page of posts from a listing built by listing() without blocking
+             * (see posts())
+             */
+            Task<std::vector<Post>> posts_co (ListingRequest request,
+                                              ListingPage * listingpage = nullptr,
+                                              Direction direction = Direction::after,
+                                              CancellationToken cancellation = CancellationToken::none());
+
+            /**
+             * @brief Go through every post in a listing, fetching the pages as they are needed.
+             *
+             * @param sort How to sort the posts (see posts()) (default: "hot")
+             * @param period The period to sort over (see posts()) (default: "all")
+             * @param cancellation Cancels the request for the page being fetched (default: none)
+             * @return AsyncGenerator<Post> The posts, in the listing's order. The Subreddit
+             * must outlive it.
+             */
+            AsyncGenerator<Post> posts_all_co (std::string sort = "hot",
+                                               std::string period = "all",
+                                               CancellationToken cancellation = CancellationToken::none());
+
+            /**
+             * @brief Stream new posts on the subreddit without blocking (see stream()). Polls
+             * wait on the Reddit instance's executor.
+             *
+             * @param skipexisting Whether to skip the posts that already exist when the stream starts
+             * @param cancellation Ends the stream when cancelled (default: none)
+             * @param seenfilter If not null, the filter to remember seen posts in (see
+             * Stream::seenfilter) (default: nullptr)
+             * @return AsyncGenerator<Post> The new posts, oldest first. The Subreddit must
+             * outlive it.
+             */
+            AsyncGenerator<Post> stream_co (bool skipexisting = false,
+                                            CancellationToken cancellation = CancellationToken::none(),
+                                            std::shared_ptr<SeenFilter> seenfilter = nullptr);
+#endif
 
             /**
              * @brief Make a new post on a subreddit. Returns the newly-made post as a Post instance
@@ -213,6 +391,7 @@ namespace CRAW {
              * @param contents The filepath to the content of the post
              * @param type The type of the post, either "image" or "video" (default: "image").
              * @param options A PostOptions struct containing the options for the post
+             * @param cancellation Cancels the upload and the post (default: none)
              * 
              * @note To make a text or link post, use post() instead. Only use this message if
              * media needs to be uploaded. Posts that merely link to some media (like a YouTube
@@ -221,7 +400,8 @@ namespace CRAW {
             void postmedia (const std::string & title,
                             const std::string & contents,
                             const std::string & type = "image",
-                            const PostOptions & options = PostOptions());
+                            const PostOptions & options = PostOptions(),
+                            const CancellationToken & cancellation = CancellationToken::none());
             
             /**
             Subscribe to a subreddit. Returns a reference to the subreddit so that
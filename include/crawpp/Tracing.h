@@ -0,0 +1,154 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "crawpp/Transport.h"
+
+namespace CRAW {
+
+    /**
+     * @brief One timed operation, such as a single HTTP request or a call to Subreddit::postmedia().
+     *
+     * Spans started while another span is open on the same thread become its children,
+     * so a slow call can be broken down into the requests it made.
+     */
+    struct Span {
+        /// A number that identifies this span, unique within the process
+        uint64_t id;
+
+        /// The ID of the span that this one was started inside of, or 0 if there was none
+        uint64_t parent;
+
+        /// What the span is timing, e.g. "Post::comments" or "GET /r/{sub}/hot"
+        std::string name;
+
+        /// Extra information about the operation, such as the HTTP status code
+        std::map<std::string, std::string> attributes;
+
+        /// When the span started
+        std::chrono::steady_clock::time_point start;
+
+        /// When the span ended (only meaningful once it has ended)
+        std::chrono::steady_clock::time_point end;
+
+        /// For HTTP requests, how long each phase of the request took
+        HTTPTimings timings;
+
+        /// Whether the operation ended by throwing an exception
+        bool failed;
+
+        Span () {
+            id = 0;
+            parent = 0;
+            failed = false;
+        }
+
+        /**
+         * @brief How long the span lasted
+         *
+         * @return double The duration of the span, in seconds
+         */
+        double duration () const {
+            return std::chrono::duration<double>(end - start).count();
+        }
+    };
+
+    /**
+     * @brief Where a Reddit instance reports its spans.
+     *
+     * Nothing is traced until a callback is set. The callbacks are called on the thread that
+     * made the call being traced, must not throw, and should be quick. Attributes and timings
+     * are filled in as the operation goes, so they are only complete in onend.
+     *
+     * Like the RetryPolicy, the callbacks should not be changed while requests are being
+     * made from other threads.
+     */
+    class Tracer {
+        public:
+            /// Called when a span starts
+            std::function<void (const Span &)> onbegin;
+
+            /// Called when a span ends
+            std::function<void (const Span &)> onend;
+
+            /**
+             * @brief Whether any callbacks are set
+             */
+            bool enabled () const {
+                return onbegin || onend;
+            }
+
+            /**
+             * @brief The innermost span that is open on the calling thread
+             *
+             * @return Span* The span, or nullptr if there is none
+             */
+            static Span * current ();
+    };
+
+    /**
+     * @brief A span that starts when it is constructed and ends when it goes out of scope.
+     *
+     * If the tracer has no callbacks, this does nothing.
+     */
+    class ScopedSpan {
+        private:
+            /// The tracer to report to, or nullptr if tracing is off
+            Tracer * _tracer;
+
+            Span _span;
+
+            /// The span that was open on this thread before this one
+            Span * _previous;
+
+            /// How many exceptions were in flight when the span started
+            int _exceptions;
+
+            /// Whether spans started on this thread while this one is open are its children
+            bool _nested;
+
+        public:
+            /**
+             * @brief Start a span
+             *
+             * @param tracer The tracer to report the span to
+             * @param name What the span is timing
+             * @param nested Whether spans started on this thread while this one is open
+             * become its children (default: true). Pass false for a span that is held across
+             * a co_await, since the coroutine can carry on on another thread.
+             */
+            ScopedSpan (Tracer & tracer, const std::string & name, bool nested = true);
+
+            ~ScopedSpan ();
+
+            ScopedSpan (const ScopedSpan &) = delete;
+            ScopedSpan & operator= (const ScopedSpan &) = delete;
+
+            /**
+             * @brief Whether the span is being reported. When it is not, there is no
+             * point in working out its attributes.
+             */
+            bool active () const {
+                return _tracer != nullptr;
+            }
+
+            /**
+             * @brief Set one of the span's attributes. This does nothing if the span is not active.
+             *
+             * @param name The name of the attribute
+             * @param value The value of the attribute
+             */
+            void attribute (const std::string & name, const std::string & value);
+
+            /**
+             * @brief Set the phases of the HTTP request that this span timed
+             *
+             * @param timings The timings of the request
+             */
+            void timings (const HTTPTimings & timings);
+    };
+}
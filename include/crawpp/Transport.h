@@ -0,0 +1,499 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cpr/cpr.h>
+
+#include "crawpp/Cancellation.h"
+
+namespace CRAW {
+
+    /**
+     * @brief A single HTTP request, as handed by a Reddit instance to its Transport.
+     *
+     * The query string (if any) is already part of path, and form payloads have
+     * already been encoded into body, so a request is fully described by these members.
+     */
+    struct HTTPRequest {
+        /// The HTTP method to use (e.g. "POST", "GET")
+        std::string method;
+
+        /// The scheme and host to send the request to (e.g. "https://oauth.reddit.com")
+        std::string host;
+
+        /// The path of the request, including the query string (e.g. "/r/cpp/hot?after=t3_abc")
+        std::string path;
+
+        /// The headers to send with the request
+        cpr::Header header;
+
+        /// The body of the request (empty if none)
+        std::string body;
+
+        /// How many times this request has already been tried (0 for the first attempt)
+        int attempt;
+
+        /// How long to wait for a connection to be made (0 to wait forever)
+        std::chrono::milliseconds connecttimeout;
+
+        /// How long the whole request may take (0 to wait forever)
+        std::chrono::milliseconds timeout;
+
+        /// Aborts the request when cancelled
+        CancellationToken cancellation;
+
+        HTTPRequest () : cancellation(CancellationToken::none()) {
+            attempt = 0;
+            connecttimeout = std::chrono::milliseconds(0);
+            timeout = std::chrono::milliseconds(0);
+        }
+
+        /**
+         * @brief The key that identifies this request when it is recorded or replayed.
+         *
+         * The host and headers are deliberately left out so that recordings made
+         * with one session can be replayed by another.
+         *
+         * @return std::string of the form "METHOD path body"
+         */
+        std::string key () const {
+            return method + " " + path + (body.empty() ? "" : " " + body);
+        }
+    };
+
+    /**
+     * @brief How long each phase of an HTTP request took, in seconds, as timed by curl.
+     *
+     * Phases that didn't happen (e.g. the DNS lookup and connection when an existing
+     * connection was reused) are 0, as are all of them for transports that don't use the network.
+     */
+    struct HTTPTimings {
+        /// Resolving the host name
+        double dns;
+
+        /// Opening the TCP connection
+        double connect;
+
+        /// The TLS handshake
+        double tls;
+
+        /// Waiting for the first byte of the response after the request was sent
+        double wait;
+
+        /// Receiving the rest of the response
+        double transfer;
+
+        HTTPTimings () {
+            dns = 0;
+            connect = 0;
+            tls = 0;
+            wait = 0;
+            transfer = 0;
+        }
+    };
+
+    /**
+     * @brief The server's response to an HTTPRequest.
+     */
+    struct HTTPResponse {
+        /// The HTTP status code, or 0 if no response was received
+        long status_code;
+
+        /// The headers sent by the server
+        cpr::Header header;
+
+        /// The body of the response
+        std::string text;
+
+        /// How long the request took, in seconds
+        double elapsed;
+
+        /// A description of what went wrong if no response was received (empty otherwise)
+        std::string error;
+
+        /// How long each phase of the request took
+        HTTPTimings timings;
+
+        /**
+         * How many bytes of body were received over the network before decompression, or 0
+         * if unknown (e.g. for transports that don't use the network)
+         */
+        size_t wirebytes;
+
+        /// The version of HTTP that the response came over (e.g. "HTTP/2"), or empty if unknown
+        std::string httpversion;
+
+        /// How many new connections had to be opened to send the request (0 if one was reused)
+        long newconnections;
+
+        HTTPResponse () {
+            status_code = 0;
+            elapsed = 0;
+            wirebytes = 0;
+            newconnections = 0;
+        }
+    };
+
+    /**
+     * @brief A Transport is what a Reddit instance uses to actually send its requests.
+     *
+     * By default, requests are sent over the network with CPRTransport. Other transports
+     * can be given to a Reddit instance to, for example, record traffic to disk or replay
+     * it without a network connection.
+     */
+    class Transport {
+        public:
+            /// Called with the response to a request sent with sendasync()
+            using Callback = std::function<void (HTTPResponse)>;
+
+            virtual ~Transport () = default;
+
+            /**
+             * @brief Send a request and wait for the response.
+             *
+             * Transports that use the network should honour the request's timeouts and give
+             * up promptly (with no response) when its CancellationToken is cancelled.
+             *
+             * @param request The request to send
+             * @return HTTPResponse The server's response
+             */
+            virtual HTTPResponse send (const HTTPRequest & request) = 0;
+
+            /**
+             * @brief Send a request, and call a function with the response once it arrives.
+             *
+             * By default this calls send() and then done on the calling thread. Transports
+             * that can wait for many responses at once (such as MultiplexTransport) call done
+             * from their own thread instead, without blocking the caller.
+             *
+             * @param request The request to send, which is copied if needed
+             * @param done Called exactly once with the response (which has status code 0 if
+             * there was none). It must not throw.
+             */
+            virtual void sendasync (const HTTPRequest & request, Callback done) {
+                done(send(request));
+            }
+
+            /**
+             * @brief Call a function after a while, on the thread that sendasync() calls back
+             * on. Only transports that must keep everything on one thread (such as a
+             * MultiplexTransport driven by an EventLoop) do this.
+             *
+             * @param delay How long to wait
+             * @param task The function to call, which must not throw
+             * @return bool Whether the transport took the task (default: false, in which case
+             * the caller has to wait some other way)
+             */
+            virtual bool after (std::chrono::milliseconds /*delay*/, std::function<void ()> /*task*/) {
+                return false;
+            }
+    };
+
+    /**
+     * @brief The default Transport, which sends requests over the network using cpr.
+     */
+    class CPRTransport : public Transport {
+        public:
+            /**
+             * If not empty, the scheme and host that all requests are sent to instead of the one
+             * in the request, e.g. "http://127.0.0.1:8080" to talk to a local mock server
+             */
+            std::string host;
+
+            /**
+             * Whether to ask for compressed responses (default: true). Every encoding that
+             * curl can decode is offered, which always includes gzip and deflate.
+             */
+            bool compression;
+
+            /**
+             * @brief Construct a new CPRTransport
+             * 
+             * @param host If not empty, the scheme and host to send all requests to instead of
+             * Reddit's (default: "")
+             */
+            CPRTransport (const std::string & host = "");
+
+            HTTPResponse send (const HTTPRequest & request) override;
+    };
+
+    /**
+     * @brief A Transport that passes requests on to another Transport and saves
+     * every exchange to a directory, so that it can later be replayed by ReplayTransport.
+     *
+     * Each exchange is saved as its own JSON file, which holds the request's method and
+     * path along with the status code, headers, and body of the response.
+     *
+     * Requests for an access token are saved with their body (which holds the username
+     * and password) replaced by "[redacted]", and so are the access_token and refresh_token
+     * of the response. ReplayTransport answers any token request with such a recording.
+     */
+    class RecordingTransport : public Transport {
+        private:
+            /// The Transport that actually sends the requests
+            std::shared_ptr<Transport> _inner;
+
+            /// The directory that the recordings are saved to
+            std::string _directory;
+
+            /// Serialises writes to the directory
+            std::mutex _lock;
+
+        public:
+            /**
+             * @brief Construct a new RecordingTransport
+             *
+             * @param directory The directory to save the recordings to. It is created if it doesn't exist.
+             * @param inner The Transport to send requests with (default: a new CPRTransport)
+             */
+            RecordingTransport (const std::string & directory, std::shared_ptr<Transport> inner = nullptr);
+
+            HTTPResponse send (const HTTPRequest & request) override;
+    };
+
+    /**
+     * @brief A Transport that answers requests from recordings on disk instead of
+     * the network. It is meant for running and benchmarking code deterministically
+     * without network access.
+     *
+     * Requests are matched by HTTPRequest::key(). A request for an access token that no
+     * recording matches exactly is answered by the redacted recording made by
+     * RecordingTransport, if there is one. If no recording matches a request, it is
+     * answered with HTTP 404 (Not Found).
+     */
+    class ReplayTransport : public Transport {
+        private:
+            /// The recorded responses, by request key
+            std::unordered_map<std::string, HTTPResponse> _responses;
+
+        public:
+            /**
+             * How long to wait before answering each request, to simulate network latency
+             * (default: 0)
+             */
+            std::chrono::microseconds latency;
+
+            /**
+             * @brief Construct a new ReplayTransport
+             *
+             * @param directory A directory of recordings, such as one written by RecordingTransport
+             * or the fixtures directory that comes with CRAW++
+             * @param latency How long to wait before answering each request (default: 0)
+             */
+            ReplayTransport (const std::string & directory, std::chrono::microseconds latency = std::chrono::microseconds(0));
+
+            /**
+             * @brief Load all of the recordings in a directory, replacing any existing
+             * recordings for the same requests.
+             *
+             * @param directory The directory to load recordings from
+             */
+            void load (const std::string & directory);
+
+            /**
+             * @brief Add (or replace) a single recording.
+             *
+             * @param key The request key, as returned by HTTPRequest::key()
+             * @param response The response to answer the request with
+             */
+            void add (const std::string & key, const HTTPResponse & response);
+
+            HTTPResponse send (const HTTPRequest & request) override;
+    };
+
+    /**
+     * @brief An event loop that belongs to the application (e.g. one built on epoll), which a
+     * MultiplexTransport can be driven by instead of running its own thread.
+     *
+     * The transport tells the loop which sockets to watch and when it next needs to be woken
+     * up. In return, the loop calls MultiplexTransport::ready() whenever one of those sockets
+     * is ready, and MultiplexTransport::expired() once the timer runs out.
+     */
+    class EventLoop {
+        public:
+            /// What to watch a socket for, or what it is ready for. These can be combined.
+            enum Events {
+                readable = 1,
+                writable = 2,
+                error = 4
+            };
+
+            virtual ~EventLoop () = default;
+
+            /**
+             * @brief Start watching a socket, change what it is watched for, or stop watching it.
+             *
+             * @param socket The socket
+             * @param events What to watch it for, as a combination of readable and writable,
+             * or 0 to stop watching it. The socket may be closed straight afterwards.
+             */
+            virtual void watch (int socket, int events) = 0;
+
+            /**
+             * @brief Set the loop's single timer for the transport, replacing the previous one.
+             *
+             * @param delay When to call MultiplexTransport::expired(). 0 means as soon as
+             * possible (but not from inside this call), and a negative delay cancels the timer.
+             */
+            virtual void timer (std::chrono::milliseconds delay) = 0;
+    };
+
+    /**
+     * @brief A Transport that multiplexes concurrent requests over a few long-lived
+     * connections, using HTTP/2 where the server supports it.
+     *
+     * All requests are driven by a single background thread using curl's multi interface,
+     * so any number of threads can call send() at once, and sendasync() doesn't block at
+     * all: its callback is called from the background thread. HTTPS connections negotiate HTTP/2
+     * and fall back to HTTP/1.1 if the server (or the linked curl) doesn't support it, in
+     * which case requests wait for one of the connections to become free instead of
+     * sharing it.
+     *
+     * Given an EventLoop, the transport starts no thread of its own. Its sockets and timer are
+     * watched by the loop instead, and everything happens on the loop's thread: sendasync()
+     * must be called from there, and its callbacks are called from ready() and expired().
+     */
+    class MultiplexTransport : public Transport {
+        private:
+            /// A request waiting for, or being sent by, the background thread
+            struct Pending;
+
+            CURLM * _multi;
+            std::thread _thread;
+            std::atomic<bool> _stopping;
+
+            /// Requests that the background thread hasn't picked up yet
+            std::deque<Pending *> _incoming;
+            std::mutex _lock;
+
+            /// The requests that have been handed to curl. Only used by the thread that drives them.
+            std::vector<Pending *> _inflight;
+
+            /// The application's event loop, if the transport is driven by one
+            EventLoop * _loop;
+
+            /// Functions passed to after(), by when they are due
+            std::multimap<std::chrono::steady_clock::time_point, std::function<void ()>> _timed;
+
+            /// The number of connections opened so far
+            std::atomic<long> _connections;
+
+            /// Run the background thread until the transport is destroyed
+            void _run ();
+
+            /// Hand the responses to requests that have finished or been cancelled to their callbacks
+            void _collect ();
+
+            /// Set the event loop's timer to curl's timeout, or sooner if a function passed to after()
+            /// is due first or a request can be cancelled
+            void _arm (long timeout);
+
+            /// Fail every request that is still in flight
+            void _abandon ();
+
+            /// Hand a finished request's response to its callback, and free the request
+            static void _finish (Pending * pending);
+
+            static int _socketcallback (CURL * handle, curl_socket_t socket, int what, void * transport, void * socketdata);
+
+            static int _timercallback (CURLM * multi, long timeout, void * transport);
+
+        public:
+            /**
+             * If not empty, the scheme and host that all requests are sent to instead of the one
+             * in the request, e.g. "http://127.0.0.1:8080" to talk to a local server
+             */
+            std::string host;
+
+            /// Whether to ask for compressed responses (default: true)
+            bool compression;
+
+            /// Whether to use HTTP/2 when the server supports it (default: true)
+            bool http2;
+
+            /**
+             * Whether to speak HTTP/2 to plain-text (http://) hosts without negotiating it first
+             * (default: false). Only turn this on for servers known to support it, such as a
+             * local h2c proxy.
+             */
+            bool priorknowledge;
+
+            /**
+             * If not empty, a file of CA certificates to trust instead of the system's, e.g. to
+             * test against a local server with a self-signed certificate
+             */
+            std::string cainfo;
+
+            /**
+             * @brief Construct a new MultiplexTransport and start its background thread
+             *
+             * @param host If not empty, the scheme and host to send all requests to instead of
+             * Reddit's (default: "")
+             * @param maxconnections The most connections to open to each host (default: 2)
+             * @param loop If not null, the event loop to drive requests with instead of a
+             * background thread (default: nullptr). It must outlive the transport.
+             */
+            MultiplexTransport (const std::string & host = "", long maxconnections = 2, EventLoop * loop = nullptr);
+
+            /**
+             * @brief Stop the background thread. Requests still in flight get no response.
+             * With an EventLoop, this must be called from the loop's thread.
+             */
+            ~MultiplexTransport ();
+
+            MultiplexTransport (const MultiplexTransport &) = delete;
+            MultiplexTransport & operator= (const MultiplexTransport &) = delete;
+
+            /**
+             * @brief How many connections have been opened so far
+             */
+            long connections () const {
+                return _connections.load();
+            }
+
+            /**
+             * @brief Send a request and wait for the response.
+             *
+             * With an EventLoop, the request is sent on a connection of its own, outside the
+             * loop, and blocks the calling thread; the library only does this to log in. Use
+             * sendasync() (or the *_co methods) for everything else.
+             */
+            HTTPResponse send (const HTTPRequest & request) override;
+
+            void sendasync (const HTTPRequest & request, Callback done) override;
+
+            /**
+             * @brief With an EventLoop, call a function from expired() once the delay has
+             * passed. Must be called from the loop's thread. Functions that are still waiting
+             * when the transport is destroyed are dropped.
+             *
+             * @return bool Whether there is an EventLoop to wait with
+             */
+            bool after (std::chrono::milliseconds delay, std::function<void ()> task) override;
+
+            /**
+             * @brief Carry on with the requests using a socket. Only for use by an EventLoop.
+             *
+             * @param socket A socket that the loop was asked to watch
+             * @param events What the socket is ready for, as a combination of
+             * EventLoop::Events
+             */
+            void ready (int socket, int events);
+
+            /**
+             * @brief Carry on with the requests once the loop's timer has run out. Only for
+             * use by an EventLoop.
+             */
+            void expired ();
+    };
+}
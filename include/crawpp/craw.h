@@ -11,4 +11,24 @@ header files to make it easier to test this library.
 #include "crawpp/Post.h"
 #include "crawpp/Comment.h"
 #include "crawpp/Message.h"
+#include "crawpp/Transport.h"
+#include "crawpp/Metrics.h"
+#include "crawpp/Tracing.h"
+#include "crawpp/Cancellation.h"
+#include "crawpp/Stream.hpp"
+#include "crawpp/BoundedQueue.hpp"
+#include "crawpp/Dispatcher.hpp"
+#include "crawpp/SeenFilter.h"
+#include "crawpp/Checkpoint.h"
+#include "crawpp/History.hpp"
+#include "crawpp/Expected.hpp"
+#include "crawpp/Fields.hpp"
+#include "crawpp/Listing.hpp"
+#include "crawpp/Hedging.h"
+#include "crawpp/Concurrency.h"
+#include "crawpp/CircuitBreaker.h"
+#include "crawpp/Scheduler.h"
+#include "crawpp/RedditPool.h"
+#include "crawpp/Executor.h"
+#include "crawpp/Coroutine.hpp"
 #include "crawpp/crawexceptions.hpp"
\ No newline at end of file
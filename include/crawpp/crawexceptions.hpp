@@ -10,6 +10,7 @@ namespace CRAW {
         |   |   |_LoginError
         |   |   |_NotLoggedInError
         |   |_NotFoundError
+        |   |_CircuitOpenError
         |_InvalidInteractionError
         |   |_EditingError
         |   |_PostingError
@@ -17,6 +18,8 @@ namespace CRAW {
         |   |   |_BanError
         |   |      |_BanDurationError
         |_FileOperationError
+        |_CancelledError
+            |_DeadlineExceededError
         */
 
 
@@ -104,6 +107,16 @@ namespace CRAW {
                 NotFoundError (const char * what) : CommunicationError(what) {}
         };
 
+        /**
+         * @brief When a request isn't sent because its endpoint has been failing and its
+         * circuit breaker is open (see CircuitBreakerTransport), CircuitOpenError is thrown.
+         */
+        class CircuitOpenError : public CommunicationError {
+            public:
+                CircuitOpenError (const std::string & what) : CommunicationError(what) {}
+                CircuitOpenError (const char * what) : CommunicationError(what) {}
+        };
+
         /**
          * @brief Whenever the user tries to interact with something in a way that is
          * invalid, such as trying to ban themselves or edit an image post, throw
@@ -174,5 +187,25 @@ namespace CRAW {
                 FileOperationError (const std::string & what = "") : CRAWError(what) {}
                 FileOperationError (const char * what) : CRAWError(what) {}
         };
+
+        /**
+         * @brief CancelledError is thrown when an operation is stopped because the
+         * CancellationToken passed to it was cancelled.
+         */
+        class CancelledError : public CRAWError {
+            public:
+                CancelledError (const std::string & what) : CRAWError(what) {}
+                CancelledError (const char * what) : CRAWError(what) {}
+        };
+
+        /**
+         * @brief DeadlineExceededError is thrown when an operation is stopped because
+         * the deadline of the CancellationToken passed to it passed.
+         */
+        class DeadlineExceededError : public CancelledError {
+            public:
+                DeadlineExceededError (const std::string & what) : CancelledError(what) {}
+                DeadlineExceededError (const char * what) : CancelledError(what) {}
+        };
     }
 }
\ No newline at end of file
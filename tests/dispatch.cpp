@@ -0,0 +1,229 @@
+/*
+Checks that BoundedQueue keeps its items in order when several threads use it at once, and
+that Dispatcher drops, spills and reports items as documented when its queue is full.
+
+Run with "make test".
+*/
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "crawpp/craw.h"
+
+static int failures = 0;
+
+/// Report a check that failed, carrying on with the rest
+static void check (bool passed, const std::string & description) {
+    if (!passed) {
+        std::cerr << "FAILED: " << description << std::endl;
+        failures++;
+    }
+}
+
+/// Holds up a handler until it is opened, so that items pile up in the queue behind it
+struct Gate {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool entered = false;
+    bool opened = false;
+
+    /// Called by the handler: wait for the gate to open
+    void pass () {
+        std::unique_lock<std::mutex> guard(lock);
+        entered = true;
+        changed.notify_all();
+        changed.wait(guard, [this] { return opened; });
+    }
+
+    /// Wait for the handler to reach the gate
+    void reached () {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return entered; });
+    }
+
+    void open () {
+        std::lock_guard<std::mutex> guard(lock);
+        opened = true;
+        changed.notify_all();
+    }
+};
+
+/// The items a dispatcher's handler and finished callback were called with
+struct Handled {
+    std::mutex lock;
+    std::vector<int> items;
+    std::vector<uint64_t> finished;
+};
+
+static void queueorder () {
+    CRAW::BoundedQueue<int> queue(5);
+    check(queue.capacity() == 8, "the capacity is rounded up to a power of 2");
+    for (int i = 0; i < 8; i++) {
+        check(queue.push(i), "an item is pushed while there is room");
+    }
+    int extra = 8;
+    check(!queue.push(extra) && extra == 8, "a full queue refuses an item without moving from it");
+    check(queue.size() == 8, "a full queue holds its capacity");
+    bool ordered = true;
+    for (int i = 0; i < 8; i++) {
+        std::optional<int> item = queue.pop();
+        ordered = ordered && item == i;
+    }
+    check(ordered, "items come out in the order they went in");
+    check(!queue.pop().has_value(), "an empty queue gives nothing");
+
+    // several producers and consumers at once, through a queue small enough to fill up and
+    // wrap around many times
+    const int producers = 4;
+    const int consumers = 4;
+    const int each = 50000;
+    CRAW::BoundedQueue<std::pair<int, int>> shared(64);
+    std::vector<std::vector<std::pair<int, int>>> taken(consumers);
+    std::atomic<int> remaining(producers * each);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&shared, p] {
+            for (int i = 0; i < each; i++) {
+                std::pair<int, int> item(p, i);
+                while (!shared.push(item)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&shared, &taken, &remaining, c] {
+            while (remaining > 0) {
+                if (std::optional<std::pair<int, int>> item = shared.pop()) {
+                    taken[c].push_back(*item);
+                    remaining--;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread & thread : threads) {
+        thread.join();
+    }
+    // each consumer takes items in queue order, so it must see each producer's items in the
+    // order they were pushed; between them, the consumers must take every item exactly once
+    bool fifo = true;
+    std::vector<std::vector<int>> counts(producers, std::vector<int>(each));
+    for (const auto & items : taken) {
+        std::vector<int> last(producers, -1);
+        for (const auto & [producer, i] : items) {
+            fifo = fifo && i > last[producer];
+            last[producer] = i;
+            counts[producer][i]++;
+        }
+    }
+    bool once = true;
+    for (const auto & producer : counts) {
+        for (int count : producer) {
+            once = once && count == 1;
+        }
+    }
+    check(fifo, "with several producers and consumers, each producer's items come out in order");
+    check(once, "with several producers and consumers, every item comes out exactly once");
+}
+
+static void dropoldest () {
+    CRAW::DispatchPolicy policy;
+    policy.capacity = 4;
+    policy.workers = 1;
+    policy.overflow = CRAW::Overflow::dropoldest;
+    Gate gate;
+    Handled handled;
+    CRAW::Dispatcher<int> dispatcher(policy, [&gate, &handled] (int & item) {
+        if (item == 0) {
+            gate.pass();
+        }
+        std::lock_guard<std::mutex> guard(handled.lock);
+        handled.items.push_back(item);
+    }, nullptr, nullptr, [&handled] (uint64_t sequence) {
+        std::lock_guard<std::mutex> guard(handled.lock);
+        handled.finished.push_back(sequence);
+    });
+    dispatcher.publish(0);
+    gate.reached();
+    for (int i = 1; i <= 10; i++) {
+        check(dispatcher.publish(i), "an item is published with dropoldest even when the queue is full");
+    }
+    check(dispatcher.dropped() == 6, "the items that didn't fit are dropped");
+    check(dispatcher.depth() == 4, "the queue stays full");
+    gate.open();
+    dispatcher.close();
+    check(handled.items == std::vector<int>({0, 7, 8, 9, 10}), "the oldest items are the ones dropped");
+    check(handled.finished.size() == 11, "dropped items are reported as finished too");
+}
+
+static void spill () {
+    std::string spillfile = "tests/dispatch.spill";
+    CRAW::DispatchPolicy policy;
+    policy.capacity = 2;
+    policy.workers = 1;
+    policy.overflow = CRAW::Overflow::spill;
+    policy.spillfile = spillfile;
+    policy.name = "test";
+    Gate gate;
+    Handled handled;
+    CRAW::Metrics metrics;
+    {
+        CRAW::Dispatcher<int> dispatcher(policy, [&gate, &handled] (int & item) {
+            if (item == 0) {
+                gate.pass();
+            }
+            std::lock_guard<std::mutex> guard(handled.lock);
+            handled.items.push_back(item);
+        }, [] (const int & item) {
+            return std::to_string(item);
+        }, [] (const std::string & line) {
+            return std::stoi(line);
+        });
+        dispatcher.exportto(metrics);
+        dispatcher.publish(0);
+        gate.reached();
+        for (int i = 1; i <= 9; i++) {
+            check(dispatcher.publish(i), "an item is published with spill even when the queue is full");
+        }
+        check(dispatcher.spilled() == 7, "the items that didn't fit are spilled");
+        check(dispatcher.depth() == 9, "spilled items count towards the depth");
+        check(std::filesystem::file_size(spillfile) > 0, "spilled items are written to the spill file");
+
+        std::string exported = metrics.prometheus();
+        check(exported.find("crawpp_test_queue_depth 9\n") != std::string::npos, "the depth is exported as a gauge");
+        check(exported.find("crawpp_test_queue_lag_seconds ") != std::string::npos, "the lag is exported as a gauge");
+        check(exported.find("crawpp_test_dropped 0\n") != std::string::npos, "the number dropped is exported as a gauge");
+        check(exported.find("crawpp_test_spilled 7\n") != std::string::npos, "the number spilled is exported as a gauge");
+
+        gate.open();
+        dispatcher.close();
+        check(handled.items == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}),
+              "every spilled item is handled exactly once, in order, after the queue drains");
+        check(dispatcher.dropped() == 0 && dispatcher.depth() == 0, "nothing is lost or left behind");
+        check(dispatcher.lag() > 0, "the lag of the last item is measured");
+    }
+    check(metrics.prometheus().find("crawpp_test_") == std::string::npos, "the gauges are removed with the dispatcher");
+    check(!std::filesystem::exists(spillfile), "the spill file is deleted with the dispatcher");
+}
+
+int main () {
+    queueorder();
+    dropoldest();
+    spill();
+
+    if (failures == 0) {
+        std::cout << "All checks passed" << std::endl;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,63 @@
+/*
+Checks that listings can be replayed from the recorded responses in the fixtures directory,
+so that the URLs CRAW++ builds for them stay the same as the recordings.
+
+Run with "make test". The fixtures directory can be given with the CRAWPP_FIXTURES
+environment variable (default: ./fixtures).
+*/
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "crawpp/craw.h"
+
+static int failures = 0;
+
+/// Report a check that failed, carrying on with the rest
+static void check (bool passed, const std::string & description) {
+    if (!passed) {
+        std::cerr << "FAILED: " << description << std::endl;
+        failures++;
+    }
+}
+
+static std::string fixturedirectory () {
+    const char * directory = std::getenv("CRAWPP_FIXTURES");
+    return directory == nullptr ? "fixtures" : directory;
+}
+
+int main () {
+    auto transport = std::make_shared<CRAW::ReplayTransport>(fixturedirectory());
+    CRAW::Reddit reddit("crawpp-tests/1.0", transport);
+    try {
+        CRAW::Subreddit cpp = reddit.subreddit("cpp");
+
+        // the example in fixtures/README.md
+        std::vector<CRAW::Post> hot = cpp.posts();
+        check(!hot.empty(), "the hot listing has posts");
+
+        CRAW::ListingPage page;
+        std::vector<CRAW::Post> first = cpp.posts("hot", "all", 25, &page);
+        check(first.size() == hot.size(), "the first page is the same with a ListingPage");
+        check(page.after != "", "the first page has a page after it");
+        std::vector<CRAW::Post> second = cpp.posts("hot", "all", 25, &page);
+        check(!second.empty(), "the page after the first one has posts");
+        check(second.empty() || first.empty() || second[0].id != first[0].id, "the second page is a different page");
+
+        CRAW::ListingRequest newest = cpp.listing(CRAW::Sort::newest);
+        check(newest.url == "/r/cpp/new", "a listing with the default limit doesn't send it");
+        check(!cpp.posts(newest).empty(), "the new listing has posts");
+
+        check(cpp.listing(CRAW::Sort::top, CRAW::Period::week, 100).url == "/r/cpp/top?limit=100&t=week",
+              "a top listing sends its limit and period");
+    } catch (const std::exception & e) {
+        check(false, std::string("replaying the listings threw: ") + e.what());
+    }
+
+    if (failures == 0) {
+        std::cout << "All checks passed" << std::endl;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
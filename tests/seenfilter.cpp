@@ -0,0 +1,166 @@
+/*
+Checks that SeenFilter packs fullnames as documented, keeps to its false positive rate,
+forgets the older window when it rotates, and survives being saved and loaded.
+
+Run with "make test".
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "crawpp/craw.h"
+
+static int failures = 0;
+
+/// Report a check that failed, carrying on with the rest
+static void check (bool passed, const std::string & description) {
+    if (!passed) {
+        std::cerr << "FAILED: " << description << std::endl;
+        failures++;
+    }
+}
+
+/// The fullname of the i-th item of a type, e.g. "t3_2s"
+static std::string fullname (int type, uint64_t i) {
+    std::string digits;
+    do {
+        digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[i % 36]);
+        i /= 36;
+    } while (i > 0);
+    return "t" + std::to_string(type) + "_" + digits;
+}
+
+/// How many of a range of items a filter takes for seen
+static size_t seen (const CRAW::SeenFilter & filter, int type, uint64_t from, uint64_t to) {
+    size_t found = 0;
+    for (uint64_t i = from; i < to; i++) {
+        found += filter.contains(fullname(type, i));
+    }
+    return found;
+}
+
+/// Whether loading a file throws FileOperationError
+static bool rejected (const std::string & path) {
+    try {
+        CRAW::SeenFilter::load(path);
+    } catch (const CRAW::errors::FileOperationError &) {
+        return true;
+    }
+    return false;
+}
+
+int main () {
+    // packing
+    check(CRAW::SeenFilter::pack("t3_abc123") == (3ULL << 59 | 0x252ce35bULL), "t3_abc123 packs into its type and base-36 id");
+    check(CRAW::SeenFilter::pack("t1_0") == 1ULL << 59, "the type goes in the top bits");
+    check(CRAW::SeenFilter::pack("t1_abc") != CRAW::SeenFilter::pack("t3_abc"), "the same id of different types packs differently");
+    check(CRAW::SeenFilter::pack("t5_zzzzzzzzzzz") == (5ULL << 59 | 131621703842267135ULL), "the longest base-36 id packs exactly");
+    check(CRAW::SeenFilter::pack("t3_ABC") >> 63 == 1, "a fullname that isn't base-36 is hashed");
+    check(CRAW::SeenFilter::pack("spez") >> 63 == 1, "something that isn't a fullname is hashed");
+    check(CRAW::SeenFilter::pack("spez") == CRAW::SeenFilter::pack("spez"), "hashing is repeatable");
+
+    // false positives
+    {
+        CRAW::SeenFilterPolicy policy;
+        policy.capacity = 100000;
+        policy.falsepositive = 0.001;
+        CRAW::SeenFilter filter(policy);
+        size_t inserted = 0;
+        for (uint64_t i = 0; i < policy.capacity; i++) {
+            inserted += filter.insert(fullname(3, i));
+        }
+        check(inserted >= policy.capacity * 0.998, "almost every new item is inserted as new");
+        check(!filter.insert(fullname(3, 42)), "an item that was inserted isn't new again");
+        check(seen(filter, 3, 0, policy.capacity) == policy.capacity, "every item that was inserted is seen");
+        double rate = static_cast<double>(seen(filter, 3, policy.capacity, 2 * policy.capacity)) / policy.capacity;
+        check(rate <= policy.falsepositive * 2, "the false positive rate is no more than twice the configured one (was " + std::to_string(rate) + ")");
+        check(rate >= policy.falsepositive / 20, "the filter isn't much bigger than it needs to be (false positive rate was " + std::to_string(rate) + ")");
+    }
+
+    // rotation
+    {
+        CRAW::SeenFilterPolicy policy;
+        policy.capacity = 1000;
+        policy.falsepositive = 0.001;
+        CRAW::SeenFilter filter(policy);
+        // an item taken for one already seen doesn't count towards the window, so fill each
+        // window until it is full
+        uint64_t first = 0;
+        while (filter.size() < policy.capacity) {
+            filter.insert(fullname(1, first++));
+        }
+        check(first < 1010, "the first window fills up with about as many items as its capacity");
+        std::vector<std::string> second;
+        for (uint64_t i = 0; i == 0 || filter.size() < policy.capacity; i++) {
+            std::string item = fullname(3, i);
+            if (filter.insert(item)) {
+                second.push_back(item);
+            }
+            if (i == 0) {
+                check(filter.size() == second.size(), "a full window starts a new one");
+            }
+        }
+        check(seen(filter, 1, 0, first) == first, "the first window is remembered while the second fills up");
+        filter.insert("t4_new");
+        check(filter.size() == 1, "the third window starts empty");
+        check(seen(filter, 1, 0, first) <= 10, "the first window is forgotten when the third starts");
+        size_t remembered = 0;
+        for (const std::string & item : second) {
+            remembered += filter.contains(item);
+        }
+        check(remembered == second.size(), "the second window is still remembered");
+        check(filter.contains("t4_new"), "the item that started the third window is remembered");
+    }
+
+    // saving and loading
+    {
+        std::string path = "tests/seenfilter.bin";
+        std::string broken = "tests/seenfilter.broken";
+        CRAW::SeenFilterPolicy policy;
+        policy.capacity = 5000;
+        policy.falsepositive = 0.01;
+        policy.window = std::chrono::hours(1);
+        CRAW::SeenFilter filter(policy);
+        for (uint64_t i = 0; i < 5000; i++) {
+            filter.insert(fullname(3, i));
+        }
+        for (uint64_t i = 0; i < 100; i++) {
+            filter.insert(fullname(1, i));
+        }
+        try {
+            filter.save(path);
+            std::shared_ptr<CRAW::SeenFilter> loaded = CRAW::SeenFilter::load(path);
+            check(loaded->size() == filter.size(), "a loaded filter has as many items in its current window");
+            check(loaded->bytes() == filter.bytes(), "a loaded filter is the same size");
+            check(seen(*loaded, 3, 0, 5000) == 5000, "a loaded filter remembers the older window");
+            check(seen(*loaded, 1, 0, 100) == 100, "a loaded filter remembers the current window");
+            check(seen(*loaded, 3, 5000, 10000) == seen(filter, 3, 5000, 10000), "a loaded filter has the same false positives");
+            check(!loaded->insert(fullname(1, 7)) && loaded->insert("t1_unseen"), "a loaded filter can be inserted into");
+
+            std::ifstream saved(path, std::ios::binary);
+            std::string contents((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+            std::ofstream(broken, std::ios::binary) << contents.substr(0, contents.size() - 100);
+            check(rejected(broken), "a truncated file is rejected");
+            std::ofstream(broken, std::ios::binary) << contents.substr(0, 20);
+            check(rejected(broken), "a file cut off in its header is rejected");
+            std::ofstream(broken, std::ios::binary) << "{\"after\": \"t3_abc123\"}";
+            check(rejected(broken), "a file that isn't a saved filter is rejected");
+            check(rejected("tests/seenfilter.missing"), "a file that doesn't exist is rejected");
+        } catch (const std::exception & e) {
+            check(false, std::string("saving and loading the filter threw: ") + e.what());
+        }
+        std::remove(path.c_str());
+        std::remove(broken.c_str());
+    }
+
+    if (failures == 0) {
+        std::cout << "All checks passed" << std::endl;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}